@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+#
+# Convert a binary trace file, written by a winpty process when the
+# WINPTY_TRACE_FILE environment variable is set, to the text lines that
+# DebugServer would have printed.  See TraceLog in src/shared/DebugClient.cc
+# for the format.
+
+# Copyright (c) 2016 Ryan Prichard
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+import struct
+import sys
+
+HEADER = struct.Struct("<8sIIQQqH")
+RECORD = struct.Struct("<QIH")
+
+def decode(path, out):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, pid, freq, qpcStart, unixStart, nameLen = \
+        HEADER.unpack_from(data, 0)
+    if magic != b"winptytr" or version != 1:
+        sys.exit("error: %s is not a version 1 winpty trace file" % path)
+    pos = HEADER.size
+    module = data[pos:pos + nameLen].decode("utf-8", "replace")
+    pos += nameLen
+    while pos + RECORD.size <= len(data):
+        qpc, tid, length = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        text = data[pos:pos + length].decode("utf-8", "replace")
+        pos += length
+        # Integer arithmetic, like DebugClient.cc, so the output matches.
+        millis = (unixStart + (qpc - qpcStart) * 1000 // freq) % 100000000
+        out.write("[%05d.%03d %s,p%04d,t%04d]: %s\n" % (
+            millis // 1000, millis % 1000, module, pid, tid, text))
+    if pos != len(data):
+        sys.stderr.write("warning: %s: truncated record at offset %d\n" %
+                         (path, pos))
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("Usage: %s TRACE-FILE..." % sys.argv[0])
+    for path in sys.argv[1:]:
+        decode(path, sys.stdout)
+
+if __name__ == "__main__":
+    main()
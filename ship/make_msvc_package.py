@@ -123,6 +123,7 @@ def build(arch, packageDir, xp=False):
     shutil.copy(binSrc + "/winpty-agent.exe",           archPackageDir + "/bin")
     shutil.copy(binSrc + "/winpty-debugserver.exe",     archPackageDir + "/bin")
     shutil.copy(binSrc + "/winpty.lib",                 archPackageDir + "/lib")
+    shutil.copy(binSrc + "/lib/winpty-frame-decoder.lib", archPackageDir + "/lib")
 
 def buildPackage():
     versionInfo = MSVC_VERSION_TABLE[ARGS.msvc_version]
@@ -153,6 +154,7 @@ def buildPackage():
     common_ship.mkdir(packageDir + "/include")
     shutil.copy(topDir + "/src/include/winpty.h",               packageDir + "/include")
     shutil.copy(topDir + "/src/include/winpty_constants.h",     packageDir + "/include")
+    shutil.copy(topDir + "/src/shared/FrameDecoder.h",          packageDir + "/include")
     shutil.copy(topDir + "/LICENSE",                            packageDir)
     shutil.copy(topDir + "/README.md",                          packageDir)
     shutil.copy(topDir + "/RELEASES.md",                        packageDir)
@@ -0,0 +1,72 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_ADAPTIVE_POLL_INTERVAL_H
+#define AGENT_ADAPTIVE_POLL_INTERVAL_H
+
+#include <algorithm>
+
+// Decides how long the event loop waits between poll timeouts.  The interval
+// starts at the minimum and doubles after each poll that saw no activity, up
+// to the maximum.  Any activity (input from the terminal, output scraped from
+// the console) snaps it back to the minimum, so an idle console is polled
+// rarely, but a busy one is polled as often as it was with a fixed interval.
+//
+// This class has no Win32 dependencies so that the policy can be exercised
+// with a simulated clock (see AdaptivePollIntervalTest.cc).
+class AdaptivePollInterval {
+public:
+    AdaptivePollInterval() {}
+    AdaptivePollInterval(int minMs, int maxMs) { setRange(minMs, maxMs); }
+
+    void setRange(int minMs, int maxMs) {
+        m_minMs = minMs;
+        m_maxMs = std::max(minMs, maxMs);
+        m_currentMs = minMs;
+        m_sawActivity = false;
+    }
+
+    int current() const { return m_currentMs; }
+    int minimum() const { return m_minMs; }
+    int maximum() const { return m_maxMs; }
+
+    void noteActivity() {
+        m_currentMs = m_minMs;
+        m_sawActivity = true;
+    }
+
+    // Called after each poll.  Back off unless something happened since the
+    // previous poll.
+    void pollFinished() {
+        if (!m_sawActivity && m_currentMs > 0) {
+            m_currentMs = m_currentMs > m_maxMs / 2
+                ? m_maxMs : m_currentMs * 2;
+        }
+        m_sawActivity = false;
+    }
+
+private:
+    int m_minMs = 0;
+    int m_maxMs = 0;
+    int m_currentMs = 0;
+    bool m_sawActivity = false;
+};
+
+#endif // AGENT_ADAPTIVE_POLL_INTERVAL_H
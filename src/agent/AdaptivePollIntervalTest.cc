@@ -0,0 +1,149 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Simulate the agent's event loop against a scripted console and report how
+// often it wakes up and how long console changes wait to be scraped, for a
+// fixed poll interval and for the adaptive one.
+
+#include "AdaptivePollInterval.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../tests/VirtualEventLoop.h"
+
+namespace {
+
+// A scripted workload.  Each input event is immediately seen by the agent
+// (it wakes up on the CONIN pipe).  Each console change is seen by the next
+// poll after it happens.
+struct Workload {
+    Workload(const char *name, int durationMs) :
+        name(name), durationMs(durationMs)
+    {
+    }
+    const char *name;
+    int durationMs;
+    std::vector<int> inputTimes;
+    std::vector<int> changeTimes;
+};
+
+struct Result {
+    int wakes = 0;
+    std::vector<int> latencies;
+};
+
+Result simulate(const Workload &w, int minMs, int maxMs) {
+    AdaptivePollInterval interval(minMs, maxMs);
+    VirtualEventLoop loop(w.inputTimes);
+    Result ret;
+    size_t nextChange = 0;
+    while (loop.now() < w.durationMs) {
+        if (!loop.wait(interval.current())) {
+            // The event loop woke up for the input, which resets the
+            // interval.
+            interval.noteActivity();
+            continue;
+        }
+        bool sawChange = false;
+        while (nextChange < w.changeTimes.size() &&
+                w.changeTimes[nextChange] <= loop.now()) {
+            ret.latencies.push_back(loop.now() - w.changeTimes[nextChange++]);
+            sawChange = true;
+        }
+        if (sawChange) {
+            interval.noteActivity();
+        }
+        interval.pollFinished();
+    }
+    ret.wakes = loop.wakes();
+    return ret;
+}
+
+int percentile(std::vector<int> v, int pct) {
+    if (v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, v.size() * pct / 100)];
+}
+
+void report(const Workload &w, int minMs, int maxMs) {
+    const Result r = simulate(w, minMs, maxMs);
+    printf("  %-10s %3d..%-3dms  wakes/s=%6.1f  latency ms: "
+           "p50=%3d p90=%3d p99=%3d max=%3d\n",
+           w.name, minMs, maxMs,
+           r.wakes * 1000.0 / w.durationMs,
+           percentile(r.latencies, 50),
+           percentile(r.latencies, 90),
+           percentile(r.latencies, 99),
+           r.latencies.empty() ? 0 :
+               *std::max_element(r.latencies.begin(), r.latencies.end()));
+}
+
+// Nothing happens except a clock in the status line that changes once per
+// second.
+Workload idleWorkload() {
+    Workload w("idle", 60000);
+    for (int t = 513; t < w.durationMs; t += 1000) {
+        w.changeTimes.push_back(t);
+    }
+    return w;
+}
+
+// Bursts of typing, each keypress echoed a few milliseconds later, followed
+// by a command that prints output for a while, separated by idle periods.
+Workload burstyWorkload() {
+    Workload w("bursty", 60000);
+    srand(1);
+    int t = 1000;
+    while (t < w.durationMs) {
+        const int keys = 5 + rand() % 20;
+        for (int i = 0; i < keys; ++i) {
+            t += 60 + rand() % 200;
+            w.inputTimes.push_back(t);
+            w.changeTimes.push_back(t + 1 + rand() % 5);
+        }
+        const int outputEnd = t + rand() % 2000;
+        while (t < outputEnd) {
+            t += 1 + rand() % 40;
+            w.changeTimes.push_back(t);
+        }
+        t += 2000 + rand() % 8000;
+    }
+    return w;
+}
+
+} // anonymous namespace
+
+int main() {
+    const Workload workloads[] = { idleWorkload(), burstyWorkload() };
+    for (const auto &w : workloads) {
+        printf("%s:\n", w.name);
+        report(w, 25, 25);
+        report(w, 25, 100);
+        report(w, 25, 200);
+        report(w, 25, 500);
+    }
+    return 0;
+}
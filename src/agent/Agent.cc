@@ -40,9 +40,11 @@
 #include "../shared/GenRandom.h"
 #include "../shared/StringBuilder.h"
 #include "../shared/StringUtil.h"
+#include "../shared/TimeMeasurement.h"
 #include "../shared/WindowsVersion.h"
 #include "../shared/WinptyAssert.h"
 
+#include "AgentStats.h"
 #include "ConsoleFont.h"
 #include "ConsoleInput.h"
 #include "NamedPipe.h"
@@ -147,16 +149,36 @@ Agent::Agent(LPCWSTR controlPipeName,
              uint64_t agentFlags,
              int mouseMode,
              int initialCols,
-             int initialRows) :
+             int initialRows,
+             int minPollIntervalMs,
+             int maxPollIntervalMs,
+             size_t outputBacklogHigh,
+             size_t outputBacklogLow,
+             const ConsoleLimits &limits) :
     m_useConerr((agentFlags & WINPTY_FLAG_CONERR) != 0),
-    m_plainMode((agentFlags & WINPTY_FLAG_PLAIN_OUTPUT) != 0),
-    m_mouseMode(mouseMode)
+    m_binaryFrames((agentFlags & WINPTY_FLAG_BINARY_FRAMES) != 0),
+    m_plainMode(!m_binaryFrames &&
+                (agentFlags & WINPTY_FLAG_PLAIN_OUTPUT) != 0),
+    m_bracketedPaste((agentFlags & WINPTY_FLAG_BRACKETED_PASTE) != 0),
+    m_mouseMode(mouseMode),
+    m_limits(limits),
+    m_outputBacklogLimit(outputBacklogHigh, outputBacklogLow)
 {
     trace("Agent::Agent entered");
 
     ASSERT(initialCols >= 1 && initialRows >= 1);
-    initialCols = std::min(initialCols, MAX_CONSOLE_WIDTH);
-    initialRows = std::min(initialRows, MAX_CONSOLE_HEIGHT);
+    ASSERT(minPollIntervalMs >= 1 && maxPollIntervalMs >= minPollIntervalMs);
+    ASSERT(outputBacklogLow <= outputBacklogHigh);
+    ASSERT(m_limits.isValid());
+    if (!isAtLeastWindows8()) {
+        // See ConsoleLimits.h.
+        m_limits.bufferLineCount =
+            std::min(m_limits.bufferLineCount, BUFFER_LINE_COUNT);
+        m_limits.maxWidth = std::min(m_limits.maxWidth, MAX_CONSOLE_WIDTH);
+        m_limits.maxHeight = std::min(m_limits.maxHeight, MAX_CONSOLE_HEIGHT);
+    }
+    initialCols = std::min(initialCols, m_limits.maxWidth);
+    initialRows = std::min(initialRows, m_limits.maxHeight);
 
     const bool outputColor =
         !m_plainMode || (agentFlags & WINPTY_FLAG_COLOR_ESCAPES);
@@ -190,27 +212,38 @@ Agent::Agent(LPCWSTR controlPipeName,
     std::unique_ptr<Terminal> primaryTerminal;
     primaryTerminal.reset(new Terminal(*m_conoutPipe,
                                        m_plainMode,
-                                       outputColor));
+                                       outputColor,
+                                       m_binaryFrames));
     m_primaryScraper.reset(new Scraper(m_console,
                                        *primaryBuffer,
                                        std::move(primaryTerminal),
-                                       initialSize));
+                                       initialSize,
+                                       m_limits));
     if (m_useConerr) {
         std::unique_ptr<Terminal> errorTerminal;
         errorTerminal.reset(new Terminal(*m_conerrPipe,
                                          m_plainMode,
-                                         outputColor));
+                                         outputColor,
+                                         m_binaryFrames));
         m_errorScraper.reset(new Scraper(m_console,
                                          *m_errorBuffer,
                                          std::move(errorTerminal),
-                                         initialSize));
+                                         initialSize,
+                                         m_limits));
+    }
+    if (agentFlags & WINPTY_FLAG_LINE_HASHING) {
+        m_primaryScraper->setLineHashing(true);
+        if (m_errorScraper) {
+            m_errorScraper->setLineHashing(true);
+        }
     }
 
     m_console.setTitle(m_currentTitle);
 
     const HANDLE conin = GetStdHandle(STD_INPUT_HANDLE);
     m_consoleInput.reset(
-        new ConsoleInput(conin, m_mouseMode, *this, m_console));
+        new ConsoleInput(conin, m_mouseMode, m_bracketedPaste, *this,
+                         m_console));
 
     // Setup Ctrl-C handling.  First restore default handling of Ctrl-C.  This
     // attribute is inherited by child processes.  Then register a custom
@@ -219,7 +252,7 @@ Agent::Agent(LPCWSTR controlPipeName,
     SetConsoleCtrlHandler(NULL, FALSE);
     SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
 
-    setPollInterval(25);
+    setPollInterval(minPollIntervalMs, maxPollIntervalMs);
 }
 
 Agent::~Agent()
@@ -237,7 +270,7 @@ Agent::~Agent()
 // bytes before it are complete keypresses.
 void Agent::sendDsr()
 {
-    if (!m_plainMode && !m_conoutPipe->isClosed()) {
+    if (!m_plainMode && !m_binaryFrames && !m_conoutPipe->isClosed()) {
         m_conoutPipe->write("\x1B[6n");
     }
 }
@@ -308,6 +341,8 @@ void Agent::pollControlPipe()
         packetData.resize(packetSize);
         const auto amt2 = m_controlPipe->read(packetData.data(), packetSize);
         ASSERT(amt2 == packetSize);
+        // A control request (e.g. a resize) usually changes the console.
+        resetPollInterval();
         try {
             ReadBuffer buffer(std::move(packetData));
             buffer.getRawValue<uint64_t>(); // Discard the size.
@@ -333,9 +368,15 @@ void Agent::handlePacket(ReadBuffer &packet)
         // at once, we can ignore the early ones.
         handleSetSizePacket(packet);
         break;
+    case AgentMsg::SetSizeAsync:
+        handleSetSizeAsyncPacket(packet);
+        break;
     case AgentMsg::GetConsoleProcessList:
         handleGetConsoleProcessListPacket(packet);
         break;
+    case AgentMsg::GetStats:
+        handleGetStatsPacket(packet);
+        break;
     default:
         trace("Unrecognized message, id:%d", type);
     }
@@ -425,11 +466,26 @@ void Agent::handleSetSizePacket(ReadBuffer &packet)
     const int cols = packet.getInt32();
     const int rows = packet.getInt32();
     packet.assertEof();
+    // This size supersedes any earlier asynchronous request.
+    m_pendingCols = 0;
+    m_pendingRows = 0;
     resizeWindow(cols, rows);
     auto reply = newPacket();
     writePacket(reply);
 }
 
+// There's no reply.  A window drag sends many of these requests, so only the
+// latest is kept, and onPollTimeout applies it.
+void Agent::handleSetSizeAsyncPacket(ReadBuffer &packet)
+{
+    const int cols = packet.getInt32();
+    const int rows = packet.getInt32();
+    packet.assertEof();
+    ASSERT(cols >= 1 && rows >= 1);
+    m_pendingCols = cols;
+    m_pendingRows = rows;
+}
+
 void Agent::handleGetConsoleProcessListPacket(ReadBuffer &packet)
 {
     packet.assertEof();
@@ -457,9 +513,25 @@ void Agent::handleGetConsoleProcessListPacket(ReadBuffer &packet)
     writePacket(reply);
 }
 
+void Agent::handleGetStatsPacket(ReadBuffer &packet)
+{
+    packet.assertEof();
+    auto reply = newPacket();
+    reply.putInt32(WINPTY_STAT_COUNT);
+    for (int i = 0; i < WINPTY_STAT_COUNT; ++i) {
+        reply.putInt64(agentStats().value(i));
+    }
+    writePacket(reply);
+}
+
 void Agent::pollConinPipe()
 {
     const std::string newData = m_coninPipe->readAllToString();
+    if (!newData.empty()) {
+        // The console will probably echo the input soon, so start polling
+        // quickly again.
+        resetPollInterval();
+    }
     if (hasDebugFlag("input_separated_bytes")) {
         // This debug flag is intended to help with testing incomplete escape
         // sequences and multibyte UTF-8 encodings.  (I wonder if the normal
@@ -481,8 +553,15 @@ void Agent::onPollTimeout()
     // escape sequence (e.g. pressing ESC).
     m_consoleInput->flushIncompleteEscapeCode();
 
+    // Continue a paste that was waiting for the console to read its input.
+    m_consoleInput->writeDeferredInput();
+
     const bool shouldScrapeContent = !m_closingOutputPipes;
 
+    // The pipes only drain while the event loop services them, so any growth
+    // in the output queues during this function is output we generated.
+    const size_t outputBefore = queuedOutputBytes();
+
     // Check if the child process has exited.
     if (m_autoShutdown &&
             m_childProcess != nullptr &&
@@ -496,17 +575,57 @@ void Agent::onPollTimeout()
         m_closingOutputPipes = true;
     }
 
+    // If the terminal isn't keeping up with the output, skip scraping until
+    // it catches up, so that it sees the latest screen rather than a backlog
+    // of stale ones.  The final scrape after the child exits always happens.
+    const bool wasThrottled = m_outputBacklogLimit.throttled();
+    const bool backlogAllowsScrape =
+        m_outputBacklogLimit.shouldScrape(outputBefore);
+    if (m_outputBacklogLimit.throttled() != wasThrottled) {
+        trace("Output backlog %s: %u bytes queued",
+              wasThrottled ? "drained" : "exceeded limit",
+              static_cast<unsigned>(outputBefore));
+    }
+
     // Scrape for output *after* the above exit-check to ensure that we collect
     // the child process's final output.
-    if (shouldScrapeContent) {
+    if (shouldScrapeContent &&
+            (backlogAllowsScrape || m_closingOutputPipes)) {
         syncConsoleTitle();
-        scrapeBuffers();
+        TimeMeasurement scrapeTime;
+        if (m_pendingCols > 0) {
+            // Apply the latest asynchronous resize.  Resizing scrapes the
+            // console, so it takes the place of this poll's scrape.  While
+            // scraping is held back, the size stays pending.
+            const int cols = m_pendingCols;
+            const int rows = m_pendingRows;
+            m_pendingCols = 0;
+            m_pendingRows = 0;
+            resizeWindow(cols, rows);
+        } else {
+            scrapeBuffers();
+        }
+        agentStats().addScrape(
+            static_cast<uint64_t>(scrapeTime.elapsed() * 1000000.0));
     }
 
-    // We must ensure that we disable mouse mode before closing the CONOUT
-    // pipe, so update the mouse mode here.
+    // We must ensure that we disable mouse mode and bracketed paste before
+    // closing the CONOUT pipe, so update the modes here.
     m_primaryScraper->terminal().enableMouseMode(
         enableMouseMode && !m_closingOutputPipes);
+    m_primaryScraper->terminal().enableBracketedPaste(
+        m_bracketedPaste && !m_closingOutputPipes);
+
+    // Poll less often while the console is idle.  While scraping is held
+    // back, or a paste is held back, keep polling quickly so it resumes soon
+    // after the backlog drains.
+    if (queuedOutputBytes() != outputBefore ||
+            m_outputBacklogLimit.throttled() ||
+            m_consoleInput->hasDeferredInput()) {
+        resetPollInterval();
+    }
+
+    agentStats().setOutputQueueBytes(queuedOutputBytes());
 
     autoClosePipesForShutdown();
 }
@@ -537,6 +656,15 @@ void Agent::autoClosePipesForShutdown()
     }
 }
 
+size_t Agent::queuedOutputBytes()
+{
+    size_t ret = m_conoutPipe->bytesToSend();
+    if (m_conerrPipe != nullptr) {
+        ret += m_conerrPipe->bytesToSend();
+    }
+    return ret;
+}
+
 std::unique_ptr<Win32ConsoleBuffer> Agent::openPrimaryBuffer()
 {
     // If we're using a separate buffer for stderr, and a program were to
@@ -554,8 +682,8 @@ std::unique_ptr<Win32ConsoleBuffer> Agent::openPrimaryBuffer()
 void Agent::resizeWindow(int cols, int rows)
 {
     ASSERT(cols >= 1 && rows >= 1);
-    cols = std::min(cols, MAX_CONSOLE_WIDTH);
-    rows = std::min(rows, MAX_CONSOLE_HEIGHT);
+    cols = std::min(cols, m_limits.maxWidth);
+    rows = std::min(rows, m_limits.maxHeight);
 
     Win32Console::FreezeGuard guard(m_console, m_console.frozen());
     const Coord newSize(cols, rows);
@@ -602,10 +730,8 @@ void Agent::syncConsoleTitle()
 {
     std::wstring newTitle = m_console.title();
     if (newTitle != m_currentTitle) {
-        if (!m_plainMode && !m_conoutPipe->isClosed()) {
-            std::string command = std::string("\x1b]0;") +
-                    utf8FromWide(newTitle) + "\x07";
-            m_conoutPipe->write(command.c_str());
+        if (!m_conoutPipe->isClosed()) {
+            m_primaryScraper->terminal().sendTitle(newTitle);
         }
         m_currentTitle = newTitle;
     }
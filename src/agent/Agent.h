@@ -27,8 +27,10 @@
 #include <memory>
 #include <string>
 
+#include "ConsoleLimits.h"
 #include "DsrSender.h"
 #include "EventLoop.h"
+#include "OutputBacklogLimit.h"
 #include "Win32Console.h"
 
 class ConsoleInput;
@@ -45,7 +47,12 @@ public:
           uint64_t agentFlags,
           int mouseMode,
           int initialCols,
-          int initialRows);
+          int initialRows,
+          int minPollIntervalMs,
+          int maxPollIntervalMs,
+          size_t outputBacklogHigh,
+          size_t outputBacklogLow,
+          const ConsoleLimits &limits);
     virtual ~Agent();
     void sendDsr() override;
 
@@ -59,7 +66,9 @@ private:
     void writePacket(WriteBuffer &packet);
     void handleStartProcessPacket(ReadBuffer &packet);
     void handleSetSizePacket(ReadBuffer &packet);
+    void handleSetSizeAsyncPacket(ReadBuffer &packet);
     void handleGetConsoleProcessListPacket(ReadBuffer &packet);
+    void handleGetStatsPacket(ReadBuffer &packet);
     void pollConinPipe();
 
 protected:
@@ -68,6 +77,7 @@ protected:
 
 private:
     void autoClosePipesForShutdown();
+    size_t queuedOutputBytes();
     std::unique_ptr<Win32ConsoleBuffer> openPrimaryBuffer();
     void resizeWindow(int cols, int rows);
     void scrapeBuffers();
@@ -75,8 +85,11 @@ private:
 
 private:
     const bool m_useConerr;
+    const bool m_binaryFrames;
     const bool m_plainMode;
+    const bool m_bracketedPaste;
     const int m_mouseMode;
+    ConsoleLimits m_limits;
     Win32Console m_console;
     std::unique_ptr<Scraper> m_primaryScraper;
     std::unique_ptr<Scraper> m_errorScraper;
@@ -88,6 +101,12 @@ private:
     bool m_autoShutdown = false;
     bool m_exitAfterShutdown = false;
     bool m_closingOutputPipes = false;
+    OutputBacklogLimit m_outputBacklogLimit;
+    // The latest size from winpty_set_size_async, applied at the next poll
+    // that scrapes the console.
+    // The column count is 0 if there is none.
+    int m_pendingCols = 0;
+    int m_pendingRows = 0;
     std::unique_ptr<ConsoleInput> m_consoleInput;
     HANDLE m_childProcess = nullptr;
 
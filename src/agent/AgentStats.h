@@ -0,0 +1,75 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_AGENT_STATS_H
+#define AGENT_AGENT_STATS_H
+
+#include <stdint.h>
+
+#include "../include/winpty_constants.h"
+
+// The counters reported by winpty_get_stats, indexed by the WINPTY_STAT_*
+// constants.  The agent does all of its work on its one thread, so the
+// counters are plain integers, and updating one is an add.
+class AgentStats {
+public:
+    void add(int stat, uint64_t amount) { m_values[stat] += amount; }
+
+    void setOutputQueueBytes(uint64_t bytes) {
+        m_values[WINPTY_STAT_OUTPUT_QUEUE_BYTES] = bytes;
+        if (bytes > m_values[WINPTY_STAT_OUTPUT_QUEUE_MAX_BYTES]) {
+            m_values[WINPTY_STAT_OUTPUT_QUEUE_MAX_BYTES] = bytes;
+        }
+    }
+
+    void addScrape(uint64_t micros) {
+        m_values[WINPTY_STAT_SCRAPE_COUNT]++;
+        m_values[WINPTY_STAT_SCRAPE_MICROSECONDS] += micros;
+        m_values[WINPTY_STAT_SCRAPE_HISTOGRAM + histogramBucket(micros)]++;
+    }
+
+    void addFreeze(uint64_t micros) {
+        m_values[WINPTY_STAT_FREEZE_COUNT]++;
+        m_values[WINPTY_STAT_FREEZE_MICROSECONDS] += micros;
+        m_values[WINPTY_STAT_FREEZE_HISTOGRAM + histogramBucket(micros)]++;
+    }
+
+    uint64_t value(int stat) const { return m_values[stat]; }
+
+private:
+    static int histogramBucket(uint64_t micros) {
+        int bucket = 0;
+        while (bucket < WINPTY_STAT_HISTOGRAM_BUCKETS - 1 &&
+                micros >= (64ull << bucket)) {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    uint64_t m_values[WINPTY_STAT_COUNT] = {};
+};
+
+// The agent's statistics.  There is one agent per process.
+inline AgentStats &agentStats() {
+    static AgentStats stats;
+    return stats;
+}
+
+#endif // AGENT_AGENT_STATS_H
@@ -0,0 +1,496 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "CellScan.h"
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define CELL_SCAN_X86 1
+#define CELL_SCAN_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define CELL_SCAN_X86 1
+#define CELL_SCAN_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+//
+// Scalar kernels
+//
+
+inline bool cellsEqual(const CHAR_INFO &a, const CHAR_INFO &b) {
+    return a.Char.UnicodeChar == b.Char.UnicodeChar &&
+           a.Attributes == b.Attributes;
+}
+
+int firstNonBlankScalar(const CHAR_INFO *cells, int count, WORD attributes) {
+    for (int i = 0; i < count; ++i) {
+        if (cells[i].Char.UnicodeChar != L' ' ||
+                cells[i].Attributes != attributes) {
+            return i;
+        }
+    }
+    return count;
+}
+
+int blankSuffixScalar(const CHAR_INFO *cells, int count, WORD attributes) {
+    for (int i = count - 1; i >= 0; --i) {
+        if (cells[i].Char.UnicodeChar != L' ' ||
+                cells[i].Attributes != attributes) {
+            return count - 1 - i;
+        }
+    }
+    return count;
+}
+
+int equalPrefixScalar(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!cellsEqual(a[i], b[i])) {
+            return i;
+        }
+    }
+    return count;
+}
+
+int equalSuffixScalar(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    for (int i = count - 1; i >= 0; --i) {
+        if (!cellsEqual(a[i], b[i])) {
+            return count - 1 - i;
+        }
+    }
+    return count;
+}
+
+int asciiPrefixScalar(const CHAR_INFO *cells, int count, WORD attributes,
+                      char *out) {
+    for (int i = 0; i < count; ++i) {
+        const wchar_t ch = cells[i].Char.UnicodeChar;
+        if (ch < 0x20 || ch > 0x7E || cells[i].Attributes != attributes) {
+            return i;
+        }
+        out[i] = static_cast<char>(ch);
+    }
+    return count;
+}
+
+void maskAttributesScalar(CHAR_INFO *cells, size_t count, WORD mask) {
+    for (size_t i = 0; i < count; ++i) {
+        cells[i].Attributes &= mask;
+    }
+}
+
+const CellScanKernels kScalarKernels = {
+    "scalar",
+    firstNonBlankScalar,
+    blankSuffixScalar,
+    equalPrefixScalar,
+    equalSuffixScalar,
+    asciiPrefixScalar,
+    maskAttributesScalar,
+};
+
+#ifdef CELL_SCAN_X86
+
+//
+// x86 kernels
+//
+// A CHAR_INFO is a little-endian 32-bit value: the UTF-16 code unit in the
+// low half and the attributes in the high half.  Each kernel compares a
+// vector of cells at a time, converts the comparison result to a byte mask
+// (four bits per cell), and locates the first or last mismatching cell with a
+// bit scan.  The final partial vector is handled by the scalar kernel.  The
+// attribute-masking kernels just AND each vector with a constant.
+//
+
+inline int lowestSetBit(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long ret;
+    _BitScanForward(&ret, v);
+    return ret;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+inline int highestSetBit(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long ret;
+    _BitScanReverse(&ret, v);
+    return ret;
+#else
+    return 31 - __builtin_clz(v);
+#endif
+}
+
+inline int blankPattern(WORD attributes) {
+    return static_cast<int>(0x20u | (static_cast<uint32_t>(attributes) << 16));
+}
+
+// Keeps the character and the `mask` bits of the attributes.
+inline int attributesMaskPattern(WORD mask) {
+    return static_cast<int>(0xFFFFu | (static_cast<uint32_t>(mask) << 16));
+}
+
+CELL_SCAN_TARGET("sse2")
+inline __m128i load4(const CHAR_INFO *cells) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells));
+}
+
+// Returns a mask with four bits set for each cell of `a` that differs from
+// the corresponding cell of `b`.
+CELL_SCAN_TARGET("sse2")
+inline uint32_t mismatch4(__m128i a, __m128i b) {
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi32(a, b))) ^ 0xFFFFu;
+}
+
+CELL_SCAN_TARGET("sse2")
+int firstNonBlankSse2(const CHAR_INFO *cells, int count, WORD attributes) {
+    const __m128i blank = _mm_set1_epi32(blankPattern(attributes));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32_t mask = mismatch4(load4(cells + i), blank);
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + firstNonBlankScalar(cells + i, count - i, attributes);
+}
+
+CELL_SCAN_TARGET("sse2")
+int blankSuffixSse2(const CHAR_INFO *cells, int count, WORD attributes) {
+    const __m128i blank = _mm_set1_epi32(blankPattern(attributes));
+    int n = count;
+    for (; n >= 4; n -= 4) {
+        const uint32_t mask = mismatch4(load4(cells + n - 4), blank);
+        if (mask != 0) {
+            return count - (n - 4 + highestSetBit(mask) / 4) - 1;
+        }
+    }
+    return count - n + blankSuffixScalar(cells, n, attributes);
+}
+
+CELL_SCAN_TARGET("sse2")
+int equalPrefixSse2(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32_t mask = mismatch4(load4(a + i), load4(b + i));
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + equalPrefixScalar(a + i, b + i, count - i);
+}
+
+CELL_SCAN_TARGET("sse2")
+int equalSuffixSse2(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    int n = count;
+    for (; n >= 4; n -= 4) {
+        const uint32_t mask = mismatch4(load4(a + n - 4), load4(b + n - 4));
+        if (mask != 0) {
+            return count - (n - 4 + highestSetBit(mask) / 4) - 1;
+        }
+    }
+    return count - n + equalSuffixScalar(a, b, n);
+}
+
+// Returns all-ones in each cell's 32-bit lane if it is printable ASCII with
+// the attributes in `pattern` (see asciiPattern).
+CELL_SCAN_TARGET("sse2")
+inline __m128i asciiMatch4(__m128i cells, __m128i pattern) {
+    // Compare the attributes in the high halves.  The character comparisons
+    // are signed, so a code unit of 0x8000 or more also fails them.  Their
+    // results for the high halves are ignored.
+    const __m128i highHalves = _mm_set1_epi32(static_cast<int>(0xFFFF0000u));
+    const __m128i attrs = _mm_cmpeq_epi32(
+        _mm_and_si128(cells, highHalves), pattern);
+    const __m128i chars = _mm_and_si128(
+        _mm_cmpgt_epi16(cells, _mm_set1_epi16(0x1F)),
+        _mm_cmplt_epi16(cells, _mm_set1_epi16(0x7F)));
+    return _mm_and_si128(attrs, _mm_or_si128(chars, highHalves));
+}
+
+inline int asciiPattern(WORD attributes) {
+    return static_cast<int>(static_cast<uint32_t>(attributes) << 16);
+}
+
+// Narrow the code units of eight cells to bytes.  Code units above 0x7FFF
+// saturate, which doesn't matter, because they end the ASCII prefix.
+CELL_SCAN_TARGET("sse2")
+inline void narrow8(__m128i lo, __m128i hi, char *out) {
+    const __m128i lowHalves = _mm_set1_epi32(0xFFFF);
+    const __m128i words = _mm_packs_epi32(_mm_and_si128(lo, lowHalves),
+                                          _mm_and_si128(hi, lowHalves));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out),
+                     _mm_packus_epi16(words, words));
+}
+
+CELL_SCAN_TARGET("sse2")
+int asciiPrefixSse2(const CHAR_INFO *cells, int count, WORD attributes,
+                    char *out) {
+    const __m128i pattern = _mm_set1_epi32(asciiPattern(attributes));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i lo = load4(cells + i);
+        const __m128i hi = load4(cells + i + 4);
+        narrow8(lo, hi, out + i);
+        const uint32_t mask = ~static_cast<uint32_t>(
+            _mm_movemask_epi8(asciiMatch4(lo, pattern)) |
+            (_mm_movemask_epi8(asciiMatch4(hi, pattern)) << 16));
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + asciiPrefixScalar(cells + i, count - i, attributes, out + i);
+}
+
+CELL_SCAN_TARGET("sse2")
+void maskAttributesSse2(CHAR_INFO *cells, size_t count, WORD mask) {
+    const __m128i pattern = _mm_set1_epi32(attributesMaskPattern(mask));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *const p = reinterpret_cast<__m128i*>(cells + i);
+        _mm_storeu_si128(p, _mm_and_si128(_mm_loadu_si128(p), pattern));
+    }
+    maskAttributesScalar(cells + i, count - i, mask);
+}
+
+const CellScanKernels kSse2Kernels = {
+    "sse2",
+    firstNonBlankSse2,
+    blankSuffixSse2,
+    equalPrefixSse2,
+    equalSuffixSse2,
+    asciiPrefixSse2,
+    maskAttributesSse2,
+};
+
+CELL_SCAN_TARGET("avx2")
+inline __m256i load8(const CHAR_INFO *cells) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells));
+}
+
+CELL_SCAN_TARGET("avx2")
+inline uint32_t mismatch8(__m256i a, __m256i b) {
+    return ~static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)));
+}
+
+CELL_SCAN_TARGET("avx2")
+int firstNonBlankAvx2(const CHAR_INFO *cells, int count, WORD attributes) {
+    const __m256i blank = _mm256_set1_epi32(blankPattern(attributes));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint32_t mask = mismatch8(load8(cells + i), blank);
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + firstNonBlankScalar(cells + i, count - i, attributes);
+}
+
+CELL_SCAN_TARGET("avx2")
+int blankSuffixAvx2(const CHAR_INFO *cells, int count, WORD attributes) {
+    const __m256i blank = _mm256_set1_epi32(blankPattern(attributes));
+    int n = count;
+    for (; n >= 8; n -= 8) {
+        const uint32_t mask = mismatch8(load8(cells + n - 8), blank);
+        if (mask != 0) {
+            return count - (n - 8 + highestSetBit(mask) / 4) - 1;
+        }
+    }
+    return count - n + blankSuffixScalar(cells, n, attributes);
+}
+
+CELL_SCAN_TARGET("avx2")
+int equalPrefixAvx2(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint32_t mask = mismatch8(load8(a + i), load8(b + i));
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + equalPrefixScalar(a + i, b + i, count - i);
+}
+
+CELL_SCAN_TARGET("avx2")
+int equalSuffixAvx2(const CHAR_INFO *a, const CHAR_INFO *b, int count) {
+    int n = count;
+    for (; n >= 8; n -= 8) {
+        const uint32_t mask = mismatch8(load8(a + n - 8), load8(b + n - 8));
+        if (mask != 0) {
+            return count - (n - 8 + highestSetBit(mask) / 4) - 1;
+        }
+    }
+    return count - n + equalSuffixScalar(a, b, n);
+}
+
+CELL_SCAN_TARGET("avx2")
+int asciiPrefixAvx2(const CHAR_INFO *cells, int count, WORD attributes,
+                    char *out) {
+    const __m256i pattern = _mm256_set1_epi32(asciiPattern(attributes));
+    const __m256i highHalves =
+        _mm256_set1_epi32(static_cast<int>(0xFFFF0000u));
+    const __m256i minChar = _mm256_set1_epi16(0x1F);
+    const __m256i maxChar = _mm256_set1_epi16(0x7F);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i v = load8(cells + i);
+        narrow8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1),
+                out + i);
+        // See asciiMatch4.
+        const __m256i attrs = _mm256_cmpeq_epi32(
+            _mm256_and_si256(v, highHalves), pattern);
+        const __m256i chars = _mm256_and_si256(
+            _mm256_cmpgt_epi16(v, minChar), _mm256_cmpgt_epi16(maxChar, v));
+        const uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(attrs, _mm256_or_si256(chars, highHalves))));
+        if (mask != 0) {
+            return i + lowestSetBit(mask) / 4;
+        }
+    }
+    return i + asciiPrefixScalar(cells + i, count - i, attributes, out + i);
+}
+
+CELL_SCAN_TARGET("avx2")
+void maskAttributesAvx2(CHAR_INFO *cells, size_t count, WORD mask) {
+    const __m256i pattern = _mm256_set1_epi32(attributesMaskPattern(mask));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i *const p = reinterpret_cast<__m256i*>(cells + i);
+        _mm256_storeu_si256(p, _mm256_and_si256(_mm256_loadu_si256(p), pattern));
+    }
+    maskAttributesScalar(cells + i, count - i, mask);
+}
+
+const CellScanKernels kAvx2Kernels = {
+    "avx2",
+    firstNonBlankAvx2,
+    blankSuffixAvx2,
+    equalPrefixAvx2,
+    equalSuffixAvx2,
+    asciiPrefixAvx2,
+    maskAttributesAvx2,
+};
+
+bool cpuHasSse2() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpuHasAvx2() {
+#ifdef _MSC_VER
+    // AVX2 requires both the CPU feature bit and OS support for saving the
+    // YMM registers.
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+    __cpuid(regs, 1);
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // CELL_SCAN_X86
+
+inline uint64_t rotl64(uint64_t v, int bits) {
+    return (v << bits) | (v >> (64 - bits));
+}
+
+const CellScanKernels &selectKernels() {
+    const CellScanKernels *ret = nullptr;
+    if ((ret = cellScanKernels(CellScanLevel::Avx2)) != nullptr) {
+        return *ret;
+    }
+    if ((ret = cellScanKernels(CellScanLevel::Sse2)) != nullptr) {
+        return *ret;
+    }
+    return kScalarKernels;
+}
+
+} // anonymous namespace
+
+const CellScanKernels *cellScanKernels(CellScanLevel level) {
+#ifdef CELL_SCAN_X86
+    if (sizeof(CHAR_INFO) == 4) {
+        if (level == CellScanLevel::Avx2) {
+            static const bool supported = cpuHasAvx2();
+            return supported ? &kAvx2Kernels : nullptr;
+        }
+        if (level == CellScanLevel::Sse2) {
+            static const bool supported = cpuHasSse2();
+            return supported ? &kSse2Kernels : nullptr;
+        }
+    }
+#endif
+    return level == CellScanLevel::Scalar ? &kScalarKernels : nullptr;
+}
+
+const CellScanKernels &cellScan() {
+    static const CellScanKernels &kernels = selectKernels();
+    return kernels;
+}
+
+// A fast 64-bit hash of the cells' values, processing two cells per round.
+uint64_t cellRangeHash(const CHAR_INFO *cells, int count) {
+    const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+    auto cellValue = [](const CHAR_INFO &cell) -> uint64_t {
+        return static_cast<uint16_t>(cell.Char.UnicodeChar) |
+            (static_cast<uint64_t>(cell.Attributes) << 16);
+    };
+    uint64_t h = kPrime3 + static_cast<uint64_t>(count);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const uint64_t k = cellValue(cells[i]) | (cellValue(cells[i + 1]) << 32);
+        h = rotl64(h + k * kPrime2, 31) * kPrime1;
+    }
+    if (i < count) {
+        h = rotl64(h + cellValue(cells[i]) * kPrime2, 31) * kPrime1;
+    }
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_CELL_SCAN_H
+#define AGENT_CELL_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ConsoleTypes.h"
+
+// Vectorized scans over CHAR_INFO arrays.  The Scraper and ConsoleLine run
+// these over every buffered line on every scrape, and lines can be up to
+// MAX_CONSOLE_WIDTH cells wide.
+//
+// There are SSE2 and AVX2 implementations and a portable scalar one.  The
+// best implementation the CPU supports is selected the first time any of the
+// functions below is called.  The kernels compare cells as 32-bit values, so
+// the vector implementations are only used when CHAR_INFO is four bytes.
+
+struct CellScanKernels {
+    const char *name;
+    // Index of the first cell that isn't a space with the given attributes,
+    // or `count` if there is none.
+    int (*firstNonBlank)(const CHAR_INFO *cells, int count, WORD attributes);
+    // Number of trailing cells that are spaces with the given attributes.
+    int (*blankSuffix)(const CHAR_INFO *cells, int count, WORD attributes);
+    // Number of leading cells that are equal in both arrays.
+    int (*equalPrefix)(const CHAR_INFO *a, const CHAR_INFO *b, int count);
+    // Number of trailing cells that are equal in both arrays.
+    int (*equalSuffix)(const CHAR_INFO *a, const CHAR_INFO *b, int count);
+    // Number of leading cells that are printable ASCII (0x20 through 0x7E)
+    // with the given attributes.  Their characters are stored in `out`,
+    // which must have room for `count` bytes.  Bytes past the returned
+    // count are unspecified.
+    int (*asciiPrefix)(const CHAR_INFO *cells, int count, WORD attributes,
+                       char *out);
+    // ANDs each cell's attributes with `mask`, in place.
+    void (*maskAttributes)(CHAR_INFO *cells, size_t count, WORD mask);
+};
+
+enum class CellScanLevel { Scalar, Sse2, Avx2 };
+
+// Returns the kernels for the given level, or nullptr if the CPU (or the
+// build) doesn't support it.  The scalar kernels are always available.
+const CellScanKernels *cellScanKernels(CellScanLevel level);
+
+// The kernels the functions below use.
+const CellScanKernels &cellScan();
+
+inline bool isCellRangeBlank(const CHAR_INFO *cells, int count,
+                             WORD attributes) {
+    return cellScan().firstNonBlank(cells, count, attributes) == count;
+}
+
+inline int firstNonBlankCell(const CHAR_INFO *cells, int count,
+                             WORD attributes) {
+    return cellScan().firstNonBlank(cells, count, attributes);
+}
+
+inline int cellRangeBlankSuffix(const CHAR_INFO *cells, int count,
+                                WORD attributes) {
+    return cellScan().blankSuffix(cells, count, attributes);
+}
+
+inline int cellRangeEqualPrefix(const CHAR_INFO *a, const CHAR_INFO *b,
+                                int count) {
+    return cellScan().equalPrefix(a, b, count);
+}
+
+inline int cellRangeEqualSuffix(const CHAR_INFO *a, const CHAR_INFO *b,
+                                int count) {
+    return cellScan().equalSuffix(a, b, count);
+}
+
+inline int cellRangeAsciiPrefix(const CHAR_INFO *cells, int count,
+                                WORD attributes, char *out) {
+    return cellScan().asciiPrefix(cells, count, attributes, out);
+}
+
+inline void maskCellAttributes(CHAR_INFO *cells, size_t count, WORD mask) {
+    cellScan().maskAttributes(cells, count, mask);
+}
+
+inline bool areCellRangesEqual(const CHAR_INFO *a, const CHAR_INFO *b,
+                               int count) {
+    return cellRangeEqualPrefix(a, b, count) == count;
+}
+
+// A 64-bit hash of the cells' characters and attributes.  It is not
+// vectorized.
+uint64_t cellRangeHash(const CHAR_INFO *cells, int count);
+
+#endif // AGENT_CELL_SCAN_H
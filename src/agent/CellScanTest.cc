@@ -0,0 +1,218 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Check each CellScan implementation the CPU supports against the scalar one.
+
+#include "CellScan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+static CHAR_INFO cell(wchar_t ch, WORD attributes)
+{
+    CHAR_INFO ret;
+    ret.Char.UnicodeChar = ch;
+    ret.Attributes = attributes;
+    return ret;
+}
+
+static int g_failures = 0;
+
+static void check(const char *kernel, const char *what, int length, int pos,
+                  int expected, int actual)
+{
+    if (expected != actual) {
+        printf("Error: %s %s: length=%d pos=%d: expected %d, got %d\n",
+               kernel, what, length, pos, expected, actual);
+        ++g_failures;
+    }
+}
+
+static void checkAsciiPrefix(const CellScanKernels &k, const char *what,
+                             const CHAR_INFO *cells, int length, int pos,
+                             WORD attributes)
+{
+    const CellScanKernels &ref = *cellScanKernels(CellScanLevel::Scalar);
+    std::vector<char> expectedText(length + 1), actualText(length + 1);
+    const int expected =
+        ref.asciiPrefix(cells, length, attributes, expectedText.data());
+    const int actual =
+        k.asciiPrefix(cells, length, attributes, actualText.data());
+    check(k.name, what, length, pos, expected, actual);
+    if (expected == actual &&
+            memcmp(expectedText.data(), actualText.data(), actual) != 0) {
+        printf("Error: %s %s: length=%d pos=%d: wrong text\n",
+               k.name, what, length, pos);
+        ++g_failures;
+    }
+}
+
+static void checkMaskAttributes(const CellScanKernels &k,
+                                const std::vector<CHAR_INFO> &cells,
+                                WORD mask)
+{
+    const CellScanKernels &ref = *cellScanKernels(CellScanLevel::Scalar);
+    std::vector<CHAR_INFO> expected = cells, actual = cells;
+    ref.maskAttributes(expected.data(), expected.size(), mask);
+    k.maskAttributes(actual.data(), actual.size(), mask);
+    if (!expected.empty() &&
+            memcmp(expected.data(), actual.data(),
+                   expected.size() * sizeof(CHAR_INFO)) != 0) {
+        printf("Error: %s maskAttributes: length=%d mask=0x%x: wrong cells\n",
+               k.name, static_cast<int>(cells.size()), mask);
+        ++g_failures;
+    }
+}
+
+static void correctness(const CellScanKernels &k)
+{
+    const CellScanKernels &ref = *cellScanKernels(CellScanLevel::Scalar);
+    for (int length = 0; length <= 70; ++length) {
+        const std::vector<CHAR_INFO> blank(length, cell(L' ', 7));
+        // Vary the character, the attribute, or both at each position, or
+        // put a non-ASCII character there.
+        static const wchar_t kNonAscii[] = { 0x1B, 0x7F, 0xE9, 0x8000 };
+        for (int pos = -1; pos < length; ++pos) {
+            for (int variant = 0; variant < 4; ++variant) {
+                std::vector<CHAR_INFO> line = blank;
+                if (pos >= 0) {
+                    if (variant == 3) {
+                        line[pos].Char.UnicodeChar = kNonAscii[pos % 4];
+                    } else {
+                        if (variant != 1) {
+                            line[pos].Char.UnicodeChar = L'x';
+                        }
+                        if (variant != 0) {
+                            line[pos].Attributes = 0x70;
+                        }
+                    }
+                }
+                const CHAR_INFO *a = blank.data();
+                const CHAR_INFO *b = line.data();
+                check(k.name, "firstNonBlank", length, pos,
+                      ref.firstNonBlank(b, length, 7),
+                      k.firstNonBlank(b, length, 7));
+                check(k.name, "firstNonBlank/attr", length, pos,
+                      ref.firstNonBlank(b, length, 0x70),
+                      k.firstNonBlank(b, length, 0x70));
+                check(k.name, "blankSuffix", length, pos,
+                      ref.blankSuffix(b, length, 7),
+                      k.blankSuffix(b, length, 7));
+                check(k.name, "equalPrefix", length, pos,
+                      ref.equalPrefix(a, b, length),
+                      k.equalPrefix(a, b, length));
+                check(k.name, "equalSuffix", length, pos,
+                      ref.equalSuffix(a, b, length),
+                      k.equalSuffix(a, b, length));
+                checkAsciiPrefix(k, "asciiPrefix", b, length, pos, 7);
+            }
+        }
+    }
+    // Random lines with several differences.
+    srand(1);
+    for (int iter = 0; iter < 100000; ++iter) {
+        const int length = rand() % 300;
+        std::vector<CHAR_INFO> a(length), b(length);
+        for (int i = 0; i < length; ++i) {
+            a[i] = b[i] = cell(rand() % 4 ? L' ' :
+                                   rand() % 8 ? L'a' + rand() % 3 :
+                                   rand() % 0x10000,
+                               rand() % 8 ? 7 : rand() % 16);
+            if (rand() % 50 == 0) {
+                b[i].Attributes ^= 1 << (rand() % 16);
+            }
+        }
+        check(k.name, "random firstNonBlank", length, -1,
+              ref.firstNonBlank(a.data(), length, 7),
+              k.firstNonBlank(a.data(), length, 7));
+        check(k.name, "random blankSuffix", length, -1,
+              ref.blankSuffix(a.data(), length, 7),
+              k.blankSuffix(a.data(), length, 7));
+        check(k.name, "random equalPrefix", length, -1,
+              ref.equalPrefix(a.data(), b.data(), length),
+              k.equalPrefix(a.data(), b.data(), length));
+        check(k.name, "random equalSuffix", length, -1,
+              ref.equalSuffix(a.data(), b.data(), length),
+              k.equalSuffix(a.data(), b.data(), length));
+        checkAsciiPrefix(k, "random asciiPrefix", a.data(), length, -1, 7);
+        checkMaskAttributes(k, b, rand() % 2 ? 0x3FFF : rand() % 0x10000);
+    }
+}
+
+// Scan 3000 blank lines of 2500 cells, as the Scraper would for the largest
+// console it supports.
+static void performance(const CellScanKernels &k)
+{
+    const int width = 2500;
+    const int lines = 3000;
+    const std::vector<CHAR_INFO> a(width, cell(L' ', 7));
+    const std::vector<CHAR_INFO> b = a;
+    const int iterations = 10;
+    long long sum = 0;
+    clock_t start = clock();
+    for (int i = 0; i < iterations * lines; ++i) {
+        sum += k.firstNonBlank(a.data(), width, 7);
+    }
+    const double blankSecs = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+    start = clock();
+    for (int i = 0; i < iterations * lines; ++i) {
+        sum += k.equalPrefix(a.data(), b.data(), width);
+    }
+    const double prefixSecs = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+    std::vector<char> text(width);
+    start = clock();
+    for (int i = 0; i < iterations * lines; ++i) {
+        sum += k.asciiPrefix(a.data(), width, 7, text.data());
+    }
+    const double asciiSecs = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+    printf("%-8s firstNonBlank: %7.2f ms/scan  equalPrefix: %7.2f ms/scan"
+           "  asciiPrefix: %7.2f ms/scan  (%lld)\n",
+           k.name,
+           blankSecs * 1000.0 / iterations,
+           prefixSecs * 1000.0 / iterations,
+           asciiSecs * 1000.0 / iterations,
+           sum);
+}
+
+int main()
+{
+    const CellScanLevel levels[] = {
+        CellScanLevel::Scalar, CellScanLevel::Sse2, CellScanLevel::Avx2,
+    };
+    printf("selected: %s\n", cellScan().name);
+    for (CellScanLevel level : levels) {
+        const CellScanKernels *k = cellScanKernels(level);
+        if (k == nullptr) {
+            continue;
+        }
+        correctness(*k);
+        performance(*k);
+    }
+    if (g_failures != 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    return 0;
+}
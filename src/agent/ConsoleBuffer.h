@@ -0,0 +1,97 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_CONSOLE_BUFFER_H
+#define AGENT_CONSOLE_BUFFER_H
+
+#include <string.h>
+
+#include "ConsoleTypes.h"
+#include "Coord.h"
+#include "SmallRect.h"
+
+class ConsoleScreenBufferInfo : public CONSOLE_SCREEN_BUFFER_INFO {
+public:
+    ConsoleScreenBufferInfo()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    Coord bufferSize() const        { return dwSize;    }
+    SmallRect windowRect() const    { return srWindow;  }
+    Coord cursorPosition() const    { return dwCursorPosition; }
+};
+
+// The screen buffer operations the Scraper needs.  Win32ConsoleBuffer
+// implements them with the console API.  SimConsoleBuffer implements them
+// with an in-memory model of a console, so that the scraping code can be
+// driven by scripted workloads and profiled outside of a real console.
+class ConsoleBuffer {
+public:
+    static const int kDefaultAttributes = 7;
+
+    ConsoleBuffer() {}
+    virtual ~ConsoleBuffer() {}
+    ConsoleBuffer(const ConsoleBuffer &other) = delete;
+    ConsoleBuffer &operator=(const ConsoleBuffer &other) = delete;
+
+    virtual void clearLines(int row, int count,
+                            const ConsoleScreenBufferInfo &info) = 0;
+    void clearAllLines(const ConsoleScreenBufferInfo &info) {
+        clearLines(0, info.bufferSize().Y, info);
+    }
+
+    // Buffer and window sizes.
+    virtual ConsoleScreenBufferInfo bufferInfo() = 0;
+    Coord bufferSize() { return bufferInfo().bufferSize(); }
+    SmallRect windowRect() { return bufferInfo().windowRect(); }
+    virtual void resizeBuffer(const Coord &size) = 0;
+    virtual bool resizeBufferRange(const Coord &initialSize,
+                                   Coord &finalSize) = 0;
+    bool resizeBufferRange(const Coord &initialSize) {
+        Coord dummy;
+        return resizeBufferRange(initialSize, dummy);
+    }
+    virtual void moveWindow(const SmallRect &rect) = 0;
+    virtual Coord largestWindowSize() = 0;
+    virtual void setSmallFont(int columns, bool isNewW10) = 0;
+
+    // Cursor.
+    Coord cursorPosition() { return bufferInfo().cursorPosition(); }
+    virtual void setCursorPosition(const Coord &point) = 0;
+    virtual bool cursorVisible() = 0;
+
+    // Screen content.
+    virtual void read(const SmallRect &rect, CHAR_INFO *data) = 0;
+    virtual void write(const SmallRect &rect, const CHAR_INFO *data) = 0;
+    // Whether a single read may cover the whole window.  Before Windows 8,
+    // ReadConsoleOutputW fails if the read is too large, so largeConsoleRead
+    // splits it into smaller reads.
+    virtual bool largeReadsAllowed() = 0;
+
+    virtual void setTextAttribute(WORD attributes) = 0;
+
+    // Console state affecting how attributes are interpreted.
+    virtual DWORD outputMode() = 0;
+    virtual UINT outputCodePage() = 0;
+};
+
+#endif // AGENT_CONSOLE_BUFFER_H
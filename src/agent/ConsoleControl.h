@@ -0,0 +1,57 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_CONSOLE_CONTROL_H
+#define AGENT_CONSOLE_CONTROL_H
+
+// The console-wide state the Scraper depends on besides the screen buffer:
+// whether output is frozen (by selecting text) while it reads and resizes
+// the buffer, and whether the console has the Windows 10 resize behavior.
+// Win32Console implements it for the real console.  SimConsoleControl is a
+// no-op version for use with SimConsoleBuffer.
+class ConsoleControl {
+public:
+    class FreezeGuard {
+    public:
+        FreezeGuard(ConsoleControl &console, bool frozen) :
+                m_console(console), m_previous(console.frozen()) {
+            m_console.setFrozen(frozen);
+        }
+        ~FreezeGuard() {
+            m_console.setFrozen(m_previous);
+        }
+        FreezeGuard(const FreezeGuard &other) = delete;
+        FreezeGuard &operator=(const FreezeGuard &other) = delete;
+    private:
+        ConsoleControl &m_console;
+        bool m_previous;
+    };
+
+    ConsoleControl() {}
+    virtual ~ConsoleControl() {}
+    ConsoleControl(const ConsoleControl &other) = delete;
+    ConsoleControl &operator=(const ConsoleControl &other) = delete;
+
+    virtual bool isNewW10() = 0;
+    virtual void setFrozen(bool frozen=true) = 0;
+    virtual bool frozen() = 0;
+};
+
+#endif // AGENT_CONSOLE_CONTROL_H
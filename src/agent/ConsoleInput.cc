@@ -32,10 +32,12 @@
 #include "../shared/StringBuilder.h"
 #include "../shared/UnixCtrlChars.h"
 
+#include "AgentStats.h"
 #include "ConsoleInputReencoding.h"
 #include "DebugShowInput.h"
 #include "DefaultInputMap.h"
 #include "DsrSender.h"
+#include "KeyboardLayoutCache.h"
 #include "UnicodeEncoding.h"
 #include "Win32Console.h"
 
@@ -46,6 +48,25 @@
 
 namespace {
 
+int16_t vkKeyScanUncached(uint16_t ch)
+{
+    return VkKeyScan(ch);
+}
+
+uint16_t scanCodeUncached(uint16_t virtualKey)
+{
+    return MapVirtualKey(virtualKey, MAPVK_VK_TO_VSC);
+}
+
+// Keyboard layouts are per-thread, and all console input is generated on the
+// agent's one thread, so the static record-building functions share a single
+// cache.  ConsoleInput::doWrite keeps it in sync with the current layout.
+KeyboardLayoutCache &keyboardLayoutCache()
+{
+    static KeyboardLayoutCache cache(vkKeyScanUncached, scanCodeUncached);
+    return cache;
+}
+
 struct MouseRecord {
     bool release;
     int flags;
@@ -66,6 +87,28 @@ std::string MouseRecord::toString() const {
 
 const unsigned int kIncompleteEscapeTimeoutMs = 1000u;
 
+// When the previous input ended with an incomplete sequence, this much of the
+// new input is appended to it to finish it.  Every sequence winpty recognizes
+// is shorter than this, so the rest of the input is scanned in place.
+const size_t kIncompleteSequenceLookahead = 64;
+
+// Input records are written to the console in batches of about this many, so
+// a large paste doesn't build up one enormous array of records.
+const size_t kInputRecordBatchSize = 4096;
+
+// While a bracketed paste is being written, stop once the console's input
+// buffer holds this many records, and resume from the poll timer after the
+// program has read it down to the lower count.  The rest of the paste, and
+// any input behind it, waits in m_deferredInput meanwhile.
+const DWORD kPasteBacklogHigh = 32768;
+const DWORD kPasteBacklogLow = 8192;
+
+// The most bytes of pasted text scanPasteInput decodes at once.
+const int kPasteRunSize = 256;
+
+const char kPasteStart[] = "\x1B[200~";
+const char kPasteEnd[] = "\x1B[201~";
+
 #define CHECK(cond)                                 \
         do {                                        \
             if (!(cond)) { return 0; }              \
@@ -121,6 +164,18 @@ static int matchDsr(const char *input, int inputSize)
     return pch - input + 1;
 }
 
+// Match a fixed escape sequence, like the bracketed paste markers.  Returns
+// the same values as matchDsr.
+static int matchString(const char *input, int inputSize, const char *str)
+{
+    const int len = strlen(str);
+    const int cmpLen = std::min(inputSize, len);
+    if (memcmp(input, str, cmpLen) != 0) {
+        return 0;
+    }
+    return cmpLen == len ? len : -1;
+}
+
 static int matchMouseDefault(const char *input, int inputSize,
                              MouseRecord &out)
 {
@@ -192,17 +247,21 @@ static int matchMouseRecord(const char *input, int inputSize, MouseRecord &out)
 
 } // anonymous namespace
 
-ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
-                           Win32Console &console) :
+ConsoleInput::ConsoleInput(HANDLE conin, int mouseMode, bool bracketedPaste,
+                           DsrSender &dsrSender, Win32Console &console) :
     m_console(console),
     m_conin(conin),
     m_mouseMode(mouseMode),
-    m_dsrSender(dsrSender)
+    m_dsrSender(dsrSender),
+    m_bracketedPaste(bracketedPaste)
 {
     addDefaultEntriesToInputMap(m_inputMap);
     if (hasDebugFlag("dump_input_map")) {
         m_inputMap.dumpInputMap();
     }
+    if (!hasDebugFlag("input_map_trie") && !m_inputMap.compile()) {
+        trace("The input map is too large to compile");
+    }
 
     // Configure Quick Edit mode according to the mouse mode.  Enable
     // InsertMode for two reasons:
@@ -239,6 +298,7 @@ void ConsoleInput::writeInput(const std::string &input)
     if (input.size() == 0) {
         return;
     }
+    agentStats().add(WINPTY_STAT_INPUT_BYTES, input.size());
 
     if (isTracingEnabled()) {
         static bool debugInput = hasDebugFlag("input");
@@ -269,8 +329,17 @@ void ConsoleInput::writeInput(const std::string &input)
         }
     }
 
-    m_byteQueue.append(input);
-    doWrite(false);
+    if (!m_deferredInput.empty()) {
+        // A paste is waiting for the console to catch up.  Keep the new input
+        // behind it.
+        m_deferredInput.append(input);
+    } else {
+        const size_t consumed = doWrite(input.data(), input.size(), false);
+        if (consumed < input.size()) {
+            m_deferredInput.assign(input, consumed, std::string::npos);
+            m_deferredStart = 0;
+        }
+    }
     if (!m_byteQueue.empty() && !m_dsrSent) {
         trace("send DSR");
         m_dsrSender.sendDsr();
@@ -281,11 +350,48 @@ void ConsoleInput::writeInput(const std::string &input)
 
 void ConsoleInput::flushIncompleteEscapeCode()
 {
-    if (!m_byteQueue.empty() &&
-            (GetTickCount() - m_lastWriteTick) > kIncompleteEscapeTimeoutMs) {
-        doWrite(true);
+    if (!m_deferredInput.empty() ||
+            (GetTickCount() - m_lastWriteTick) <= kIncompleteEscapeTimeoutMs) {
+        return;
+    }
+    if (!m_byteQueue.empty()) {
+        doWrite("", 0, true);
         m_byteQueue.clear();
     }
+    // A terminal sends a paste all at once, so if the input has gone idle
+    // before the end marker, the marker isn't coming.  End the paste, or
+    // Ctrl-C, arrow keys, and DSR replies would be typed literally forever.
+    if (m_inBracketedPaste) {
+        trace("Bracketed paste ended without an end marker");
+        m_inBracketedPaste = false;
+    }
+}
+
+// Write more of a paste that was held back because the console's input buffer
+// was full.  The agent calls this from its poll timer.
+void ConsoleInput::writeDeferredInput()
+{
+    if (m_deferredInput.empty()) {
+        return;
+    }
+    DWORD pending = 0;
+    if (GetNumberOfConsoleInputEvents(m_conin, &pending) &&
+            pending > kPasteBacklogLow) {
+        return;
+    }
+    m_deferredStart += doWrite(&m_deferredInput[m_deferredStart],
+                               m_deferredInput.size() - m_deferredStart,
+                               false);
+    if (m_deferredStart == m_deferredInput.size()) {
+        m_deferredInput.clear();
+        m_deferredStart = 0;
+    } else if (m_deferredStart >= m_deferredInput.size() / 2) {
+        // Discard the written prefix once it's most of the string, so the
+        // cost of erasing it is amortized over the bytes written.
+        m_deferredInput.erase(0, m_deferredStart);
+        m_deferredStart = 0;
+    }
+    m_lastWriteTick = GetTickCount();
 }
 
 void ConsoleInput::updateInputFlags(bool forceTrace)
@@ -331,19 +437,91 @@ bool ConsoleInput::shouldActivateTerminalMouse()
     }
 }
 
-void ConsoleInput::doWrite(bool isEof)
+// Translate the incomplete sequence left over from the previous write,
+// followed by the new input, into input records.  Only the pending bytes and
+// the start of the new input are ever copied into m_byteQueue; the rest is
+// scanned where it is, and any incomplete sequence at its end is saved for
+// next time.  Since sequences have a bounded length, the work per input byte
+// is bounded however the input is split up.
+//
+// Returns the number of bytes consumed, including an incomplete tail saved in
+// m_byteQueue.  It's less than inputSize only when a bracketed paste filled
+// the console's input buffer, and the caller must hold the rest back.
+size_t ConsoleInput::doWrite(const char *input, size_t inputSize, bool isEof)
 {
-    const char *data = m_byteQueue.c_str();
-    std::vector<INPUT_RECORD> records;
+    keyboardLayoutCache().setLayout(
+        reinterpret_cast<uintptr_t>(GetKeyboardLayout(0)));
+
     size_t idx = 0;
-    while (idx < m_byteQueue.size()) {
-        int charSize = scanInput(records, &data[idx], m_byteQueue.size() - idx, isEof);
-        if (charSize == -1)
+    if (!m_byteQueue.empty()) {
+        size_t pendingSize = m_byteQueue.size();
+        size_t lookahead = std::min(inputSize, kIncompleteSequenceLookahead);
+        while (true) {
+            m_byteQueue.append(input, lookahead);
+            const size_t scanned = scanInputRange(
+                m_byteQueue.data(), m_byteQueue.size(), pendingSize,
+                isEof && lookahead == inputSize, false);
+            if (scanned >= pendingSize) {
+                // Scanning has moved past the pending bytes and into the new
+                // input, which can be scanned in place from here.
+                idx = scanned - pendingSize;
+                m_byteQueue.clear();
+                break;
+            }
+            m_byteQueue.erase(0, scanned);
+            if (lookahead == inputSize) {
+                // All of the new input went into completing the pending
+                // sequence, and it's still incomplete.
+                flushInputRecords(m_records);
+                return inputSize;
+            }
+            // The lookahead was too short.  Retry with all of the input.
+            pendingSize -= scanned;
+            m_byteQueue.resize(pendingSize);
+            lookahead = inputSize;
+        }
+    }
+    bool throttled = false;
+    idx += scanInputRange(input + idx, inputSize - idx, inputSize - idx,
+                          isEof, true, &throttled);
+    flushInputRecords(m_records);
+    if (throttled) {
+        return idx;
+    }
+    m_byteQueue.append(input + idx, inputSize - idx);
+    return inputSize;
+}
+
+// Scan sequences starting before scanLimit, stopping early at an incomplete
+// one.  Returns the number of bytes consumed, which can extend past
+// scanLimit.  If canThrottle is set, scanning also stops, setting *throttled,
+// when the console's input buffer fills up in the middle of a paste.
+size_t ConsoleInput::scanInputRange(const char *input, size_t inputSize,
+                                    size_t scanLimit, bool isEof,
+                                    bool canThrottle, bool *throttled)
+{
+    size_t idx = 0;
+    while (idx < scanLimit) {
+        const int charSize =
+            scanInput(m_records, &input[idx], inputSize - idx, isEof);
+        if (charSize == -1) {
             break;
+        }
         idx += charSize;
+        if (m_records.size() >= kInputRecordBatchSize) {
+            flushInputRecords(m_records);
+            DWORD pending = 0;
+            if (canThrottle && m_inBracketedPaste && idx < inputSize &&
+                    GetNumberOfConsoleInputEvents(m_conin, &pending) &&
+                    pending >= kPasteBacklogHigh) {
+                trace("Paste throttled: %u input records pending",
+                      static_cast<unsigned>(pending));
+                *throttled = true;
+                break;
+            }
+        }
     }
-    m_byteQueue.erase(0, idx);
-    flushInputRecords(records);
+    return idx;
 }
 
 void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
@@ -351,6 +529,7 @@ void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
     if (records.size() == 0) {
         return;
     }
+    agentStats().add(WINPTY_STAT_INPUT_RECORDS, records.size());
     DWORD actual = 0;
     if (!WriteConsoleInputW(m_conin, records.data(), records.size(), &actual)) {
         trace("WriteConsoleInputW failed");
@@ -369,7 +548,7 @@ void ConsoleInput::flushInputRecords(std::vector<INPUT_RECORD> &records)
 // https://github.com/rprichard/winpty/issues/116
 static void sendKeyMessage(HWND hwnd, bool isKeyDown, uint16_t virtualKey)
 {
-    uint32_t scanCode = MapVirtualKey(virtualKey, MAPVK_VK_TO_VSC);
+    uint32_t scanCode = keyboardLayoutCache().scanCode(virtualKey);
     if (scanCode > 255) {
         scanCode = 0;
     }
@@ -384,6 +563,10 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
 {
     ASSERT(inputSize >= 1);
 
+    if (m_inBracketedPaste) {
+        return scanPasteInput(records, input, inputSize, isEof);
+    }
+
     // Ctrl-C.
     //
     // In processed mode, use GenerateConsoleCtrlEvent so that Ctrl-C handlers
@@ -416,6 +599,17 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
             return -1;
         }
 
+        // The start of a bracketed paste.
+        const int pasteLen = m_bracketedPaste
+            ? matchString(input, inputSize, kPasteStart) : 0;
+        if (pasteLen > 0) {
+            m_inBracketedPaste = true;
+            return pasteLen;
+        } else if (!isEof && pasteLen == -1) {
+            trace("Incomplete paste marker");
+            return -1;
+        }
+
         int mouseLen = scanMouseInput(records, input, inputSize);
         if (mouseLen > 0 || (!isEof && mouseLen == -1)) {
             return mouseLen;
@@ -485,6 +679,59 @@ int ConsoleInput::scanInput(std::vector<INPUT_RECORD> &records,
     return len;
 }
 
+// Inside a bracketed paste, the terminal sends the pasted text as is, so
+// every character is typed literally.  The input map, Ctrl-C, and the other
+// escape sequences are skipped until the end marker.
+int ConsoleInput::scanPasteInput(std::vector<INPUT_RECORD> &records,
+                                 const char *input,
+                                 int inputSize,
+                                 bool isEof)
+{
+    if (input[0] == '\x1B') {
+        const int endLen = matchString(input, inputSize, kPasteEnd);
+        if (endLen > 0) {
+            m_inBracketedPaste = false;
+            return endLen;
+        } else if (!isEof && endLen == -1) {
+            return -1;
+        }
+    }
+    // Decode the text up to the next escape in bulk.  The run is capped so
+    // that scanInputRange still flushes (and throttles) in small batches.
+    const char *const esc =
+        static_cast<const char*>(memchr(input, '\x1B', inputSize));
+    const int runLimit = std::min<int>(
+        esc != nullptr ? esc - input : inputSize, kPasteRunSize);
+    if (runLimit > 0) {
+        wchar_t units[kPasteRunSize];
+        int unitCount = 0;
+        const int runLen = decodeUtf8Run(input, runLimit, units, unitCount);
+        if (runLen > 0) {
+            for (int i = 0; i < unitCount; ++i) {
+                uint32_t codePoint = static_cast<uint16_t>(units[i]);
+                if ((codePoint & 0xFC00) == 0xD800) {
+                    // decodeUtf8Run only writes complete surrogate pairs.
+                    codePoint = decodeSurrogatePair(units[i], units[i + 1]);
+                    ++i;
+                }
+                appendCharKeyPress(records, codePoint, false);
+            }
+            return runLen;
+        }
+    }
+    // An invalid or incomplete character, or an escape.
+    const int len = utf8CharLength(input[0]);
+    if (len == 0) {
+        return 1;
+    }
+    if (len > inputSize) {
+        trace("Incomplete UTF-8 character in paste");
+        return -1;
+    }
+    appendUtf8Char(records, &input[0], len, false);
+    return len;
+}
+
 int ConsoleInput::scanMouseInput(std::vector<INPUT_RECORD> &records,
                                  const char *input,
                                  int inputSize)
@@ -617,8 +864,15 @@ void ConsoleInput::appendUtf8Char(std::vector<INPUT_RECORD> &records,
         }
         return;
     }
+    appendCharKeyPress(records, codePoint, terminalAltEscape);
+}
 
-    const short charScan = codePoint > 0xFFFF ? -1 : VkKeyScan(codePoint);
+void ConsoleInput::appendCharKeyPress(std::vector<INPUT_RECORD> &records,
+                                      const uint32_t codePoint,
+                                      const bool terminalAltEscape)
+{
+    const short charScan = codePoint > 0xFFFF ? -1 :
+        keyboardLayoutCache().vkKeyScan(codePoint);
     uint16_t virtualKey = 0;
     uint16_t winKeyState = 0;
     uint32_t winCodePointDn = codePoint;
@@ -835,7 +1089,7 @@ void ConsoleInput::appendInputRecord(std::vector<INPUT_RECORD> &records,
     ir.Event.KeyEvent.wRepeatCount = 1;
     ir.Event.KeyEvent.wVirtualKeyCode = virtualKey;
     ir.Event.KeyEvent.wVirtualScanCode =
-            MapVirtualKey(virtualKey, MAPVK_VK_TO_VSC);
+            keyboardLayoutCache().scanCode(virtualKey);
     ir.Event.KeyEvent.uChar.UnicodeChar = utf16Char;
     ir.Event.KeyEvent.dwControlKeyState = keyState;
     records.push_back(ir);
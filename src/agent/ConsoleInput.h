@@ -38,21 +38,30 @@ class DsrSender;
 class ConsoleInput
 {
 public:
-    ConsoleInput(HANDLE conin, int mouseMode, DsrSender &dsrSender,
-                 Win32Console &console);
+    ConsoleInput(HANDLE conin, int mouseMode, bool bracketedPaste,
+                 DsrSender &dsrSender, Win32Console &console);
     void writeInput(const std::string &input);
     void flushIncompleteEscapeCode();
+    void writeDeferredInput();
+    bool hasDeferredInput() const { return !m_deferredInput.empty(); }
     void setMouseWindowRect(SmallRect val) { m_mouseWindowRect = val; }
     void updateInputFlags(bool forceTrace=false);
     bool shouldActivateTerminalMouse();
 
 private:
-    void doWrite(bool isEof);
+    size_t doWrite(const char *input, size_t inputSize, bool isEof);
+    size_t scanInputRange(const char *input, size_t inputSize,
+                          size_t scanLimit, bool isEof,
+                          bool canThrottle, bool *throttled=nullptr);
     void flushInputRecords(std::vector<INPUT_RECORD> &records);
     int scanInput(std::vector<INPUT_RECORD> &records,
                   const char *input,
                   int inputSize,
                   bool isEof);
+    int scanPasteInput(std::vector<INPUT_RECORD> &records,
+                       const char *input,
+                       int inputSize,
+                       bool isEof);
     int scanMouseInput(std::vector<INPUT_RECORD> &records,
                        const char *input,
                        int inputSize);
@@ -60,6 +69,9 @@ private:
                         const char *charBuffer,
                         int charLen,
                         bool terminalAltEscape);
+    void appendCharKeyPress(std::vector<INPUT_RECORD> &records,
+                            uint32_t codePoint,
+                            bool terminalAltEscape);
     void appendKeyPress(std::vector<INPUT_RECORD> &records,
                         uint16_t virtualKey,
                         uint32_t winCodePointDn,
@@ -89,7 +101,18 @@ private:
     int m_mouseMode = 0;
     DsrSender &m_dsrSender;
     bool m_dsrSent = false;
+    // The start of an escape sequence or UTF-8 character that was incomplete
+    // at the end of the input written so far.
     std::string m_byteQueue;
+    std::vector<INPUT_RECORD> m_records;
+    // Whether the paste markers are recognized (WINPTY_FLAG_BRACKETED_PASTE).
+    bool m_bracketedPaste = false;
+    // Set between the start and end markers of a bracketed paste.
+    bool m_inBracketedPaste = false;
+    // Input held back while the console's input buffer is full, of which the
+    // first m_deferredStart bytes have already been written.
+    std::string m_deferredInput;
+    size_t m_deferredStart = 0;
     InputMap m_inputMap;
     DWORD m_lastWriteTick = 0;
     DWORD m_mouseButtonState = 0;
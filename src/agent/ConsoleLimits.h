@@ -0,0 +1,55 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_CONSOLE_LIMITS_H
+#define AGENT_CONSOLE_LIMITS_H
+
+// The default console limits.  Prior to Windows 8, the size of a
+// ReadConsoleOutputW call is limited by the ~32KB RPC buffer, and we must be
+// able to issue a single call of MAX_CONSOLE_WIDTH characters, and a single
+// read of approximately several hundred fewer characters than
+// BUFFER_LINE_COUNT, so the agent never exceeds these defaults there.
+const int BUFFER_LINE_COUNT = 3000;
+const int MAX_CONSOLE_WIDTH = 2500;
+const int MAX_CONSOLE_HEIGHT = 2000;
+
+// In scrolling mode, the console buffer must have this many more lines than
+// the tallest window, to leave room in the scrollback for the sync marker.
+const int BUFFER_LINE_MARGIN = 1000;
+
+// The largest console buffer dimension.
+const int MAX_CONSOLE_BUFFER_SIZE = 32766;
+
+// The limits for one agent session, set with winpty_config_set_console_limits.
+// bufferLineCount is the height of the console buffer in scrolling mode.
+struct ConsoleLimits {
+    int bufferLineCount = BUFFER_LINE_COUNT;
+    int maxWidth = MAX_CONSOLE_WIDTH;
+    int maxHeight = MAX_CONSOLE_HEIGHT;
+
+    bool isValid() const {
+        return maxWidth >= 1 && maxWidth <= MAX_CONSOLE_BUFFER_SIZE &&
+               maxHeight >= 1 &&
+               bufferLineCount >= maxHeight + BUFFER_LINE_MARGIN &&
+               bufferLineCount <= MAX_CONSOLE_BUFFER_SIZE;
+    }
+};
+
+#endif // AGENT_CONSOLE_LIMITS_H
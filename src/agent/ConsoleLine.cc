@@ -25,13 +25,27 @@
 // output line and determines when a line has changed.  Detecting line changes
 // is made complicated by terminal resizing.
 //
+// In hash-only mode, the line content is not kept.  Instead, the line is
+// reduced to a 64-bit hash and enough information about its trailing blanks
+// to make the same decisions as the copying mode, which saves up to
+// MAX_CONSOLE_WIDTH cells of memory per buffered line.  There are two
+// differences:
+//  - The first changed column is unknown, so firstChangedColumn() is 0.
+//  - If narrowing the terminal truncated a line's non-blank content, and the
+//    terminal is widened again, the line is always reported as changed.  The
+//    copying mode could find the reexposed cells blank and skip it.
+//
 
 #include "ConsoleLine.h"
 
+#include <string.h>
+
 #include <algorithm>
 
 #include "../shared/WinptyAssert.h"
 
+#include "CellScan.h"
+
 static CHAR_INFO blankChar(WORD attributes)
 {
     // N.B.: As long as we write to UnicodeChar rather than AsciiChar, there
@@ -43,53 +57,151 @@ static CHAR_INFO blankChar(WORD attributes)
     return ret;
 }
 
-static bool isLineBlank(const CHAR_INFO *line, int length, WORD attributes)
+ConsoleLine::ConsoleLine() : m_prevLength(0), m_firstChangedColumn(0)
 {
-    for (int col = 0; col < length; ++col) {
-        if (line[col].Attributes != attributes ||
-                line[col].Char.UnicodeChar != L' ') {
-            return false;
-        }
+}
+
+// Switching modes discards the previous line.
+void ConsoleLine::setHashOnly(bool hashOnly)
+{
+    m_hashOnly = hashOnly;
+    reset();
+    m_prevData.shrink_to_fit();
+}
+
+void ConsoleLine::reset()
+{
+    m_prevLength = 0;
+    m_firstChangedColumn = 0;
+    m_prevData.clear();
+    m_summary = Summary();
+    m_staleRuns.clear();
+}
+
+ConsoleLine::Summary ConsoleLine::summarize(const CHAR_INFO *line, int length)
+{
+    ASSERT(length >= 1);
+    Summary ret;
+    ret.trailAttr = line[length - 1].Attributes;
+    ret.coreLength =
+        length - cellRangeBlankSuffix(line, length, ret.trailAttr);
+    ret.runStart = ret.coreLength;
+    if (ret.coreLength > 0 &&
+            line[ret.coreLength - 1].Char.UnicodeChar == L' ') {
+        ret.runAttr = line[ret.coreLength - 1].Attributes;
+        ret.runStart -= cellRangeBlankSuffix(line, ret.coreLength,
+                                             ret.runAttr);
     }
-    return true;
+    ret.hash = cellRangeHash(line, ret.coreLength);
+    return ret;
 }
 
-static inline bool areLinesEqual(
-    const CHAR_INFO *line1,
-    const CHAR_INFO *line2,
-    int length)
+// Whether the stale cells from m_prevLength up to `end` (or as far as they
+// go) are all blank with the given attributes.
+bool ConsoleLine::isStaleBlank(int end, WORD attributes) const
 {
-    return memcmp(line1, line2, sizeof(CHAR_INFO) * length) == 0;
+    int start = m_prevLength;
+    for (const StaleRun &run : m_staleRuns) {
+        if (start >= end) {
+            break;
+        }
+        if (run.attr != attributes) {
+            return false;
+        }
+        start = run.end;
+    }
+    return true;
 }
 
-ConsoleLine::ConsoleLine() : m_prevLength(0)
+void ConsoleLine::setSummary(const Summary &summary, int newLength)
 {
+    const int prevLength = m_prevLength;
+    if (newLength < prevLength) {
+        // The end of the previous line becomes stale, in front of any older
+        // stale cells.
+        const Summary &prev = m_summary;
+        std::vector<StaleRun> runs;
+        if (newLength < prev.runStart) {
+            runs.push_back({ prev.runStart, -1 });
+        }
+        if (std::max(newLength, prev.runStart) < prev.coreLength) {
+            runs.push_back({ prev.coreLength, prev.runAttr });
+        }
+        if (std::max(newLength, prev.coreLength) < prevLength) {
+            runs.push_back({ prevLength, prev.trailAttr });
+        }
+        runs.insert(runs.end(), m_staleRuns.begin(), m_staleRuns.end());
+        m_staleRuns.swap(runs);
+    } else {
+        // The new line overwrites the stale cells it covers.
+        auto it = m_staleRuns.begin();
+        while (it != m_staleRuns.end() && it->end <= newLength) {
+            ++it;
+        }
+        m_staleRuns.erase(m_staleRuns.begin(), it);
+    }
+    m_summary = summary;
+    m_prevLength = newLength;
 }
 
-void ConsoleLine::reset()
+// The hash-only version of detectChangeAndSetLine.  Whatever the change in
+// length, the copying mode considers the lines equal exactly when they have
+// the same core and trailing attribute, and (if the line became longer) the
+// reexposed stale cells are blank in that attribute.
+bool ConsoleLine::detectChangeAndSetHash(const CHAR_INFO *const line,
+                                         const int newLength)
 {
-    m_prevLength = 0;
-    m_prevData.clear();
+    const Summary summary = summarize(line, newLength);
+    bool equalLines = false;
+    if (m_prevLength > 0) {
+        equalLines =
+            summary.coreLength == m_summary.coreLength &&
+            summary.hash == m_summary.hash &&
+            summary.trailAttr == m_summary.trailAttr &&
+            (newLength <= m_prevLength ||
+                isStaleBlank(newLength, m_summary.trailAttr));
+    }
+    setSummary(summary, newLength);
+    if (!equalLines) {
+        m_firstChangedColumn = 0;
+    }
+    return !equalLines;
 }
 
 // Determines whether the given line is sufficiently different from the
 // previously seen line as to justify reoutputting the line.  The function
 // also sets the `ConsoleLine` to the given line, exactly as if `setLine` had
-// been called.
-bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int newLength)
+// been called.  When it returns true, firstChangedColumn() is the first
+// column where the new line differs from the previous one.
+// If `previous` is non-NULL and the line is replaced by one of the same
+// length, the old cells are moved into it, so the caller can diff against
+// them.  Otherwise (including in hash-only mode), it is left empty.
+bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line,
+                                         const int newLength,
+                                         std::vector<CHAR_INFO> *previous)
 {
     ASSERT(newLength >= 1);
+    if (previous != nullptr) {
+        previous->clear();
+    }
+    if (m_hashOnly) {
+        return detectChangeAndSetHash(line, newLength);
+    }
     ASSERT(m_prevLength <= static_cast<int>(m_prevData.size()));
 
     if (newLength == m_prevLength) {
-        bool equalLines = areLinesEqual(m_prevData.data(), line, newLength);
+        const int prefix =
+            cellRangeEqualPrefix(m_prevData.data(), line, newLength);
+        const bool equalLines = prefix == newLength;
         if (!equalLines) {
-            setLine(line, newLength);
+            setLine(line, newLength, previous);
+            m_firstChangedColumn = prefix;
         }
         return !equalLines;
     } else {
         if (m_prevLength == 0) {
             setLine(line, newLength);
+            m_firstChangedColumn = 0;
             return true;
         }
 
@@ -97,15 +209,18 @@ bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int
         const WORD prevBlank = m_prevData[m_prevLength - 1].Attributes;
         const WORD newBlank = line[newLength - 1].Attributes;
 
+        const int commonLength = std::min(newLength, m_prevLength);
+        const int prefix =
+            cellRangeEqualPrefix(m_prevData.data(), line, commonLength);
         bool equalLines = false;
         if (newLength < m_prevLength) {
             // The line has become shorter.  The lines are equal if the common
             // part is equal, and if the newly truncated characters were blank.
             equalLines =
-                areLinesEqual(m_prevData.data(), line, newLength) &&
-                isLineBlank(m_prevData.data() + newLength,
-                            m_prevLength - newLength,
-                            newBlank);
+                prefix == commonLength &&
+                isCellRangeBlank(m_prevData.data() + newLength,
+                                 m_prevLength - newLength,
+                                 newBlank);
         } else {
             //
             // The line has become longer.  The lines are equal if the common
@@ -122,21 +237,37 @@ bool ConsoleLine::detectChangeAndSetLine(const CHAR_INFO *const line, const int
             //
             ASSERT(newLength > m_prevLength);
             equalLines =
-                areLinesEqual(m_prevData.data(), line, m_prevLength) &&
-                isLineBlank(m_prevData.data() + m_prevLength,
-                            std::min<int>(m_prevData.size(), newLength) - m_prevLength,
-                            prevBlank) &&
-                isLineBlank(line + m_prevLength,
-                            newLength - m_prevLength,
-                            prevBlank);
+                prefix == commonLength &&
+                isCellRangeBlank(m_prevData.data() + m_prevLength,
+                                 std::min<int>(m_prevData.size(), newLength) - m_prevLength,
+                                 prevBlank) &&
+                isCellRangeBlank(line + m_prevLength,
+                                 newLength - m_prevLength,
+                                 prevBlank);
         }
         setLine(line, newLength);
+        m_firstChangedColumn = prefix;
         return !equalLines;
     }
 }
 
-void ConsoleLine::setLine(const CHAR_INFO *const line, const int newLength)
+void ConsoleLine::setLine(const CHAR_INFO *const line, const int newLength,
+                          std::vector<CHAR_INFO> *previous)
 {
+    if (previous != nullptr) {
+        previous->clear();
+    }
+    if (m_hashOnly) {
+        setSummary(summarize(line, newLength), newLength);
+        return;
+    }
+    if (previous != nullptr && newLength == m_prevLength &&
+            m_prevData.size() == static_cast<size_t>(newLength)) {
+        // There are no stale cells past the end of the line to preserve, so
+        // swap buffers with the caller instead of copying.
+        previous->swap(m_prevData);
+        m_prevData.resize(newLength);
+    }
     if (static_cast<int>(m_prevData.size()) < newLength) {
         m_prevData.resize(newLength);
     }
@@ -146,6 +277,13 @@ void ConsoleLine::setLine(const CHAR_INFO *const line, const int newLength)
 
 void ConsoleLine::blank(WORD attributes)
 {
+    if (m_hashOnly) {
+        const CHAR_INFO cell = blankChar(attributes);
+        m_staleRuns.clear();
+        m_prevLength = 0;
+        setSummary(summarize(&cell, 1), 1);
+        return;
+    }
     m_prevData.resize(1);
     m_prevData[0] = blankChar(attributes);
     m_prevLength = 1;
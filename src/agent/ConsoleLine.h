@@ -21,21 +21,57 @@
 #ifndef CONSOLE_LINE_H
 #define CONSOLE_LINE_H
 
-#include <windows.h>
+#include <stdint.h>
 
 #include <vector>
 
+#include "ConsoleTypes.h"
+
 class ConsoleLine
 {
 public:
     ConsoleLine();
+    void setHashOnly(bool hashOnly);
     void reset();
-    bool detectChangeAndSetLine(const CHAR_INFO *line, int newLength);
-    void setLine(const CHAR_INFO *line, int newLength);
+    bool detectChangeAndSetLine(const CHAR_INFO *line, int newLength,
+                                std::vector<CHAR_INFO> *previous=nullptr);
+    void setLine(const CHAR_INFO *line, int newLength,
+                 std::vector<CHAR_INFO> *previous=nullptr);
     void blank(WORD attributes);
+    int firstChangedColumn() const { return m_firstChangedColumn; }
+
 private:
+    // In hash-only mode, a line is summarized as a "core" followed by blanks
+    // in the attribute of the line's last cell.  The core itself is hashed,
+    // and its trailing run of blanks (in some other attribute) is recorded so
+    // that truncating the line can be tracked precisely.
+    struct Summary {
+        uint64_t hash = 0;
+        int coreLength = 0;
+        WORD trailAttr = 0;
+        int runStart = 0;
+        WORD runAttr = 0;
+    };
+
+    // Cells beyond m_prevLength left over from longer lines, which reappear
+    // when the terminal is widened.  Each run ends at `end`, and is either
+    // blank with attributes `attr`, or unknown content (attr == -1).
+    struct StaleRun {
+        int end;
+        int attr;
+    };
+
+    static Summary summarize(const CHAR_INFO *line, int length);
+    bool detectChangeAndSetHash(const CHAR_INFO *line, int newLength);
+    void setSummary(const Summary &summary, int newLength);
+    bool isStaleBlank(int end, WORD attributes) const;
+
+    bool m_hashOnly = false;
     int m_prevLength;
+    int m_firstChangedColumn;
     std::vector<CHAR_INFO> m_prevData;
+    Summary m_summary;
+    std::vector<StaleRun> m_staleRuns;
 };
 
 #endif // CONSOLE_LINE_H
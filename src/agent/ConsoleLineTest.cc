@@ -0,0 +1,117 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Check that a hash-only ConsoleLine detects every change a copying one does.
+
+#include "ConsoleLine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+static CHAR_INFO randomCell()
+{
+    // Mostly blanks, in a few attributes, so that the blank-trimming logic
+    // is exercised.
+    static const WORD kAttrs[] = { 7, 7, 7, 0x70, 0x0C };
+    CHAR_INFO ret;
+    ret.Char.UnicodeChar = rand() % 3 == 0 ? L'a' + rand() % 2 : L' ';
+    ret.Attributes = kAttrs[rand() % 5];
+    return ret;
+}
+
+static std::vector<CHAR_INFO> mutate(std::vector<CHAR_INFO> line, int length)
+{
+    // Keep the old content, so that equal lines are common.
+    const WORD fill = line.empty() ? 7 : line.back().Attributes;
+    CHAR_INFO blank;
+    blank.Char.UnicodeChar = L' ';
+    blank.Attributes = fill;
+    line.resize(length, blank);
+    switch (rand() % 4) {
+        case 0:
+            break;
+        case 1:
+            line[rand() % length] = randomCell();
+            break;
+        case 2:
+            for (auto &cell : line) {
+                cell = randomCell();
+            }
+            break;
+        case 3: {
+            // Clear the tail in a single attribute.
+            const int start = rand() % length;
+            blank.Attributes = randomCell().Attributes;
+            for (int i = start; i < length; ++i) {
+                line[i] = blank;
+            }
+            break;
+        }
+    }
+    return line;
+}
+
+int main()
+{
+    const int kWidths[] = { 1, 2, 3, 5, 8, 13, 20 };
+    int conservative = 0;
+    int errors = 0;
+    int decisions = 0;
+    srand(1);
+    for (int seq = 0; seq < 20000; ++seq) {
+        ConsoleLine copying;
+        ConsoleLine hashed;
+        hashed.setHashOnly(true);
+        std::vector<CHAR_INFO> line;
+        int width = kWidths[rand() % 7];
+        for (int step = 0; step < 50; ++step) {
+            const int op = rand() % 20;
+            if (op == 0) {
+                const WORD attr = randomCell().Attributes;
+                copying.blank(attr);
+                hashed.blank(attr);
+                continue;
+            } else if (op == 1) {
+                copying.reset();
+                hashed.reset();
+                continue;
+            } else if (op <= 4) {
+                width = kWidths[rand() % 7];
+            }
+            line = mutate(line, width);
+            const bool c1 = copying.detectChangeAndSetLine(line.data(), width);
+            const bool c2 = hashed.detectChangeAndSetLine(line.data(), width);
+            ++decisions;
+            if (c1 && !c2) {
+                printf("Error: seq %d step %d: hash-only line missed a "
+                       "change\n", seq, step);
+                ++errors;
+            } else if (!c1 && c2) {
+                ++conservative;
+            }
+        }
+    }
+    printf("%d decisions, %d errors, %d conservative changes\n",
+           decisions, errors, conservative);
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_CONSOLE_TYPES_H
+#define AGENT_CONSOLE_TYPES_H
+
+// The Win32 console types and constants used by the scraping code (Scraper,
+// Terminal, and the ConsoleBuffer implementations).  On Windows, they come
+// from <windows.h>.  Elsewhere, this header defines the same layouts, so that
+// the scraper can be built against SimConsoleBuffer and profiled natively.
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef int BOOL;
+typedef int16_t SHORT;
+typedef char CHAR;
+typedef uint16_t WCHAR;
+
+typedef struct _COORD {
+    SHORT X;
+    SHORT Y;
+} COORD;
+
+typedef struct _SMALL_RECT {
+    SHORT Left;
+    SHORT Top;
+    SHORT Right;
+    SHORT Bottom;
+} SMALL_RECT;
+
+typedef struct _CHAR_INFO {
+    union {
+        WCHAR UnicodeChar;
+        CHAR AsciiChar;
+    } Char;
+    WORD Attributes;
+} CHAR_INFO;
+
+typedef struct _CONSOLE_SCREEN_BUFFER_INFO {
+    COORD dwSize;
+    COORD dwCursorPosition;
+    WORD wAttributes;
+    SMALL_RECT srWindow;
+    COORD dwMaximumWindowSize;
+} CONSOLE_SCREEN_BUFFER_INFO;
+
+#define FOREGROUND_BLUE             0x0001
+#define FOREGROUND_GREEN            0x0002
+#define FOREGROUND_RED              0x0004
+#define FOREGROUND_INTENSITY        0x0008
+#define BACKGROUND_BLUE             0x0010
+#define BACKGROUND_GREEN            0x0020
+#define BACKGROUND_RED              0x0040
+#define BACKGROUND_INTENSITY        0x0080
+#define COMMON_LVB_LEADING_BYTE     0x0100
+#define COMMON_LVB_TRAILING_BYTE    0x0200
+#define COMMON_LVB_REVERSE_VIDEO    0x4000
+#define COMMON_LVB_UNDERSCORE       0x8000
+
+#define ENABLE_PROCESSED_OUTPUT     0x0001
+#define ENABLE_WRAP_AT_EOL_OUTPUT   0x0002
+
+#endif
+
+#endif // AGENT_CONSOLE_TYPES_H
@@ -21,11 +21,10 @@
 #ifndef COORD_H
 #define COORD_H
 
-#include <windows.h>
-
 #include <string>
 
 #include "../shared/winpty_snprintf.h"
+#include "ConsoleTypes.h"
 
 struct Coord : COORD {
     Coord()
@@ -51,10 +51,12 @@ void EventLoop::run()
         }
 
         // Call the timeout if enough time has elapsed.
-        if (m_pollInterval > 0) {
+        const int pollInterval = m_pollInterval.current();
+        if (pollInterval > 0) {
             int elapsed = GetTickCount() - lastTime;
-            if (elapsed >= m_pollInterval) {
+            if (elapsed >= pollInterval) {
                 onPollTimeout();
+                m_pollInterval.pollFinished();
                 lastTime = GetTickCount();
                 didSomething = true;
             }
@@ -65,8 +67,8 @@ void EventLoop::run()
 
         // If there's nothing to do, wait.
         DWORD timeout = INFINITE;
-        if (m_pollInterval > 0)
-            timeout = std::max(0, (int)(lastTime + m_pollInterval - GetTickCount()));
+        if (pollInterval > 0)
+            timeout = std::max(0, (int)(lastTime + pollInterval - GetTickCount()));
         if (waitHandles.size() == 0) {
             ASSERT(timeout != INFINITE);
             if (timeout > 0)
@@ -88,9 +90,20 @@ NamedPipe &EventLoop::createNamedPipe()
     return *ret;
 }
 
-void EventLoop::setPollInterval(int ms)
+// The poll interval starts at minMs and backs off toward maxMs while the
+// onPollTimeout handler sees nothing to do.  Pass the same value twice for a
+// fixed interval.
+void EventLoop::setPollInterval(int minMs, int maxMs)
 {
-    m_pollInterval = ms;
+    m_pollInterval.setRange(minMs, maxMs);
+}
+
+// Return to the minimum poll interval.  Subclasses call this when something
+// happens that is likely to be followed by console output (e.g. input
+// arriving, or a scrape that found changes).
+void EventLoop::resetPollInterval()
+{
+    m_pollInterval.noteActivity();
 }
 
 void EventLoop::shutdown()
@@ -23,6 +23,8 @@
 
 #include <vector>
 
+#include "AdaptivePollInterval.h"
+
 class NamedPipe;
 
 class EventLoop
@@ -33,7 +35,8 @@ public:
 
 protected:
     NamedPipe &createNamedPipe();
-    void setPollInterval(int ms);
+    void setPollInterval(int minMs, int maxMs);
+    void resetPollInterval();
     void shutdown();
     virtual void onPollTimeout()                    {}
     virtual void onPipeIo(NamedPipe &namedPipe)     {}
@@ -41,7 +44,7 @@ protected:
 private:
     bool m_exiting = false;
     std::vector<NamedPipe*> m_pipes;
-    int m_pollInterval = 0;
+    AdaptivePollInterval m_pollInterval;
 };
 
 #endif // EVENTLOOP_H
@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <map>
+#include <vector>
+
 #include "DebugShowInput.h"
 #include "SimplePool.h"
 #include "../shared/DebugClient.h"
@@ -140,6 +143,9 @@ std::string InputMap::Key::toString() const {
 void InputMap::set(const char *encoding, int encodingLen, const Key &key) {
     ASSERT(encodingLen > 0);
     setHelper(m_root, encoding, encodingLen, key);
+    m_compiled = false;
+    m_transitions.clear();
+    m_states.clear();
 }
 
 void InputMap::setHelper(Node &node, const char *encoding, int encodingLen, const Key &key) {
@@ -185,9 +191,129 @@ InputMap::Node &InputMap::getOrCreateChild(Node &node, unsigned char ch) {
     return *ret;
 }
 
+// Flatten the trie into the state-transition table used by lookupKey, so that
+// each input byte costs two table reads instead of a scan of a node's
+// children.  The table is discarded if the map is changed afterward.  Returns
+// false, leaving lookups on the trie, if the map has too many nodes to number
+// with 16 bits.
+bool InputMap::compile() {
+    m_compiled = false;
+
+    // Walk the trie breadth-first, recording each edge.
+    struct Edge {
+        int parent;
+        unsigned char ch;
+    };
+    std::vector<const Node*> nodes;
+    std::vector<Edge> edges;
+    nodes.push_back(&m_root);
+    edges.push_back({ -1, 0 });
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (int ch = 0; ch < 256; ++ch) {
+            const Node *child = getChild(*nodes[i], ch);
+            if (child != NULL) {
+                nodes.push_back(child);
+                edges.push_back({ static_cast<int>(i),
+                                  static_cast<unsigned char>(ch) });
+            }
+        }
+    }
+    if (nodes.size() > 0xFFFF) {
+        return false;
+    }
+
+    // Most nodes are leaves, which need no row of transitions.  Number the
+    // root and the other interior nodes first, in breadth-first order, so the
+    // root is state 0, then the leaves.
+    std::vector<uint16_t> stateOf(nodes.size());
+    int interiorCount = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (i == 0 || nodes[i]->childCount > 0) {
+            stateOf[i] = interiorCount++;
+        }
+    }
+    int leafState = interiorCount;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i]->childCount == 0) {
+            stateOf[i] = leafState++;
+        }
+    }
+    std::vector<uint16_t> wideTable(interiorCount * 256);
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        wideTable[stateOf[edges[i].parent] * 256 + edges[i].ch] = stateOf[i];
+    }
+
+    // Bytes with identical columns of next states are interchangeable, and
+    // share a byte class.
+    std::map<std::vector<uint16_t>, int> classOfColumn;
+    std::vector<uint16_t> column(interiorCount);
+    for (int ch = 0; ch < 256; ++ch) {
+        for (int i = 0; i < interiorCount; ++i) {
+            column[i] = wideTable[i * 256 + ch];
+        }
+        auto it = classOfColumn.insert(
+            std::make_pair(column, static_cast<int>(classOfColumn.size())));
+        m_byteClass[ch] = static_cast<unsigned char>(it.first->second);
+    }
+
+    m_classCount = classOfColumn.size();
+    m_interiorCount = interiorCount;
+    m_transitions.assign(interiorCount * m_classCount, 0);
+    for (int i = 0; i < interiorCount; ++i) {
+        for (int ch = 0; ch < 256; ++ch) {
+            m_transitions[i * m_classCount + m_byteClass[ch]] =
+                wideTable[i * 256 + ch];
+        }
+    }
+    m_states.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        CompiledState &state = m_states[stateOf[i]];
+        state.key = nodes[i]->key;
+        state.hasKey = nodes[i]->hasKey();
+        state.hasChildren = nodes[i]->childCount > 0;
+    }
+    m_compiled = true;
+    return true;
+}
+
 // Find the longest matching key and node.
 int InputMap::lookupKey(const char *input, int inputSize,
                         Key &keyOut, bool &incompleteOut) const {
+    if (!m_compiled) {
+        return lookupKeyInTrie(input, inputSize, keyOut, incompleteOut);
+    }
+
+    const uint16_t *const transitions = m_transitions.data();
+    const CompiledState *const states = m_states.data();
+    const int classCount = m_classCount;
+    int state = 0;
+    int longestMatchState = 0;
+    int longestMatchLen = 0;
+
+    for (int i = 0; i < inputSize; ++i) {
+        const unsigned char ch = input[i];
+        state = transitions[state * classCount + m_byteClass[ch]];
+        if (state == 0) {
+            keyOut = states[longestMatchState].key;
+            incompleteOut = false;
+            return longestMatchLen;
+        }
+        if (states[state].hasKey) {
+            longestMatchLen = i + 1;
+            longestMatchState = state;
+        }
+        if (state >= m_interiorCount) {
+            // A leaf has no transitions.
+            break;
+        }
+    }
+    keyOut = states[longestMatchState].key;
+    incompleteOut = states[state].hasChildren;
+    return longestMatchLen;
+}
+
+int InputMap::lookupKeyInTrie(const char *input, int inputSize,
+                              Key &keyOut, bool &incompleteOut) const {
     keyOut = kKeyZero;
     incompleteOut = false;
 
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include <string>
+#include <vector>
 
 #include "SimplePool.h"
 #include "../shared/WinptyAssert.h"
@@ -73,13 +74,32 @@ private:
         }
     };
 
+    // The trie flattened into a state-transition table.  Input bytes that
+    // every node treats alike share a byte class, and each interior state
+    // has one row of next states, indexed by byte class.  The leaf states
+    // are numbered after the interior ones.  State 0 is the root, so a next
+    // state of 0 means there is no transition.
+    struct CompiledState {
+        Key key;
+        bool hasKey;
+        bool hasChildren;
+    };
+
 private:
     SimplePool<Node, 256> m_nodePool;
     SimplePool<Branch, 8> m_branchPool;
     Node m_root;
+    bool m_compiled = false;
+    int m_classCount = 0;
+    int m_interiorCount = 0;
+    unsigned char m_byteClass[256];
+    std::vector<uint16_t> m_transitions;
+    std::vector<CompiledState> m_states;
 
 public:
     void set(const char *encoding, int encodingLen, const Key &key);
+    bool compile();
+    bool isCompiled() const { return m_compiled; }
     int lookupKey(const char *input, int inputSize,
                   Key &keyOut, bool &incompleteOut) const;
     void dumpInputMap() const;
@@ -102,6 +122,8 @@ private:
         }
     }
 
+    int lookupKeyInTrie(const char *input, int inputSize,
+                        Key &keyOut, bool &incompleteOut) const;
     void setHelper(Node &node, const char *encoding, int encodingLen, const Key &key);
     Node &getOrCreateChild(Node &node, unsigned char ch);
     void dumpInputMapHelper(const Node &node, std::string &encoding) const;
@@ -0,0 +1,83 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "KeyboardLayoutCache.h"
+
+#include <string.h>
+
+const uint16_t KeyboardLayoutCache::kDenseLimit;
+const size_t KeyboardLayoutCache::kSparseSlots;
+const int32_t KeyboardLayoutCache::kUnknown;
+
+KeyboardLayoutCache::KeyboardLayoutCache(
+        VkKeyScanFunc *vkKeyScan, ScanCodeFunc *scanCode) :
+    m_vkKeyScanFunc(vkKeyScan),
+    m_scanCodeFunc(scanCode),
+    m_denseVkKeyScan(kDenseLimit),
+    m_sparseVkKeyScan(kSparseSlots)
+{
+    clear();
+}
+
+// Record the current keyboard layout, discarding the cached results if it
+// has changed since the last call.
+void KeyboardLayoutCache::setLayout(uintptr_t layout)
+{
+    if (layout != m_layout) {
+        m_layout = layout;
+        clear();
+    }
+}
+
+void KeyboardLayoutCache::clear()
+{
+    m_denseVkKeyScan.assign(kDenseLimit, kUnknown);
+    m_sparseVkKeyScan.assign(kSparseSlots, SparseEntry());
+    memset(m_scanCodeKnown, 0, sizeof(m_scanCodeKnown));
+}
+
+int16_t KeyboardLayoutCache::vkKeyScan(uint16_t ch)
+{
+    if (ch < kDenseLimit) {
+        int32_t &entry = m_denseVkKeyScan[ch];
+        if (entry == kUnknown) {
+            entry = m_vkKeyScanFunc(ch);
+        }
+        return static_cast<int16_t>(entry);
+    }
+    SparseEntry &entry = m_sparseVkKeyScan[ch % kSparseSlots];
+    if (entry.ch != ch) {
+        entry.ch = ch;
+        entry.result = m_vkKeyScanFunc(ch);
+    }
+    return entry.result;
+}
+
+uint16_t KeyboardLayoutCache::scanCode(uint16_t virtualKey)
+{
+    if (virtualKey >= 256) {
+        return m_scanCodeFunc(virtualKey);
+    }
+    if (!m_scanCodeKnown[virtualKey]) {
+        m_scanCodes[virtualKey] = m_scanCodeFunc(virtualKey);
+        m_scanCodeKnown[virtualKey] = true;
+    }
+    return m_scanCodes[virtualKey];
+}
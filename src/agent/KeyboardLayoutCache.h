@@ -0,0 +1,74 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_KEYBOARD_LAYOUT_CACHE_H
+#define AGENT_KEYBOARD_LAYOUT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Caches the keyboard layout lookups ConsoleInput makes for every character
+// and key event it synthesizes: VkKeyScan (character -> virtual key and
+// shift state) and MapVirtualKey (virtual key -> scan code).  Each is a
+// user32 call, and a large paste makes several per character.
+//
+// Characters below kDenseLimit, which covers the alphabetic scripts most
+// layouts type directly, have a table entry each.  Other BMP characters share
+// a small direct-mapped table, where a character evicts whichever one was
+// in its slot.  Scan codes are kept for virtual keys 0-255.  Everything is
+// discarded when the layout changes.
+//
+// The lookups are passed in as plain functions, so that this class has no
+// Win32 dependencies (see KeyboardLayoutCacheTest.cc).
+class KeyboardLayoutCache {
+public:
+    typedef int16_t VkKeyScanFunc(uint16_t ch);
+    typedef uint16_t ScanCodeFunc(uint16_t virtualKey);
+
+    static const uint16_t kDenseLimit = 0x800;
+    static const size_t kSparseSlots = 4096;
+
+    KeyboardLayoutCache(VkKeyScanFunc *vkKeyScan, ScanCodeFunc *scanCode);
+    void setLayout(uintptr_t layout);
+    int16_t vkKeyScan(uint16_t ch);
+    uint16_t scanCode(uint16_t virtualKey);
+
+private:
+    static const int32_t kUnknown = -0x10000;
+
+    void clear();
+
+    VkKeyScanFunc *m_vkKeyScanFunc;
+    ScanCodeFunc *m_scanCodeFunc;
+    uintptr_t m_layout = 0;
+    // VkKeyScan results, or kUnknown.
+    std::vector<int32_t> m_denseVkKeyScan;
+    struct SparseEntry {
+        uint16_t ch;        // 0 if the slot is empty
+        int16_t result;
+    };
+    std::vector<SparseEntry> m_sparseVkKeyScan;
+    uint16_t m_scanCodes[256];
+    bool m_scanCodeKnown[256];
+};
+
+#endif // AGENT_KEYBOARD_LAYOUT_CACHE_H
@@ -0,0 +1,158 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Check KeyboardLayoutCache against uncached lookups across layout changes.
+
+#include "KeyboardLayoutCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint16_t kVkShift = 0x10;
+
+int g_layout = 1;
+size_t g_vkKeyScanCalls = 0;
+size_t g_scanCodeCalls = 0;
+int g_failures = 0;
+
+// Stand-ins for VkKeyScan and MapVirtualKey that count their calls, using a
+// made-up layout: ASCII letters and digits are typed directly, with Shift for
+// capitals, and other characters depend on the layout number.  The stubs cost
+// almost nothing, unlike the user32 calls, so the benchmark's times show only
+// the overhead of the cache itself.
+int16_t stubVkKeyScan(uint16_t ch) {
+    ++g_vkKeyScanCalls;
+    if (ch >= 'a' && ch <= 'z') {
+        return ch - 'a' + 'A';
+    } else if (ch >= 'A' && ch <= 'Z') {
+        return 0x100 | ch;
+    } else if (ch >= '0' && ch <= '9') {
+        return ch;
+    } else if ((ch + g_layout) % 3 == 0) {
+        return -1;
+    }
+    return static_cast<int16_t>(((ch * 7 + g_layout) & 0x3FF) | 0x30);
+}
+
+uint16_t stubScanCode(uint16_t virtualKey) {
+    ++g_scanCodeCalls;
+    return (virtualKey * 13 + g_layout) & 0xFF;
+}
+
+void check(bool cond, const char *what, uint16_t value) {
+    if (!cond && g_failures++ < 10) {
+        printf("FAIL: %s: 0x%04x\n", what, value);
+    }
+}
+
+void correctness() {
+    KeyboardLayoutCache cache(stubVkKeyScan, stubScanCode);
+    srand(1);
+    for (int step = 0; step < 1000000; ++step) {
+        if (rand() % 10000 == 0) {
+            g_layout = 1 + rand() % 4;
+            cache.setLayout(g_layout);
+        }
+        const uint16_t ch = rand() % 2 == 0
+            ? rand() % 0x1000 : rand() % 0x10000;
+        check(cache.vkKeyScan(ch) == stubVkKeyScan(ch), "vkKeyScan", ch);
+        const uint16_t vk = rand() % 300;
+        check(cache.scanCode(vk) == stubScanCode(vk), "scanCode", vk);
+    }
+}
+
+// The lookups ConsoleInput::appendUtf8Char and appendKeyPress make for one
+// character: VkKeyScan, then a scan code for each key record, including the
+// Shift press and release if the character needs Shift.
+template <typename VkKeyScan, typename ScanCode>
+uint32_t translate(const std::u16string &text,
+                   VkKeyScan vkKeyScan, ScanCode scanCode) {
+    uint32_t sum = 0;
+    for (char16_t ch : text) {
+        const int16_t charScan = vkKeyScan(ch);
+        const uint16_t vk = charScan == -1 ? 0 : charScan & 0xFF;
+        const bool shift = charScan != -1 && (charScan & 0x100);
+        if (shift) {
+            sum += scanCode(kVkShift);
+        }
+        sum += scanCode(vk) + scanCode(vk);
+        if (shift) {
+            sum += scanCode(kVkShift);
+        }
+    }
+    return sum;
+}
+
+std::u16string pasteText() {
+    static const char16_t *const lines[] = {
+        u"Get-ChildItem -Recurse | Where-Object { $_.Length -gt 1MB }\r",
+        u"    Write-Host \"Processing $($_.FullName)...\"\r",
+        u"# Straße, naïve, été, Γειά\r",
+        u"# 日本語のテキスト\r",
+    };
+    std::u16string ret;
+    srand(2);
+    while (ret.size() < 4 * 1024 * 1024) {
+        ret += lines[rand() % (sizeof(lines) / sizeof(lines[0]))];
+    }
+    return ret;
+}
+
+void benchmark() {
+    const std::u16string text = pasteText();
+    KeyboardLayoutCache cache(stubVkKeyScan, stubScanCode);
+    for (int cached = 0; cached < 2; ++cached) {
+        g_vkKeyScanCalls = 0;
+        g_scanCodeCalls = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const uint32_t sum = cached
+            ? translate(text,
+                [&](uint16_t ch) { return cache.vkKeyScan(ch); },
+                [&](uint16_t vk) { return cache.scanCode(vk); })
+            : translate(text, stubVkKeyScan, stubScanCode);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        printf("%-8s VkKeyScan calls/char=%.4f  MapVirtualKey calls/char=%.4f"
+               "  %.1f ns/char  (sum %u)\n",
+               cached ? "cached" : "uncached",
+               static_cast<double>(g_vkKeyScanCalls) / text.size(),
+               static_cast<double>(g_scanCodeCalls) / text.size(),
+               elapsed.count() * 1e9 / text.size(), sum);
+    }
+}
+
+} // anonymous namespace
+
+int main() {
+    correctness();
+    if (g_failures > 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    printf("correctness: OK\n");
+    benchmark();
+    return 0;
+}
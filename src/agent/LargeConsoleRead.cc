@@ -22,9 +22,9 @@
 
 #include <stdlib.h>
 
-#include "../shared/WindowsVersion.h"
+#include "CellScan.h"
 #include "Scraper.h"
-#include "Win32ConsoleBuffer.h"
+#include "ConsoleBuffer.h"
 
 LargeConsoleReadBuffer::LargeConsoleReadBuffer() :
     m_rect(0, 0, 0, 0), m_rectWidth(0)
@@ -32,14 +32,13 @@ LargeConsoleReadBuffer::LargeConsoleReadBuffer() :
 }
 
 void largeConsoleRead(LargeConsoleReadBuffer &out,
-                      Win32ConsoleBuffer &buffer,
+                      ConsoleBuffer &buffer,
                       const SmallRect &readArea,
                       WORD attributesMask) {
     ASSERT(readArea.Left >= 0 &&
            readArea.Top >= 0 &&
            readArea.Right >= readArea.Left &&
-           readArea.Bottom >= readArea.Top &&
-           readArea.width() <= MAX_CONSOLE_WIDTH);
+           readArea.Bottom >= readArea.Top);
     const size_t count = readArea.width() * readArea.height();
     if (out.m_data.size() < count) {
         out.m_data.resize(count);
@@ -47,10 +46,19 @@ void largeConsoleRead(LargeConsoleReadBuffer &out,
     out.m_rect = readArea;
     out.m_rectWidth = readArea.width();
 
-    static const bool useLargeReads = isAtLeastWindows8();
-    if (useLargeReads) {
+    // Mask the attributes of each chunk as soon as it's read, while the
+    // cells are still in cache.
+    const bool maskAttributes = attributesMask != static_cast<WORD>(~0);
+
+    if (buffer.largeReadsAllowed()) {
         buffer.read(readArea, out.m_data.data());
+        if (maskAttributes) {
+            maskCellAttributes(out.m_data.data(), count, attributesMask);
+        }
     } else {
+        // Prior to Windows 8, the agent keeps the console within the default
+        // limits (see ConsoleLimits.h).
+        ASSERT(readArea.width() <= MAX_CONSOLE_WIDTH);
         const int maxReadLines = std::max(1, MAX_CONSOLE_WIDTH / readArea.width());
         int curLine = readArea.Top;
         while (curLine <= readArea.Bottom) {
@@ -59,13 +67,14 @@ void largeConsoleRead(LargeConsoleReadBuffer &out,
                 curLine,
                 readArea.width(),
                 std::min(maxReadLines, readArea.Bottom + 1 - curLine));
-            buffer.read(subReadArea, out.lineDataMut(curLine));
+            CHAR_INFO *const data = out.lineDataMut(curLine);
+            buffer.read(subReadArea, data);
+            if (maskAttributes) {
+                maskCellAttributes(
+                    data, subReadArea.width() * subReadArea.height(),
+                    attributesMask);
+            }
             curLine = subReadArea.Bottom + 1;
         }
     }
-    if (attributesMask != static_cast<WORD>(~0)) {
-        for (size_t i = 0; i < count; ++i) {
-            out.m_data[i].Attributes &= attributesMask;
-        }
-    }
 }
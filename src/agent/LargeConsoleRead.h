@@ -21,16 +21,16 @@
 #ifndef LARGE_CONSOLE_READ_H
 #define LARGE_CONSOLE_READ_H
 
-#include <windows.h>
 #include <stdlib.h>
 
 #include <vector>
 
+#include "ConsoleTypes.h"
 #include "SmallRect.h"
 #include "../shared/DebugClient.h"
 #include "../shared/WinptyAssert.h"
 
-class Win32ConsoleBuffer;
+class ConsoleBuffer;
 
 class LargeConsoleReadBuffer {
 public:
@@ -60,7 +60,7 @@ private:
     std::vector<CHAR_INFO> m_data;
 
     friend void largeConsoleRead(LargeConsoleReadBuffer &out,
-                                 Win32ConsoleBuffer &buffer,
+                                 ConsoleBuffer &buffer,
                                  const SmallRect &readArea,
                                  WORD attributesMask);
 };
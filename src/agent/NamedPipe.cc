@@ -114,16 +114,17 @@ NamedPipe::ServiceResult NamedPipe::IoWorker::service()
         m_currentIoSize = 0;
         progress = ServiceResult::Progress;
     }
+    char *buffer = nullptr;
     DWORD nextSize = 0;
     bool isRead = false;
-    while (shouldIssueIo(&nextSize, &isRead)) {
+    while (shouldIssueIo(&buffer, &nextSize, &isRead)) {
         m_currentIoSize = nextSize;
         DWORD actual = 0;
         memset(&m_over, 0, sizeof(m_over));
         m_over.hEvent = m_event.get();
         BOOL ret = isRead
-                ? ReadFile(m_namedPipe.m_handle, m_buffer, nextSize, &actual, &m_over)
-                : WriteFile(m_namedPipe.m_handle, m_buffer, nextSize, &actual, &m_over);
+                ? ReadFile(m_namedPipe.m_handle, buffer, nextSize, &actual, &m_over)
+                : WriteFile(m_namedPipe.m_handle, buffer, nextSize, &actual, &m_over);
         if (!ret) {
             if (GetLastError() == ERROR_IO_PENDING) {
                 // There is a pending I/O.
@@ -164,8 +165,10 @@ void NamedPipe::InputWorker::completeIo(DWORD size)
     m_namedPipe.m_inQueue.append(m_buffer, size);
 }
 
-bool NamedPipe::InputWorker::shouldIssueIo(DWORD *size, bool *isRead)
+bool NamedPipe::InputWorker::shouldIssueIo(char **buffer, DWORD *size,
+                                           bool *isRead)
 {
+    *buffer = m_buffer;
     *isRead = true;
     ASSERT(!m_namedPipe.isConnecting());
     if (m_namedPipe.isClosed()) {
@@ -181,28 +184,23 @@ bool NamedPipe::InputWorker::shouldIssueIo(DWORD *size, bool *isRead)
 void NamedPipe::OutputWorker::completeIo(DWORD size)
 {
     ASSERT(size == m_currentIoSize);
+    m_namedPipe.m_outQueue.pop(size);
 }
 
-bool NamedPipe::OutputWorker::shouldIssueIo(DWORD *size, bool *isRead)
+bool NamedPipe::OutputWorker::shouldIssueIo(char **buffer, DWORD *size,
+                                            bool *isRead)
 {
     *isRead = false;
-    if (!m_namedPipe.m_outQueue.empty()) {
-        auto &out = m_namedPipe.m_outQueue;
-        const DWORD writeSize = std::min<size_t>(out.size(), kIoSize);
-        std::copy(&out[0], &out[writeSize], m_buffer);
-        out.erase(0, writeSize);
-        *size = writeSize;
+    size_t frontSize = 0;
+    *buffer = m_namedPipe.m_outQueue.front(&frontSize);
+    if (frontSize > 0) {
+        *size = std::min<size_t>(frontSize, kIoSize);
         return true;
     } else {
         return false;
     }
 }
 
-DWORD NamedPipe::OutputWorker::getPendingIoSize()
-{
-    return m_pending ? m_currentIoSize : 0;
-}
-
 void NamedPipe::openServerPipe(LPCWSTR pipeName, OpenMode::t openMode,
                                int outBufferSize, int inBufferSize) {
     ASSERT(isClosed());
@@ -285,11 +283,8 @@ void NamedPipe::startPipeWorkers()
 size_t NamedPipe::bytesToSend()
 {
     ASSERT(m_openMode & OpenMode::Writing);
-    auto ret = m_outQueue.size();
-    if (m_outputWorker != NULL) {
-        ret += m_outputWorker->getPendingIoSize();
-    }
-    return ret;
+    // This includes the bytes of a pending write.
+    return m_outQueue.size();
 }
 
 void NamedPipe::write(const void *data, size_t size)
@@ -28,10 +28,12 @@
 #include <vector>
 
 #include "../shared/OwnedHandle.h"
+#include "OutputQueue.h"
+#include "TerminalOutput.h"
 
 class EventLoop;
 
-class NamedPipe
+class NamedPipe : public TerminalOutput
 {
 private:
     // The EventLoop uses these private members.
@@ -59,9 +61,9 @@ private:
         OwnedHandle m_event;
         OVERLAPPED m_over = {};
         enum { kIoSize = 64 * 1024 };
-        char m_buffer[kIoSize];
         virtual void completeIo(DWORD size) = 0;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) = 0;
+        virtual bool shouldIssueIo(char **buffer, DWORD *size,
+                                   bool *isRead) = 0;
     };
 
     class InputWorker : public IoWorker
@@ -69,18 +71,22 @@ private:
     public:
         InputWorker(NamedPipe &namedPipe) : IoWorker(namedPipe) {}
     protected:
+        char m_buffer[kIoSize];
         virtual void completeIo(DWORD size) override;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) override;
+        virtual bool shouldIssueIo(char **buffer, DWORD *size,
+                                   bool *isRead) override;
     };
 
+    // The output worker writes directly from the front of m_outQueue.  The
+    // bytes stay queued (and in place) until the write completes.
     class OutputWorker : public IoWorker
     {
     public:
         OutputWorker(NamedPipe &namedPipe) : IoWorker(namedPipe) {}
-        DWORD getPendingIoSize();
     protected:
         virtual void completeIo(DWORD size) override;
-        virtual bool shouldIssueIo(DWORD *size, bool *isRead) override;
+        virtual bool shouldIssueIo(char **buffer, DWORD *size,
+                                   bool *isRead) override;
     };
 
 public:
@@ -94,7 +100,7 @@ public:
                         int outBufferSize, int inBufferSize);
     void connectToServer(LPCWSTR pipeName, OpenMode::t openMode);
     size_t bytesToSend();
-    void write(const void *data, size_t size);
+    virtual void write(const void *data, size_t size) override;
     void write(const char *text);
     size_t readBufferSize();
     void setReadBufferSize(size_t size);
@@ -116,7 +122,7 @@ private:
     OpenMode::t m_openMode = OpenMode::None;
     size_t m_readBufferSize = 64 * 1024;
     std::string m_inQueue;
-    std::string m_outQueue;
+    OutputQueue m_outQueue;
     HANDLE m_handle = nullptr;
     std::unique_ptr<InputWorker> m_inputWorker;
     std::unique_ptr<OutputWorker> m_outputWorker;
@@ -0,0 +1,69 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_OUTPUT_BACKLOG_LIMIT_H
+#define AGENT_OUTPUT_BACKLOG_LIMIT_H
+
+#include <stddef.h>
+
+#include <algorithm>
+
+// Hysteresis on the output queued for the terminal (NamedPipe::bytesToSend
+// summed over the output pipes).  When more than `highBytes` are queued, the
+// agent stops scraping; it starts again once the terminal has read the queue
+// down to `lowBytes`.  The console isn't frozen meanwhile, so whatever the
+// program printed in between reaches the terminal as one scrape of the
+// console's current state, and the terminal skips the intermediate frames
+// instead of replaying them late.  The gap between the limits keeps the
+// agent from alternating between scraping and skipping on every poll.  A
+// `highBytes` of 0 turns the limit off.
+class OutputBacklogLimit {
+public:
+    OutputBacklogLimit(size_t highBytes, size_t lowBytes) :
+        m_highBytes(highBytes),
+        m_lowBytes(std::min(lowBytes, highBytes))
+    {
+    }
+
+    size_t high() const { return m_highBytes; }
+    size_t low() const { return m_lowBytes; }
+    bool throttled() const { return m_throttled; }
+
+    // Called before each scrape with the number of bytes still queued for
+    // the terminal.  Returns whether the scrape should go ahead.
+    bool shouldScrape(size_t queuedBytes) {
+        if (m_highBytes == 0) {
+            return true;
+        }
+        if (m_throttled) {
+            m_throttled = queuedBytes > m_lowBytes;
+        } else {
+            m_throttled = queuedBytes > m_highBytes;
+        }
+        return !m_throttled;
+    }
+
+private:
+    size_t m_highBytes = 0;
+    size_t m_lowBytes = 0;
+    bool m_throttled = false;
+};
+
+#endif // AGENT_OUTPUT_BACKLOG_LIMIT_H
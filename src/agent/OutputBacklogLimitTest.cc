@@ -0,0 +1,176 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Check OutputBacklogLimit's hysteresis, then simulate a program that floods
+// the console while the terminal reads slowly.  The simulation reports how
+// large the output queue grows and how long the terminal takes to catch up
+// once the flood stops, and checks that the queue stays within one scrape of
+// the high limit.
+
+#include "OutputBacklogLimit.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "../tests/VirtualEventLoop.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("Error: %s:%d: check failed: %s\n",                  \
+                   __FILE__, __LINE__, #cond);                          \
+            ++g_failures;                                               \
+        }                                                               \
+    } while (false)
+
+void checkHysteresis() {
+    OutputBacklogLimit limit(1000, 100);
+    CHECK(limit.shouldScrape(1000));
+    CHECK(!limit.shouldScrape(1001));
+    CHECK(limit.throttled());
+    // Below the high limit isn't enough to resume...
+    CHECK(!limit.shouldScrape(500));
+    CHECK(!limit.shouldScrape(101));
+    // ...until the queue drains to the low limit.
+    CHECK(limit.shouldScrape(100));
+    CHECK(!limit.throttled());
+    CHECK(limit.shouldScrape(500));
+
+    OutputBacklogLimit off(0, 0);
+    CHECK(off.shouldScrape(static_cast<size_t>(-1)));
+    CHECK(!off.throttled());
+
+    // A low limit above the high one is clamped.
+    OutputBacklogLimit inverted(1000, 5000);
+    CHECK(inverted.low() == 1000);
+}
+
+const int kPollMs = 25;
+const int kFloodMs = 10000;
+
+// What one scrape sends while the program is printing.  In scrolling mode,
+// the lines that scrolled by during skipped polls are still in the console
+// buffer, so a scrape after a pause sends all of them, up to the size of the
+// buffer.  In a full-screen program, a scrape sends one screenful however
+// long the pause was.
+struct Workload {
+    const char *name;
+    size_t bytesPerPoll;
+    size_t maxBytesPerScrape;
+};
+
+struct Result {
+    size_t peakQueued = 0;
+    size_t sentBytes = 0;
+    int droppedPolls = 0;
+    int catchUpMs = 0;
+};
+
+Result simulate(const Workload &w, size_t bytesPerMs,
+                size_t highBytes, size_t lowBytes) {
+    OutputBacklogLimit limit(highBytes, lowBytes);
+    VirtualEventLoop loop;
+    Result ret;
+    size_t queued = 0;
+    size_t unscraped = 0;
+    int caughtUpTime = 0;
+    while (true) {
+        loop.wait(kPollMs);
+        queued -= std::min(queued, bytesPerMs * loop.elapsed());
+        if (loop.now() <= kFloodMs) {
+            unscraped += w.bytesPerPoll;
+        } else if (unscraped == 0) {
+            break;
+        }
+        if (unscraped > 0) {
+            if (limit.shouldScrape(queued)) {
+                const size_t frame = std::min(unscraped, w.maxBytesPerScrape);
+                queued += frame;
+                ret.sentBytes += frame;
+                unscraped = 0;
+                // The terminal has caught up once it reads what is queued
+                // after the last scrape.
+                caughtUpTime = loop.now() +
+                    static_cast<int>((queued + bytesPerMs - 1) / bytesPerMs);
+                ret.peakQueued = std::max(ret.peakQueued, queued);
+            } else {
+                ++ret.droppedPolls;
+            }
+        }
+    }
+    ret.catchUpMs = std::max(0, caughtUpTime - kFloodMs);
+    if (highBytes != 0) {
+        // A scrape only starts with at most `highBytes` queued.
+        CHECK(ret.peakQueued <= highBytes + w.maxBytesPerScrape);
+    }
+    return ret;
+}
+
+void report(const Workload &w, size_t bytesPerMs,
+            size_t highBytes, size_t lowBytes) {
+    const Result r = simulate(w, bytesPerMs, highBytes, lowBytes);
+    char limitDesc[64];
+    if (highBytes == 0) {
+        snprintf(limitDesc, sizeof(limitDesc), "no limit");
+    } else {
+        snprintf(limitDesc, sizeof(limitDesc), "%zuK/%zuK",
+                 highBytes / 1024, lowBytes / 1024);
+    }
+    printf("  %-12s %4zuKB/s  %-10s peak=%6zuKB  sent=%6zuKB  "
+           "dropped=%3d  catch-up=%6dms\n",
+           w.name, bytesPerMs * 1000 / 1024, limitDesc,
+           r.peakQueued / 1024, r.sentBytes / 1024,
+           r.droppedPolls, r.catchUpMs);
+}
+
+} // anonymous namespace
+
+int main() {
+    checkHysteresis();
+
+    // About 5.5KB per poll matches the scraper_bench "spew" workload.  The
+    // console buffer holds about 3000 lines.
+    const Workload workloads[] = {
+        { "scrolling", 5500, 3000 * 80 },
+        { "fullscreen", 5500, 5500 },
+    };
+    const size_t rates[] = { 50, 150, 1000 };
+    for (const auto &w : workloads) {
+        printf("%s:\n", w.name);
+        for (size_t rate : rates) {
+            report(w, rate, 0, 0);
+            report(w, rate, 1024 * 1024, 64 * 1024);
+            report(w, rate, 256 * 1024, 16 * 1024);
+            report(w, rate, 64 * 1024, 8 * 1024);
+        }
+    }
+
+    if (g_failures != 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "OutputQueue.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "../shared/WinptyAssert.h"
+
+void OutputQueue::append(const void *data, size_t size)
+{
+    const char *src = reinterpret_cast<const char*>(data);
+    while (size > 0) {
+        Segment *tail = m_segments.empty() ? nullptr : m_segments.back().get();
+        if (tail == nullptr || tail->end == kSegmentSize) {
+            tail = &appendSegment();
+        }
+        const size_t chunk = std::min(size, kSegmentSize - tail->end);
+        memcpy(&tail->data[tail->end], src, chunk);
+        tail->end += chunk;
+        m_size += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+// Returns the contiguous bytes at the front of the queue, which stay in place
+// until they are popped, or NULL if the queue is empty.
+char *OutputQueue::front(size_t *size)
+{
+    if (m_size == 0) {
+        *size = 0;
+        return nullptr;
+    }
+    Segment &head = *m_segments.front();
+    ASSERT(head.end > head.begin);
+    *size = head.end - head.begin;
+    return &head.data[head.begin];
+}
+
+void OutputQueue::pop(size_t size)
+{
+    ASSERT(size <= m_size);
+    m_size -= size;
+    while (size > 0) {
+        Segment &head = *m_segments.front();
+        const size_t chunk = std::min(size, head.end - head.begin);
+        head.begin += chunk;
+        size -= chunk;
+        if (head.begin == head.end) {
+            if (m_segments.size() == 1) {
+                // Keep the last segment, and start over at its beginning.
+                head.begin = head.end = 0;
+            } else {
+                recycleSegment(std::move(m_segments.front()));
+                m_segments.pop_front();
+            }
+        }
+    }
+}
+
+void OutputQueue::clear()
+{
+    while (!m_segments.empty()) {
+        recycleSegment(std::move(m_segments.front()));
+        m_segments.pop_front();
+    }
+    m_size = 0;
+}
+
+OutputQueue::Segment &OutputQueue::appendSegment()
+{
+    std::unique_ptr<Segment> segment = std::move(m_spare);
+    if (!segment) {
+        segment.reset(new Segment);
+    }
+    segment->begin = segment->end = 0;
+    m_segments.push_back(std::move(segment));
+    return *m_segments.back();
+}
+
+// Keep one drained segment for reuse, so a queue that is repeatedly filled
+// and drained doesn't allocate, but a large backlog is freed once it's sent.
+void OutputQueue::recycleSegment(std::unique_ptr<Segment> segment)
+{
+    if (!m_spare) {
+        m_spare = std::move(segment);
+    }
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef AGENT_OUTPUT_QUEUE_H
+#define AGENT_OUTPUT_QUEUE_H
+
+#include <stdlib.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+// A FIFO byte queue for a NamedPipe's outgoing data, made of fixed-size
+// segments.  Queued bytes never move, so an overlapped WriteFile can send
+// straight from the front segment while more output is appended behind it,
+// and consuming bytes doesn't shift the rest of the queue.  Drained segments
+// are recycled.
+class OutputQueue {
+public:
+    static const size_t kSegmentSize = 64 * 1024;
+
+    OutputQueue() {}
+    OutputQueue(const OutputQueue &other) = delete;
+    OutputQueue &operator=(const OutputQueue &other) = delete;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    void append(const void *data, size_t size);
+    char *front(size_t *size);
+    void pop(size_t size);
+    void clear();
+
+private:
+    struct Segment {
+        size_t begin;
+        size_t end;
+        char data[kSegmentSize];
+    };
+
+    Segment &appendSegment();
+    void recycleSegment(std::unique_ptr<Segment> segment);
+
+    std::deque<std::unique_ptr<Segment>> m_segments;
+    std::unique_ptr<Segment> m_spare;
+    size_t m_size = 0;
+};
+
+#endif // AGENT_OUTPUT_QUEUE_H
@@ -0,0 +1,183 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Check OutputQueue against a std::string model with random appends and pops.
+
+#include "OutputQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+void assertTrace(const char *file, int line, const char *cond) {
+    fprintf(stderr, "Assertion failed: %s, file %s, line %d\n",
+            cond, file, line);
+}
+
+namespace {
+
+const size_t kIoSize = 64 * 1024;
+
+int g_failures = 0;
+
+void correctness() {
+    OutputQueue queue;
+    std::string model;
+    std::vector<char> data(3 * OutputQueue::kSegmentSize);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(rand());
+    }
+    for (int step = 0; step < 200000 && g_failures == 0; ++step) {
+        const int op = rand() % 8;
+        if (op < 5) {
+            // Mostly short writes, occasionally one spanning segments.
+            const size_t size = rand() % 20 == 0
+                ? rand() % data.size() : rand() % 200;
+            const size_t start = rand() % (data.size() - size + 1);
+            queue.append(&data[start], size);
+            model.append(&data[start], size);
+        } else if (op < 7) {
+            size_t frontSize = 0;
+            const char *front = queue.front(&frontSize);
+            if (frontSize > model.size() ||
+                    (model.size() > 0 && frontSize == 0) ||
+                    (frontSize > 0 &&
+                     memcmp(front, model.data(), frontSize) != 0)) {
+                printf("Error: step %d: front doesn't match\n", step);
+                ++g_failures;
+            }
+            const size_t size = frontSize == 0 ? 0 : rand() % (frontSize + 1);
+            queue.pop(size);
+            model.erase(0, size);
+        } else if (rand() % 100 == 0) {
+            queue.clear();
+            model.clear();
+        }
+        if (queue.size() != model.size()) {
+            printf("Error: step %d: size %u, expected %u\n", step,
+                   static_cast<unsigned>(queue.size()),
+                   static_cast<unsigned>(model.size()));
+            ++g_failures;
+        }
+    }
+}
+
+// The old NamedPipe output path: the output worker copied each chunk into a
+// 64KB I/O buffer and erased it from the front of the string.  `pipe` stands
+// in for WriteFile, which copies the bytes out.
+class StringQueue {
+public:
+    void write(const char *data, size_t size) { m_queue.append(data, size); }
+    size_t size() const { return m_queue.size(); }
+    void sendChunk(char *pipe) {
+        const size_t size = std::min(m_queue.size(), kIoSize);
+        std::copy(&m_queue[0], &m_queue[size], m_buffer);
+        m_queue.erase(0, size);
+        memcpy(pipe, m_buffer, size);
+    }
+private:
+    std::string m_queue;
+    char m_buffer[kIoSize];
+};
+
+class SegmentQueue {
+public:
+    void write(const char *data, size_t size) { m_queue.append(data, size); }
+    size_t size() const { return m_queue.size(); }
+    void sendChunk(char *pipe) {
+        size_t size = 0;
+        const char *data = m_queue.front(&size);
+        size = std::min(size, kIoSize);
+        memcpy(pipe, data, size);
+        m_queue.pop(size);
+    }
+private:
+    OutputQueue m_queue;
+};
+
+// Write `total` bytes of terminal-sized lines in scrapes of 4KB.  The pipe
+// accepts one write per `scrapesPerWrite` scrapes until the output is all
+// queued, then the rest drains.  A slow reader therefore builds a backlog.
+template <typename Queue>
+double throughput(size_t total, int scrapesPerWrite) {
+    static std::vector<char> pipe(kIoSize);
+    static const char kLine[] =
+        "drwxr-xr-x  2 user group     4096 Oct 18 05:03 some-directory-name\r\n";
+    const size_t lineSize = sizeof(kLine) - 1;
+    std::unique_ptr<Queue> queue(new Queue);
+    const auto t0 = std::chrono::steady_clock::now();
+    size_t written = 0;
+    int scrape = 0;
+    while (written < total) {
+        for (size_t batch = 0; batch < 4096; batch += lineSize) {
+            queue->write(kLine, lineSize);
+        }
+        written += 4096 / lineSize * lineSize;
+        if (++scrape % scrapesPerWrite == 0) {
+            queue->sendChunk(pipe.data());
+        }
+    }
+    while (queue->size() > 0) {
+        queue->sendChunk(pipe.data());
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    return written / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+}
+
+void benchmark() {
+    struct Scenario {
+        const char *name;
+        size_t total;
+        int scrapesPerWrite;
+    };
+    // With 4KB scrapes and 64KB writes, one write per scrape keeps up, while
+    // one write per 20 scrapes lets the backlog grow to about 6MB.
+    const Scenario kScenarios[] = {
+        { "keeping up", 1024 * 1024 * 1024, 1 },
+        { "backlog",    32 * 1024 * 1024,   20 },
+    };
+    for (const Scenario &s : kScenarios) {
+        const double before = throughput<StringQueue>(s.total,
+                                                      s.scrapesPerWrite);
+        const double after = throughput<SegmentQueue>(s.total,
+                                                      s.scrapesPerWrite);
+        printf("%-12s std::string %8.0f MB/s   OutputQueue %8.0f MB/s\n",
+               s.name, before, after);
+    }
+}
+
+} // anonymous namespace
+
+int main() {
+    correctness();
+    if (g_failures > 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    printf("correctness: OK\n");
+    benchmark();
+    return 0;
+}
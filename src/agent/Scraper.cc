@@ -20,9 +20,8 @@
 
 #include "Scraper.h"
 
-#include <windows.h>
-
 #include <stdint.h>
+#include <stdlib.h>
 
 #include <algorithm>
 #include <utility>
@@ -30,9 +29,10 @@
 #include "../shared/WinptyAssert.h"
 #include "../shared/winpty_snprintf.h"
 
-#include "ConsoleFont.h"
-#include "Win32Console.h"
-#include "Win32ConsoleBuffer.h"
+#include "AgentStats.h"
+#include "CellScan.h"
+#include "ConsoleBuffer.h"
+#include "ConsoleControl.h"
 
 namespace {
 
@@ -45,19 +45,22 @@ T constrained(T min, T val, T max) {
 } // anonymous namespace
 
 Scraper::Scraper(
-        Win32Console &console,
-        Win32ConsoleBuffer &buffer,
+        ConsoleControl &console,
+        ConsoleBuffer &buffer,
         std::unique_ptr<Terminal> terminal,
-        Coord initialSize) :
+        Coord initialSize,
+        const ConsoleLimits &limits) :
     m_console(console),
+    m_limits(limits),
     m_terminal(std::move(terminal)),
     m_ptySize(initialSize)
 {
+    ASSERT(m_limits.isValid());
     m_consoleBuffer = &buffer;
 
     resetConsoleTracking(Terminal::OmitClear, buffer.windowRect().top());
 
-    m_bufferData.resize(BUFFER_LINE_COUNT);
+    reserveBufferLines(initialSize.Y * 2);
 
     // Setup the initial screen buffer and window size.
     //
@@ -71,10 +74,10 @@ Scraper::Scraper(
     // While the small font intends to support large buffers, a user could
     // still hit a limit imposed by their monitor width, so cap the new window
     // size to GetLargestConsoleWindowSize().
-    setSmallFont(buffer.conout(), initialSize.X, m_console.isNewW10());
+    buffer.setSmallFont(initialSize.X, m_console.isNewW10());
     buffer.moveWindow(SmallRect(0, 0, 1, 1));
-    buffer.resizeBufferRange(Coord(initialSize.X, BUFFER_LINE_COUNT));
-    const auto largest = GetLargestConsoleWindowSize(buffer.conout());
+    buffer.resizeBufferRange(Coord(initialSize.X, m_limits.bufferLineCount));
+    const auto largest = buffer.largestWindowSize();
     buffer.moveWindow(SmallRect(
         0, 0,
         std::min(initialSize.X, largest.X),
@@ -83,7 +86,7 @@ Scraper::Scraper(
 
     // For the sake of the color translation heuristic, set the console color
     // to LtGray-on-Black.
-    buffer.setTextAttribute(Win32ConsoleBuffer::kDefaultAttributes);
+    buffer.setTextAttribute(ConsoleBuffer::kDefaultAttributes);
     buffer.clearAllLines(m_consoleBuffer->bufferInfo());
 
     m_consoleBuffer = nullptr;
@@ -93,23 +96,35 @@ Scraper::~Scraper()
 {
 }
 
-// Whether or not the agent is frozen on entry, it will be frozen on exit.
-void Scraper::resizeWindow(Win32ConsoleBuffer &buffer,
+// Track lines with hashes instead of copies (see ConsoleLine).  Call this
+// before the first scrape.
+void Scraper::setLineHashing(bool enabled)
+{
+    m_lineHashing = enabled;
+    for (ConsoleLine &line : m_bufferData) {
+        line.setHashOnly(enabled);
+    }
+}
+
+// The console is left frozen or unfrozen as it was on entry.
+void Scraper::resizeWindow(ConsoleBuffer &buffer,
                            Coord newSize,
                            ConsoleScreenBufferInfo &finalInfoOut)
 {
     m_consoleBuffer = &buffer;
     m_ptySize = newSize;
     syncConsoleContentAndSize(true, finalInfoOut);
+    m_terminal->flush();
     m_consoleBuffer = nullptr;
 }
 
-// This function may freeze the agent, but it will not unfreeze it.
-void Scraper::scrapeBuffer(Win32ConsoleBuffer &buffer,
+// The console is left frozen or unfrozen as it was on entry.
+void Scraper::scrapeBuffer(ConsoleBuffer &buffer,
                            ConsoleScreenBufferInfo &finalInfoOut)
 {
     m_consoleBuffer = &buffer;
     syncConsoleContentAndSize(false, finalInfoOut);
+    m_terminal->flush();
     m_consoleBuffer = nullptr;
 }
 
@@ -120,11 +135,15 @@ void Scraper::resetConsoleTracking(
         line.reset();
     }
     m_syncRow = -1;
+    m_outputLineRate = 0;
+    m_lastCursorRow = -1;
+    m_lastScrolledCount = 0;
     m_scrapedLineCount = scrapedLineCount;
     m_scrolledCount = 0;
     m_maxBufferedLine = -1;
     m_dirtyWindowTop = -1;
     m_dirtyLineCount = 0;
+    m_prevLineHashes.clear();
     m_terminal->reset(sendClear, m_scrapedLineCount);
 }
 
@@ -150,13 +169,8 @@ void Scraper::scanForDirtyLines(const SmallRect &windowRect)
 
     for (int line = m_dirtyLineCount; line < stopLine; ++line) {
         const CHAR_INFO *lineData = m_readBuffer.lineData(line);
-        for (int col = 0; col < w; ++col) {
-            const WORD colAttr = lineData[col].Attributes;
-            if (lineData[col].Char.UnicodeChar != L' ' ||
-                    colAttr != prevLineAttr) {
-                m_dirtyLineCount = line + 1;
-                break;
-            }
+        if (!isCellRangeBlank(lineData, w, prevLineAttr)) {
+            m_dirtyLineCount = line + 1;
         }
         prevLineAttr = lineData[w - 1].Attributes;
     }
@@ -172,9 +186,39 @@ void Scraper::clearBufferLines(
     for (int row = firstRow; row < firstRow + count; ++row) {
         const int64_t bufLine = row + m_scrolledCount;
         m_maxBufferedLine = std::max(m_maxBufferedLine, bufLine);
-        m_bufferData[bufLine % BUFFER_LINE_COUNT].blank(
-            Win32ConsoleBuffer::kDefaultAttributes);
+        bufferLine(bufLine).blank(ConsoleBuffer::kDefaultAttributes);
+    }
+}
+
+// Make room in m_bufferData for at least `count` lines, up to the console
+// buffer height.  A scrolling-mode scrape compares lines from the top of the
+// previous window (or the current one, if a resize moved it up) through the
+// last line sent, so the ring must span the tallest window it has seen plus
+// however far a resize can move the window up.
+void Scraper::reserveBufferLines(int count)
+{
+    const int64_t oldSize = m_bufferData.size();
+    const int64_t wanted = std::min(count, m_limits.bufferLineCount);
+    if (oldSize >= wanted) {
+        return;
+    }
+    const int64_t newSize = std::min<int64_t>(
+        std::max(wanted, oldSize * 2), m_limits.bufferLineCount);
+    std::vector<ConsoleLine> newData(newSize);
+    for (ConsoleLine &line : newData) {
+        line.setHashOnly(m_lineHashing);
+    }
+    if (m_directMode) {
+        std::move(m_bufferData.begin(), m_bufferData.end(), newData.begin());
+    } else {
+        // Lines keep their virtual line numbers, so each buffered line moves
+        // to its slot in the larger ring.
+        for (int64_t line = std::max<int64_t>(0, m_maxBufferedLine - oldSize + 1);
+                line <= m_maxBufferedLine; ++line) {
+            newData[line % newSize] = std::move(m_bufferData[line % oldSize]);
+        }
     }
+    m_bufferData.swap(newData);
 }
 
 static bool cursorInWindow(const ConsoleScreenBufferInfo &info)
@@ -205,19 +249,24 @@ void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
         const Coord origBufferSize = origInfo.bufferSize();
         const SmallRect origWindowRect = origInfo.windowRect();
 
+        reserveBufferLines(origWindowRect.height() + rows);
         if (m_directMode) {
             for (ConsoleLine &line : m_bufferData) {
                 line.reset();
             }
+            m_prevLineHashes.clear();
         } else {
             m_consoleBuffer->clearLines(0, origWindowRect.Top, origInfo);
-            clearBufferLines(0, origWindowRect.Top);
+            // Growing the window moves its top up by less than `rows` lines,
+            // so only those lines can be scraped again.
+            const int firstClearRow = std::max(0, origWindowRect.Top - rows);
+            clearBufferLines(firstClearRow, origWindowRect.Top - firstClearRow);
             if (m_syncRow != -1) {
                 createSyncMarker(std::min(
                     m_syncRow,
-                    BUFFER_LINE_COUNT - rows
-                                      - SYNC_MARKER_LEN
-                                      - SYNC_MARKER_MARGIN));
+                    m_limits.bufferLineCount - rows
+                                             - SYNC_MARKER_LEN
+                                             - SYNC_MARKER_MARGIN));
             }
         }
 
@@ -237,13 +286,12 @@ void Scraper::resizeImpl(const ConsoleScreenBufferInfo &origInfo)
         // Windows 10 (10240 build) if the console selection is in progress, so
         // unfreeze it first.
         m_console.setFrozen(false);
-        setSmallFont(m_consoleBuffer->conout(), cols, m_console.isNewW10());
+        m_consoleBuffer->setSmallFont(cols, m_console.isNewW10());
     }
 
     // We try to make the font small enough so that the entire screen buffer
     // fits on the monitor, but it can't be guaranteed.
-    const auto largest =
-        GetLargestConsoleWindowSize(m_consoleBuffer->conout());
+    const auto largest = m_consoleBuffer->largestWindowSize();
     const short visibleCols = std::min<short>(cols, largest.X);
     const short visibleRows = std::min<short>(rows, largest.Y);
 
@@ -329,22 +377,18 @@ void Scraper::syncConsoleContentAndSize(
     //  - Prior to Windows 10, an out-of-range read region crashes the caller.
     //    (See misc/WindowsBugCrashReader.cc.)
     //
+    const bool wasFrozen = m_console.frozen();
     if (!m_console.isNewW10() || forceResize) {
         m_console.setFrozen(true);
     }
 
     const ConsoleScreenBufferInfo info = m_consoleBuffer->bufferInfo();
-    bool cursorVisible = true;
-    CONSOLE_CURSOR_INFO cursorInfo = {};
-    if (!GetConsoleCursorInfo(GetStdHandle(STD_OUTPUT_HANDLE), &cursorInfo)) {
-        trace("GetConsoleCursorInfo failed");
-    } else {
-        cursorVisible = cursorInfo.bVisible != 0;
-    }
+    const bool cursorVisible = m_consoleBuffer->cursorVisible();
 
     // If an app resizes the buffer height, then we enter "direct mode", where
     // we stop trying to track incremental console changes.
-    const bool newDirectMode = (info.bufferSize().Y != BUFFER_LINE_COUNT);
+    const bool newDirectMode =
+        (info.bufferSize().Y != m_limits.bufferLineCount);
     if (newDirectMode != m_directMode) {
         trace("Entering %s mode", newDirectMode ? "direct" : "scrolling");
         resetConsoleTracking(Terminal::SendClear,
@@ -359,6 +403,12 @@ void Scraper::syncConsoleContentAndSize(
         }
     }
 
+    // A console program writing output blocks while the console is frozen,
+    // so unless the console must stay frozen for resizeImpl, unfreeze it as
+    // soon as the scrape has read everything it needs.  Comparing lines and
+    // encoding the terminal output happen afterward.
+    m_unfreezeAfterRead = !wasFrozen && (m_directMode || !forceResize);
+
     if (m_directMode) {
         // In direct-mode, resizing the console redraws the terminal, so do it
         // before scraping.
@@ -384,6 +434,17 @@ void Scraper::syncConsoleContentAndSize(
     }
 
     finalInfoOut = forceResize ? m_consoleBuffer->bufferInfo() : info;
+    m_unfreezeAfterRead = false;
+    m_console.setFrozen(wasFrozen);
+}
+
+// Called once a scrape has finished reading from (and writing to) the
+// console.
+void Scraper::endConsoleAccess()
+{
+    if (m_unfreezeAfterRead) {
+        m_console.setFrozen(false);
+    }
 }
 
 // Try to match Windows' behavior w.r.t. to the LVB attribute flags.  In some
@@ -401,17 +462,11 @@ WORD Scraper::attributesMask()
     const auto WINPTY_COMMON_LVB_REVERSE_VIDEO           = 0x4000u;
     const auto WINPTY_COMMON_LVB_UNDERSCORE              = 0x8000u;
 
-    const auto cp = GetConsoleOutputCP();
+    ASSERT(m_consoleBuffer != nullptr);
+    const auto cp = m_consoleBuffer->outputCodePage();
     const auto isCjk = (cp == 932 || cp == 936 || cp == 949 || cp == 950);
 
-    const DWORD outputMode = [this]{
-        ASSERT(this->m_consoleBuffer != nullptr);
-        DWORD mode = 0;
-        if (!GetConsoleMode(this->m_consoleBuffer->conout(), &mode)) {
-            mode = 0;
-        }
-        return mode;
-    }();
+    const DWORD outputMode = m_consoleBuffer->outputMode();
     const bool hasEnableLvbGridWorldwide =
         (outputMode & WINPTY_ENABLE_LVB_GRID_WORLDWIDE) != 0;
     const bool hasEnableVtProcessing =
@@ -439,9 +494,9 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
     const SmallRect scrapeRect(
         windowRect.left(), windowRect.top(),
         std::min<SHORT>(std::min(windowRect.width(), m_ptySize.X),
-                        MAX_CONSOLE_WIDTH),
+                        m_limits.maxWidth),
         std::min<SHORT>(std::min(windowRect.height(), m_ptySize.Y),
-                        BUFFER_LINE_COUNT));
+                        m_limits.bufferLineCount));
     const int w = scrapeRect.width();
     const int h = scrapeRect.height();
 
@@ -456,15 +511,24 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
     }
 
     largeConsoleRead(m_readBuffer, *m_consoleBuffer, scrapeRect, attributesMask());
+    endConsoleAccess();
+
+    reserveBufferLines(h);
+
+    if (m_scrollDetection) {
+        scrollDirectLines(scrapeRect);
+    }
 
     for (int line = 0; line < h; ++line) {
         const CHAR_INFO *const curLine =
             m_readBuffer.lineData(scrapeRect.top() + line);
         ConsoleLine &bufLine = m_bufferData[line];
-        if (bufLine.detectChangeAndSetLine(curLine, w)) {
+        if (bufLine.detectChangeAndSetLine(curLine, w, &m_previousLine)) {
+            agentStats().add(WINPTY_STAT_LINES_CHANGED, 1);
             const int lineCursorColumn =
                 line == cursorLine ? cursorColumn : -1;
-            m_terminal->sendLine(line, curLine, w, lineCursorColumn);
+            m_terminal->sendLine(line, curLine, w, lineCursorColumn,
+                                 previousLineData(w));
         }
     }
 
@@ -473,6 +537,135 @@ void Scraper::directScrapeOutput(const ConsoleScreenBufferInfo &info,
     }
 }
 
+// Full-screen programs like pagers and editors scroll all or part of the
+// window, which changes every line in the scrolled block.  Find the block of
+// lines that moved, by matching line hashes against the previous scrape, and
+// if scrolling it in the terminal saves enough lines from being resent,
+// scroll it and shift the line buffer to match what the terminal now shows.
+// The directScrapeOutput loop then sends the lines that still differ, such as
+// the ones the scroll exposed.
+void Scraper::scrollDirectLines(const SmallRect &scrapeRect)
+{
+    const int w = scrapeRect.width();
+    const int h = scrapeRect.height();
+
+    std::vector<uint64_t> &cur = m_lineHashes;
+    std::vector<uint64_t> &prev = m_prevLineHashes;
+    cur.resize(h);
+    for (int line = 0; line < h; ++line) {
+        cur[line] = cellRangeHash(
+            m_readBuffer.lineData(scrapeRect.top() + line), w);
+    }
+    const bool comparable =
+        prev.size() == static_cast<size_t>(h) && m_lineHashWidth == w;
+    if (!comparable || cur == prev) {
+        prev.swap(cur);
+        m_lineHashWidth = w;
+        return;
+    }
+
+    // Only a shift that moves a changed line back onto its old contents can
+    // save anything, so rather than trying every shift, try the shifts of the
+    // changed lines whose contents appear exactly once in the previous
+    // window.  (Blank and repeated lines don't say where they came from.)
+    std::vector<std::pair<uint64_t, int>> &sortedPrev = m_sortedPrevHashes;
+    sortedPrev.resize(h);
+    for (int line = 0; line < h; ++line) {
+        sortedPrev[line] = std::make_pair(prev[line], line);
+    }
+    std::sort(sortedPrev.begin(), sortedPrev.end());
+    std::vector<int> &shifts = m_candidateShifts;
+    shifts.clear();
+    for (int line = 0; line < h; ++line) {
+        if (cur[line] == prev[line]) {
+            continue;
+        }
+        const auto match = std::lower_bound(
+            sortedPrev.begin(), sortedPrev.end(),
+            std::make_pair(cur[line], 0));
+        if (match != sortedPrev.end() && match->first == cur[line] &&
+                (match + 1 == sortedPrev.end() ||
+                    (match + 1)->first != cur[line])) {
+            shifts.push_back(match->second - line);
+        }
+    }
+    std::sort(shifts.begin(), shifts.end());
+    shifts.erase(std::unique(shifts.begin(), shifts.end()), shifts.end());
+
+    // For each shift, look at each run of lines that moved by that shift.
+    // Scrolling the run saves sending its lines that changed in place, but
+    // costs resending the exposed lines that hadn't changed.  The escape
+    // sequences cost about as much as a short line, so require a net savings
+    // of two lines.  Each shift costs a pass over the window.
+    int bestSavings = 1;
+    int bestTop = 0;
+    int bestBottom = 0;
+    int bestCount = 0;
+    for (const int shift : shifts) {
+        const int first = std::max(0, -shift);
+        const int last = std::min(h, h - shift);
+        int runStart = -1;
+        int savings = 0;
+        for (int line = first; line <= last; ++line) {
+            if (line < last && cur[line] == prev[line + shift]) {
+                if (runStart == -1) {
+                    runStart = line;
+                    savings = 0;
+                }
+                if (cur[line] != prev[line]) {
+                    savings++;
+                }
+                continue;
+            }
+            if (runStart == -1) {
+                continue;
+            }
+            // A positive shift scrolls [runStart, line + shift) up, exposing
+            // rows at the bottom.  A negative shift scrolls
+            // [runStart + shift, line) down, exposing rows at the top.
+            const int top = shift > 0 ? runStart : runStart + shift;
+            const int bottom = shift > 0 ? line + shift - 1 : line - 1;
+            const int exposedTop = shift > 0 ? line : top;
+            for (int row = exposedTop;
+                    row < exposedTop + abs(shift) && savings > bestSavings;
+                    ++row) {
+                if (cur[row] == prev[row]) {
+                    savings--;
+                }
+            }
+            if (savings > bestSavings) {
+                bestSavings = savings;
+                bestTop = top;
+                bestBottom = bottom;
+                bestCount = shift;
+            }
+            runStart = -1;
+        }
+    }
+
+    prev.swap(cur);
+    m_lineHashWidth = w;
+
+    if (bestCount == 0 ||
+            !m_terminal->scrollRows(bestTop, bestBottom, bestCount)) {
+        return;
+    }
+
+    const auto regionBegin = m_bufferData.begin() + bestTop;
+    const auto regionEnd = m_bufferData.begin() + bestBottom + 1;
+    int exposedTop = 0;
+    if (bestCount > 0) {
+        std::rotate(regionBegin, regionBegin + bestCount, regionEnd);
+        exposedTop = bestBottom + 1 - bestCount;
+    } else {
+        std::rotate(regionBegin, regionEnd + bestCount, regionEnd);
+        exposedTop = bestTop;
+    }
+    for (int row = exposedTop; row < exposedTop + abs(bestCount); ++row) {
+        m_bufferData[row].blank(ConsoleBuffer::kDefaultAttributes);
+    }
+}
+
 bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                                     bool consoleCursorVisible,
                                     bool tentative)
@@ -480,10 +673,26 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     const Coord cursor = info.cursorPosition();
     const SmallRect windowRect = info.windowRect();
 
-    if (m_syncRow != -1) {
+    // Each line of output since the last completed scrape either moved the
+    // cursor down or scrolled the buffer up.  Expect the usual number of
+    // lines, less the ones the cursor's movement accounts for, to have
+    // scrolled.  If a tentative scrape bailed out after finding the marker,
+    // the marker has already been moved that far.
+    const int cursorMove = m_lastCursorRow == -1
+        ? 0 : std::max(0, cursor.Y - m_lastCursorRow);
+    const bool lookForSyncMarker = m_syncRow != -1;
+    bool syncMarkerPredicted = false;
+    bool syncMarkerFound = false;
+
+    if (lookForSyncMarker) {
         // If a synchronizing marker was placed into the history, look for it
         // and adjust the scroll count.
-        const int markerRow = findSyncMarker();
+        const int alreadyScrolled =
+            static_cast<int>(m_scrolledCount - m_lastScrolledCount);
+        const int markerRow = findSyncMarker(
+            std::max(0, m_outputLineRate - cursorMove - alreadyScrolled),
+            syncMarkerPredicted);
+        syncMarkerFound = markerRow != -1;
         if (markerRow == -1) {
             if (tentative) {
                 // I *think* it's possible to keep going, but it's simple to
@@ -557,6 +766,11 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     // bottom of the window.  (It's not clear to me whether the
     // m_dirtyLineCount adjustment here is strictly necessary.  It isn't
     // necessary so long as the cursor is inside the current window.)
+    //
+    // The last scrape covered up to the old window top, so the read reaches
+    // above the current window only by the number of lines the sync marker
+    // (or the window) has moved since then.  A scrape of a console that
+    // hasn't scrolled reads just the window and the row above it.
     const int firstReadLine = std::min<int>(firstVirtLine - m_scrolledCount,
                                             m_dirtyLineCount - 1);
     const int stopReadLine = std::max(windowRect.top() + windowRect.height(),
@@ -566,7 +780,7 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                      *m_consoleBuffer,
                      SmallRect(0, firstReadLine,
                                std::min<SHORT>(info.bufferSize().X,
-                                               MAX_CONSOLE_WIDTH),
+                                               m_limits.maxWidth),
                                stopReadLine - firstReadLine),
                      attributesMask());
 
@@ -582,11 +796,29 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                 info.cursorPosition() != infoCheck.cursorPosition()) {
             return false;
         }
-        if (m_syncRow != -1 && m_syncRow != findSyncMarker()) {
+        if (m_syncRow != -1 && !syncMarkerUnmoved()) {
             return false;
         }
     }
 
+    // The scrape can no longer bail out, so record this scrape's sync marker
+    // lookup and output rate.  A tentative scrape that bailed out records
+    // nothing; the frozen retry counts the lines it found scrolled.
+    if (lookForSyncMarker) {
+        agentStats().add(syncMarkerPredicted
+                             ? WINPTY_STAT_SYNC_MARKER_HITS
+                             : WINPTY_STAT_SYNC_MARKER_MISSES,
+                         1);
+    }
+    if (syncMarkerFound) {
+        const int scrolled =
+            static_cast<int>(m_scrolledCount - m_lastScrolledCount);
+        m_outputLineRate = std::max(scrolled + cursorMove,
+                                    m_outputLineRate / 2);
+    }
+    m_lastCursorRow = cursor.Y;
+    m_lastScrolledCount = m_scrolledCount;
+
     if (shouldCreateSyncRow) {
         ASSERT(!tentative);
         createSyncMarker(newSyncRow);
@@ -595,6 +827,7 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
     // At this point, we're finished interacting (reading or writing) the
     // console, and we just need to convert our collected data into terminal
     // output.
+    endConsoleAccess();
 
     scanForDirtyLines(windowRect);
 
@@ -617,24 +850,39 @@ bool Scraper::scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
 
     bool sawModifiedLine = false;
 
+    reserveBufferLines(windowRect.height() * 2);
+
     const int w = m_readBuffer.rect().width();
     for (int64_t line = firstVirtLine; line < stopVirtLine; ++line) {
         const CHAR_INFO *curLine =
             m_readBuffer.lineData(line - m_scrolledCount);
-        ConsoleLine &bufLine = m_bufferData[line % BUFFER_LINE_COUNT];
+        ConsoleLine &bufLine = bufferLine(line);
+        // A line past m_maxBufferedLine hasn't been output yet, so its
+        // ConsoleLine holds an unrelated (older) line.  Discard that line,
+        // including any stale cells past its end.
+        std::vector<CHAR_INFO> *previous = &m_previousLine;
         if (line > m_maxBufferedLine) {
             m_maxBufferedLine = line;
             sawModifiedLine = true;
+            bufLine.reset();
+            previous = nullptr;
+            m_previousLine.clear();
+            agentStats().add(WINPTY_STAT_LINES_CHANGED, 1);
         }
         if (sawModifiedLine) {
-            bufLine.setLine(curLine, w);
+            bufLine.setLine(curLine, w, previous);
         } else {
-            sawModifiedLine = bufLine.detectChangeAndSetLine(curLine, w);
+            sawModifiedLine =
+                bufLine.detectChangeAndSetLine(curLine, w, previous);
+            if (sawModifiedLine) {
+                agentStats().add(WINPTY_STAT_LINES_CHANGED, 1);
+            }
         }
         if (sawModifiedLine) {
             const int lineCursorColumn =
                 line == cursorLine ? cursorColumn : -1;
-            m_terminal->sendLine(line, curLine, w, lineCursorColumn);
+            m_terminal->sendLine(line, curLine, w, lineCursorColumn,
+                                 previousLineData(w));
         }
     }
 
@@ -659,27 +907,71 @@ void Scraper::syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN])
     }
 }
 
-int Scraper::findSyncMarker()
+static bool isSyncMarkerAt(const CHAR_INFO *column,
+                           const CHAR_INFO (&marker)[SYNC_MARKER_LEN])
+{
+    for (int j = 0; j < SYNC_MARKER_LEN; ++j) {
+        if (column[j].Char.UnicodeChar != marker[j].Char.UnicodeChar)
+            return false;
+    }
+    return true;
+}
+
+// Returns the marker's row, or -1.  Sets `predictedOut` if the marker was
+// within the rows read first.
+int Scraper::findSyncMarker(int expectedMove, bool &predictedOut)
 {
     ASSERT(m_syncRow >= 0);
     CHAR_INFO marker[SYNC_MARKER_LEN];
-    CHAR_INFO column[BUFFER_LINE_COUNT];
     syncMarkerText(marker);
-    SmallRect rect(0, 0, 1, m_syncRow + SYNC_MARKER_LEN);
-    m_consoleBuffer->read(rect, column);
-    int i;
-    for (i = m_syncRow; i >= 0; --i) {
-        int j;
-        for (j = 0; j < SYNC_MARKER_LEN; ++j) {
-            if (column[i + j].Char.UnicodeChar != marker[j].Char.UnicodeChar)
-                break;
-        }
-        if (j == SYNC_MARKER_LEN)
+    m_syncColumn.resize(m_syncRow + SYNC_MARKER_LEN);
+    CHAR_INFO *const column = m_syncColumn.data();
+
+    // The marker only moves up, by the number of lines the console buffer
+    // has scrolled since the last scrape.  First read just the rows the
+    // marker would reach if the buffer scrolled up to twice `expectedMove`.
+    // On a miss, read the rest of the column above it in growing chunks.
+    // Either way, the rows are searched in the same order as a single read
+    // of the whole column would be.
+    int top = std::max(0, m_syncRow - 2 * expectedMove);
+    m_consoleBuffer->read(
+        SmallRect(0, top, 1, m_syncRow + SYNC_MARKER_LEN - top),
+        &column[top]);
+    for (int i = m_syncRow; i >= top; --i) {
+        if (isSyncMarkerAt(&column[i], marker)) {
+            predictedOut = true;
             return i;
+        }
+    }
+    predictedOut = false;
+    int chunk = 64;
+    while (top > 0) {
+        const int newTop = std::max(0, top - chunk);
+        m_consoleBuffer->read(SmallRect(0, newTop, 1, top - newTop),
+                              &column[newTop]);
+        for (int i = top - 1; i >= newTop; --i) {
+            if (isSyncMarkerAt(&column[i], marker))
+                return i;
+        }
+        top = newTop;
+        chunk *= 2;
     }
     return -1;
 }
 
+// Whether the marker is still at m_syncRow, i.e. the console hasn't
+// scrolled since findSyncMarker found it.
+bool Scraper::syncMarkerUnmoved()
+{
+    ASSERT(m_syncRow >= 0);
+    CHAR_INFO marker[SYNC_MARKER_LEN];
+    syncMarkerText(marker);
+    CHAR_INFO column[SYNC_MARKER_LEN];
+    m_consoleBuffer->read(SmallRect(0, m_syncRow, 1, SYNC_MARKER_LEN),
+                          column);
+    return isSyncMarkerAt(column, marker);
+}
+
 void Scraper::createSyncMarker(int row)
 {
     ASSERT(row >= 1);
@@ -21,46 +21,44 @@
 #ifndef AGENT_SCRAPER_H
 #define AGENT_SCRAPER_H
 
-#include <windows.h>
-
 #include <stdint.h>
 
 #include <memory>
+#include <utility>
 #include <vector>
 
+#include "ConsoleLimits.h"
 #include "ConsoleLine.h"
+#include "ConsoleTypes.h"
 #include "Coord.h"
 #include "LargeConsoleRead.h"
 #include "SmallRect.h"
 #include "Terminal.h"
 
+class ConsoleBuffer;
+class ConsoleControl;
 class ConsoleScreenBufferInfo;
-class Win32Console;
-class Win32ConsoleBuffer;
 
-// We must be able to issue a single ReadConsoleOutputW call of
-// MAX_CONSOLE_WIDTH characters, and a single read of approximately several
-// hundred fewer characters than BUFFER_LINE_COUNT.
-const int BUFFER_LINE_COUNT = 3000;
-const int MAX_CONSOLE_WIDTH = 2500;
-const int MAX_CONSOLE_HEIGHT = 2000;
 const int SYNC_MARKER_LEN = 16;
 const int SYNC_MARKER_MARGIN = 200;
 
 class Scraper {
 public:
     Scraper(
-        Win32Console &console,
-        Win32ConsoleBuffer &buffer,
+        ConsoleControl &console,
+        ConsoleBuffer &buffer,
         std::unique_ptr<Terminal> terminal,
-        Coord initialSize);
+        Coord initialSize,
+        const ConsoleLimits &limits=ConsoleLimits());
     ~Scraper();
-    void resizeWindow(Win32ConsoleBuffer &buffer,
+    void resizeWindow(ConsoleBuffer &buffer,
                       Coord newSize,
                       ConsoleScreenBufferInfo &finalInfoOut);
-    void scrapeBuffer(Win32ConsoleBuffer &buffer,
+    void scrapeBuffer(ConsoleBuffer &buffer,
                       ConsoleScreenBufferInfo &finalInfoOut);
     Terminal &terminal() { return *m_terminal; }
+    void setLineHashing(bool enabled);
+    void setScrollDetection(bool enabled) { m_scrollDetection = enabled; }
 
 private:
     void resetConsoleTracking(
@@ -68,34 +66,71 @@ private:
     void markEntireWindowDirty(const SmallRect &windowRect);
     void scanForDirtyLines(const SmallRect &windowRect);
     void clearBufferLines(int firstRow, int count);
+    void reserveBufferLines(int count);
+    ConsoleLine &bufferLine(int64_t line) {
+        return m_bufferData[line % m_bufferData.size()];
+    }
     void resizeImpl(const ConsoleScreenBufferInfo &origInfo);
     void syncConsoleContentAndSize(bool forceResize,
                                    ConsoleScreenBufferInfo &finalInfoOut);
+    void endConsoleAccess();
     WORD attributesMask();
     void directScrapeOutput(const ConsoleScreenBufferInfo &info,
                             bool consoleCursorVisible);
+    void scrollDirectLines(const SmallRect &scrapeRect);
     bool scrollingScrapeOutput(const ConsoleScreenBufferInfo &info,
                                bool consoleCursorVisible,
                                bool tentative);
     void syncMarkerText(CHAR_INFO (&output)[SYNC_MARKER_LEN]);
-    int findSyncMarker();
+    int findSyncMarker(int expectedMove, bool &predictedOut);
+    bool syncMarkerUnmoved();
     void createSyncMarker(int row);
 
+    // The cells the line being output held before it changed, which the
+    // terminal still shows, or NULL if they're unknown.
+    const CHAR_INFO *previousLineData(int width) const {
+        return m_previousLine.size() == static_cast<size_t>(width)
+            ? m_previousLine.data() : nullptr;
+    }
+
 private:
-    Win32Console &m_console;
-    Win32ConsoleBuffer *m_consoleBuffer = nullptr;
+    ConsoleControl &m_console;
+    const ConsoleLimits m_limits;
+    ConsoleBuffer *m_consoleBuffer = nullptr;
     std::unique_ptr<Terminal> m_terminal;
 
     int m_syncRow = -1;
+    // About how many lines of output each scrape sees: the most recent
+    // count of lines the sync marker moved up plus lines the cursor moved
+    // down, or half the previous estimate if that is larger.
+    int m_outputLineRate = 0;
+    // The cursor's row and m_scrolledCount as of the last scrolling-mode
+    // scrape that completed (rather than bailing out to be redone frozen).
+    int m_lastCursorRow = -1;
+    int64_t m_lastScrolledCount = 0;
     unsigned int m_syncCounter = 0;
 
     bool m_directMode = false;
+    bool m_unfreezeAfterRead = false;
     Coord m_ptySize;
     int64_t m_scrapedLineCount = 0;
     int64_t m_scrolledCount = 0;
     int64_t m_maxBufferedLine = -1;
     LargeConsoleReadBuffer m_readBuffer;
+    // In scrolling mode, a ring of the lines most recently sent to the
+    // terminal, indexed by virtual line number (see bufferLine).  In direct
+    // mode, the window's lines, indexed by row.  It starts out large enough
+    // for the window and grows with it, up to the console buffer height.
     std::vector<ConsoleLine> m_bufferData;
+    bool m_lineHashing = false;
+    std::vector<CHAR_INFO> m_syncColumn;
+    std::vector<CHAR_INFO> m_previousLine;
+    bool m_scrollDetection = true;
+    int m_lineHashWidth = 0;
+    std::vector<uint64_t> m_lineHashes;
+    std::vector<uint64_t> m_prevLineHashes;
+    std::vector<std::pair<uint64_t, int>> m_sortedPrevHashes;
+    std::vector<int> m_candidateShifts;
     int m_dirtyWindowTop = -1;
     int m_dirtyLineCount = 0;
 };
@@ -0,0 +1,294 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include "SimConsoleBuffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../shared/DebugClient.h"
+#include "../shared/WinptyAssert.h"
+
+namespace {
+
+const int WINPTY_COMMON_LVB_LEADING_BYTE  = 0x100;
+const int WINPTY_COMMON_LVB_TRAILING_BYTE = 0x200;
+const int WINPTY_DISABLE_NEWLINE_AUTO_RETURN = 0x8;
+
+CHAR_INFO blankCell(WORD attributes) {
+    CHAR_INFO ret;
+    ret.Char.UnicodeChar = L' ';
+    ret.Attributes = attributes;
+    return ret;
+}
+
+// A rough approximation of the characters a CJK console renders with two
+// cells.  It is good enough to exercise the Scraper's full-width handling.
+bool isWideChar(wchar_t ch) {
+    return (ch >= 0x1100 && ch <= 0x115F) ||
+           (ch >= 0x2E80 && ch <= 0xA4CF && ch != 0x303F) ||
+           (ch >= 0xAC00 && ch <= 0xD7A3) ||
+           (ch >= 0xF900 && ch <= 0xFAFF) ||
+           (ch >= 0xFE30 && ch <= 0xFE4F) ||
+           (ch >= 0xFF00 && ch <= 0xFF60) ||
+           (ch >= 0xFFE0 && ch <= 0xFFE6);
+}
+
+} // anonymous namespace
+
+SimConsoleBuffer::SimConsoleBuffer(Coord bufferSize, Coord windowSize) :
+    m_size(bufferSize),
+    m_window(0, 0, windowSize.X, windowSize.Y),
+    m_largestWindow(0x7FFF, 0x7FFF),
+    m_cells(bufferSize.X * bufferSize.Y, blankCell(kDefaultAttributes))
+{
+    ASSERT(windowSize.X >= 1 && windowSize.Y >= 1 &&
+           windowSize.X <= bufferSize.X && windowSize.Y <= bufferSize.Y);
+}
+
+void SimConsoleBuffer::blankLines(int top, int count, WORD attributes) {
+    ASSERT(top >= 0 && count >= 0 && top + count <= m_size.Y);
+    for (int y = top; y < top + count; ++y) {
+        std::fill(row(y), row(y) + m_size.X, blankCell(attributes));
+    }
+}
+
+void SimConsoleBuffer::clearLines(
+        int row,
+        int count,
+        const ConsoleScreenBufferInfo &info) {
+    const int start = std::max(0, row);
+    const int end = std::min<int>(m_size.Y, row + count);
+    if (start < end) {
+        blankLines(start, end - start, kDefaultAttributes);
+    }
+}
+
+ConsoleScreenBufferInfo SimConsoleBuffer::bufferInfo() {
+    ConsoleScreenBufferInfo info;
+    info.dwSize = m_size;
+    info.dwCursorPosition = m_cursor;
+    info.wAttributes = m_attributes;
+    info.srWindow = m_window;
+    info.dwMaximumWindowSize = Coord(
+        std::min(m_size.X, m_largestWindow.X),
+        std::min(m_size.Y, m_largestWindow.Y));
+    return info;
+}
+
+bool SimConsoleBuffer::resizeBufferRange(const Coord &initialSize,
+                                         Coord &finalSize) {
+    // Like SetConsoleScreenBufferSize, refuse to make the buffer smaller than
+    // the window.  Existing content stays anchored at the top-left.
+    const Coord size = initialSize;
+    if (size.X < m_window.width() || size.Y < m_window.height() ||
+            m_window.Right >= size.X || m_window.Bottom >= size.Y) {
+        trace("SimConsoleBuffer: resize to (%d,%d) failed: window is %s",
+              size.X, size.Y, m_window.toString().c_str());
+        return false;
+    }
+    std::vector<CHAR_INFO> cells(size.X * size.Y, blankCell(m_attributes));
+    const int copyWidth = std::min(m_size.X, size.X);
+    const int copyHeight = std::min(m_size.Y, size.Y);
+    for (int y = 0; y < copyHeight; ++y) {
+        std::copy(row(y), row(y) + copyWidth, &cells[y * size.X]);
+    }
+    m_cells.swap(cells);
+    m_firstRow = 0;
+    m_size = size;
+    m_cursor.X = std::min<SHORT>(m_cursor.X, m_size.X - 1);
+    m_cursor.Y = std::min<SHORT>(m_cursor.Y, m_size.Y - 1);
+    finalSize = size;
+    return true;
+}
+
+void SimConsoleBuffer::resizeBuffer(const Coord &size) {
+    resizeBufferRange(size);
+}
+
+void SimConsoleBuffer::moveWindow(const SmallRect &rect) {
+    if (rect.Left < 0 || rect.Top < 0 ||
+            rect.Right < rect.Left || rect.Bottom < rect.Top ||
+            rect.Right >= m_size.X || rect.Bottom >= m_size.Y ||
+            rect.width() > m_largestWindow.X ||
+            rect.height() > m_largestWindow.Y) {
+        trace("SimConsoleBuffer: moveWindow to %s failed",
+              rect.toString().c_str());
+        return;
+    }
+    m_window = rect;
+}
+
+void SimConsoleBuffer::setCursorPosition(const Coord &point) {
+    if (point.X < 0 || point.Y < 0 ||
+            point.X >= m_size.X || point.Y >= m_size.Y) {
+        trace("SimConsoleBuffer: setCursorPosition to (%d,%d) failed",
+              point.X, point.Y);
+        return;
+    }
+    m_cursor = point;
+    scrollWindowToCursor();
+}
+
+void SimConsoleBuffer::read(const SmallRect &rect, CHAR_INFO *data) {
+    const int width = rect.width();
+    for (int y = rect.Top; y <= rect.Bottom; ++y) {
+        for (int x = rect.Left; x <= rect.Right; ++x) {
+            CHAR_INFO &out = data[(y - rect.Top) * width + (x - rect.Left)];
+            if (x >= 0 && y >= 0 && x < m_size.X && y < m_size.Y) {
+                out = cell(x, y);
+            } else {
+                out = blankCell(kDefaultAttributes);
+            }
+        }
+    }
+}
+
+void SimConsoleBuffer::write(const SmallRect &rect, const CHAR_INFO *data) {
+    const int width = rect.width();
+    for (int y = std::max<int>(rect.Top, 0);
+            y <= rect.Bottom && y < m_size.Y; ++y) {
+        for (int x = std::max<int>(rect.Left, 0);
+                x <= rect.Right && x < m_size.X; ++x) {
+            cell(x, y) = data[(y - rect.Top) * width + (x - rect.Left)];
+        }
+    }
+}
+
+// The console scrolls the window just enough to keep the cursor visible.
+void SimConsoleBuffer::scrollWindowToCursor() {
+    if (!m_window.contains(m_cursor)) {
+        m_window = m_window.ensureLineIncluded(m_cursor.Y);
+        if (m_cursor.X < m_window.Left) {
+            m_window.Right -= m_window.Left - m_cursor.X;
+            m_window.Left = m_cursor.X;
+        } else if (m_cursor.X > m_window.Right) {
+            m_window.Left += m_cursor.X - m_window.Right;
+            m_window.Right = m_cursor.X;
+        }
+    }
+}
+
+// Move the cursor down a line.  At the bottom of the buffer, the oldest line
+// is discarded and everything else moves up.
+void SimConsoleBuffer::lineFeed() {
+    if (m_cursor.Y + 1 < m_size.Y) {
+        ++m_cursor.Y;
+    } else {
+        m_firstRow = (m_firstRow + 1) % m_size.Y;
+        blankLines(m_size.Y - 1, 1, m_attributes);
+    }
+}
+
+// A full-width character occupies two cells holding the same character,
+// flagged as the leading and trailing halves.
+void SimConsoleBuffer::setCells(int x, int y, wchar_t ch, int width,
+                                WORD attributes) {
+    if (width == 2) {
+        cell(x, y).Char.UnicodeChar = ch;
+        cell(x, y).Attributes = attributes | WINPTY_COMMON_LVB_LEADING_BYTE;
+        cell(x + 1, y).Char.UnicodeChar = ch;
+        cell(x + 1, y).Attributes =
+            attributes | WINPTY_COMMON_LVB_TRAILING_BYTE;
+    } else {
+        cell(x, y).Char.UnicodeChar = ch;
+        cell(x, y).Attributes = attributes;
+    }
+}
+
+void SimConsoleBuffer::putChar(wchar_t ch, int width) {
+    const bool wrap = (m_outputMode & ENABLE_WRAP_AT_EOL_OUTPUT) != 0;
+    if (width == 2 && m_cursor.X == m_size.X - 1) {
+        if (!wrap) {
+            return;
+        }
+        // A full-width character never straddles two lines.
+        cell(m_cursor.X, m_cursor.Y) = blankCell(m_attributes);
+        m_cursor.X = 0;
+        lineFeed();
+    }
+    setCells(m_cursor.X, m_cursor.Y, ch, width, m_attributes);
+    m_cursor.X += width;
+    if (m_cursor.X >= m_size.X) {
+        if (wrap) {
+            m_cursor.X = 0;
+            lineFeed();
+        } else {
+            m_cursor.X = m_size.X - 1;
+        }
+    }
+}
+
+// Emulate WriteConsoleW.  With ENABLE_PROCESSED_OUTPUT, the usual control
+// characters move the cursor instead of being written into the buffer.
+void SimConsoleBuffer::writeText(const wchar_t *text, size_t len) {
+    const bool processed = (m_outputMode & ENABLE_PROCESSED_OUTPUT) != 0;
+    const bool autoReturn =
+        (m_outputMode & WINPTY_DISABLE_NEWLINE_AUTO_RETURN) == 0;
+    for (size_t i = 0; i < len; ++i) {
+        const wchar_t ch = text[i];
+        if (processed && ch < 0x20) {
+            switch (ch) {
+                case L'\r':
+                    m_cursor.X = 0;
+                    continue;
+                case L'\n':
+                    if (autoReturn) {
+                        m_cursor.X = 0;
+                    }
+                    lineFeed();
+                    continue;
+                case L'\b':
+                    if (m_cursor.X > 0) {
+                        --m_cursor.X;
+                    }
+                    continue;
+                case L'\t':
+                    do {
+                        putChar(L' ', 1);
+                    } while (m_cursor.X % 8 != 0);
+                    continue;
+                case L'\a':
+                    continue;
+            }
+        }
+        putChar(ch, isWideChar(ch) && m_size.X >= 2 ? 2 : 1);
+    }
+    scrollWindowToCursor();
+}
+
+// Emulate WriteConsoleOutputCharacterW followed by
+// FillConsoleOutputAttribute: the text is written starting at `pos` and the
+// cursor does not move.  The text is clipped at the end of the line.
+void SimConsoleBuffer::writeCells(Coord pos, const std::wstring &text,
+                                  WORD attributes) {
+    ASSERT(pos.X >= 0 && pos.Y >= 0 && pos.X < m_size.X && pos.Y < m_size.Y);
+    int x = pos.X;
+    for (wchar_t ch : text) {
+        const bool wide = isWideChar(ch);
+        if (x + (wide ? 2 : 1) > m_size.X) {
+            break;
+        }
+        setCells(x, pos.Y, ch, wide ? 2 : 1, attributes);
+        x += wide ? 2 : 1;
+    }
+}
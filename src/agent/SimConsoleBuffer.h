@@ -0,0 +1,122 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#ifndef AGENT_SIM_CONSOLE_BUFFER_H
+#define AGENT_SIM_CONSOLE_BUFFER_H
+
+#include <string>
+#include <vector>
+
+#include "ConsoleBuffer.h"
+#include "ConsoleControl.h"
+#include "ConsoleTypes.h"
+#include "Coord.h"
+#include "SmallRect.h"
+
+// An in-memory console screen buffer.  It models the parts of a Windows
+// console that the Scraper observes: a scrollback buffer, a window into that
+// buffer, a cursor, and the way WriteConsoleW output wraps, scrolls the
+// buffer, and drags the window along with the cursor.  It uses the pre-Windows
+// 10 resize semantics (no reflow), and every operation succeeds as long as the
+// window fits in the buffer.
+//
+// Scripted workloads use the writeText/writeCells helpers to play the part of
+// a console application.
+class SimConsoleBuffer : public ConsoleBuffer {
+public:
+    SimConsoleBuffer(Coord bufferSize, Coord windowSize);
+
+    // ConsoleBuffer implementation.
+    virtual void clearLines(int row, int count,
+                            const ConsoleScreenBufferInfo &info) override;
+    virtual ConsoleScreenBufferInfo bufferInfo() override;
+    virtual void resizeBuffer(const Coord &size) override;
+    using ConsoleBuffer::resizeBufferRange;
+    virtual bool resizeBufferRange(const Coord &initialSize,
+                                   Coord &finalSize) override;
+    virtual void moveWindow(const SmallRect &rect) override;
+    virtual Coord largestWindowSize() override { return m_largestWindow; }
+    virtual void setSmallFont(int columns, bool isNewW10) override {}
+    virtual void setCursorPosition(const Coord &point) override;
+    virtual bool cursorVisible() override { return m_cursorVisible; }
+    virtual void read(const SmallRect &rect, CHAR_INFO *data) override;
+    virtual void write(const SmallRect &rect, const CHAR_INFO *data) override;
+    virtual bool largeReadsAllowed() override { return true; }
+    virtual void setTextAttribute(WORD attributes) override {
+        m_attributes = attributes;
+    }
+    virtual DWORD outputMode() override { return m_outputMode; }
+    virtual UINT outputCodePage() override { return m_codePage; }
+
+    // Simulated console application.
+    void writeText(const wchar_t *text, size_t len);
+    void writeText(const std::wstring &text) {
+        writeText(text.data(), text.size());
+    }
+    void writeCells(Coord pos, const std::wstring &text, WORD attributes);
+    void setCursorVisible(bool visible) { m_cursorVisible = visible; }
+    void setOutputMode(DWORD mode) { m_outputMode = mode; }
+    void setOutputCodePage(UINT codePage) { m_codePage = codePage; }
+    void setLargestWindowSize(Coord size) { m_largestWindow = size; }
+    WORD textAttribute() const { return m_attributes; }
+
+private:
+    // The buffer's rows are stored in a ring, so that scrolling the whole
+    // buffer is cheap.
+    CHAR_INFO *row(int y) {
+        return &m_cells[((m_firstRow + y) % m_size.Y) * m_size.X];
+    }
+    CHAR_INFO &cell(int x, int y) { return row(y)[x]; }
+    void blankLines(int top, int count, WORD attributes);
+    void setCells(int x, int y, wchar_t ch, int width, WORD attributes);
+    void putChar(wchar_t ch, int width);
+    void lineFeed();
+    void scrollWindowToCursor();
+
+    Coord m_size;
+    SmallRect m_window;
+    Coord m_cursor;
+    Coord m_largestWindow;
+    WORD m_attributes = kDefaultAttributes;
+    bool m_cursorVisible = true;
+    DWORD m_outputMode = ENABLE_PROCESSED_OUTPUT | ENABLE_WRAP_AT_EOL_OUTPUT;
+    UINT m_codePage = 437;
+    int m_firstRow = 0;
+    std::vector<CHAR_INFO> m_cells;
+};
+
+// The ConsoleControl to scrape a SimConsoleBuffer with.  There is nothing to
+// freeze, so it only records the frozen state that the Scraper asserts.  It
+// reports the Windows 10 console by default, so the Scraper freezes only
+// when it must.
+class SimConsoleControl : public ConsoleControl {
+public:
+    explicit SimConsoleControl(bool isNewW10=true) : m_isNewW10(isNewW10) {}
+    virtual bool isNewW10() override { return m_isNewW10; }
+    virtual void setFrozen(bool frozen=true) override { m_frozen = frozen; }
+    virtual bool frozen() override { return m_frozen; }
+
+private:
+    bool m_isNewW10;
+    bool m_frozen = false;
+};
+
+#endif // AGENT_SIM_CONSOLE_BUFFER_H
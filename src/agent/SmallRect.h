@@ -21,12 +21,11 @@
 #ifndef SMALLRECT_H
 #define SMALLRECT_H
 
-#include <windows.h>
-
 #include <algorithm>
 #include <string>
 
 #include "../shared/winpty_snprintf.h"
+#include "ConsoleTypes.h"
 #include "Coord.h"
 
 struct SmallRect : SMALL_RECT
@@ -20,14 +20,18 @@
 
 #include "Terminal.h"
 
-#include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <string>
 
-#include "NamedPipe.h"
+#include "AgentStats.h"
+#include "CellScan.h"
+#include "TerminalOutput.h"
 #include "UnicodeEncoding.h"
+#include "../include/winpty_constants.h"
 #include "../shared/DebugClient.h"
 #include "../shared/WinptyAssert.h"
 #include "../shared/winpty_snprintf.h"
@@ -53,6 +57,10 @@ const int COLOR_ATTRIBUTE_MASK =
         WINPTY_COMMON_LVB_REVERSE_VIDEO |
         WINPTY_COMMON_LVB_UNDERSCORE;
 
+// The console color that outputSetColor renders as a bare SGR 0, i.e. the
+// terminal's state after an SGR reset.
+const int SGR_RESET_COLOR = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+
 const int FLAG_RED    = 1;
 const int FLAG_GREEN  = 2;
 const int FLAG_BLUE   = 4;
@@ -66,8 +74,10 @@ const int WHITE  = LTGRAY | FLAG_BRIGHT;
 // SGR parameters (Select Graphic Rendition)
 const int SGR_FORE = 30;
 const int SGR_FORE_HI = 90;
+const int SGR_FORE_DEFAULT = 39;
 const int SGR_BACK = 40;
 const int SGR_BACK_HI = 100;
+const int SGR_BACK_DEFAULT = 49;
 
 namespace {
 
@@ -83,9 +93,41 @@ static void outUInt(std::string &out, unsigned int n)
     out.append(pbuf);
 }
 
-static void outputSetColorSgrParams(std::string &out, bool isFore, int color)
+// Binary frames: the magic byte, the version, and the payload size.
+const size_t FRAME_HEADER_SIZE = 6;
+
+static void outVarint(std::string &out, uint64_t n)
+{
+    while (n >= 0x80) {
+        out.push_back(static_cast<char>((n & 0x7F) | 0x80));
+        n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+}
+
+// The SGR parameters that select one terminal color: a 3X/4X (or 39/49
+// default) parameter, optionally followed by a 9X/10X parameter.
+struct SgrColor {
+    int base;
+    int hi;
+    bool operator==(const SgrColor &o) const {
+        return base == o.base && hi == o.hi;
+    }
+};
+
+// The terminal's SGR state, as far as outputSetColor uses it.  The
+// default-constructed state is the one after an SGR reset.
+struct SgrState {
+    SgrColor fore = { SGR_FORE_DEFAULT, 0 };
+    SgrColor back = { SGR_BACK_DEFAULT, 0 };
+    bool bold = false;
+    bool reverse = false;
+    bool conceal = false;
+    bool underline = false;
+};
+
+static SgrColor sgrColor(bool isFore, int color)
 {
-    out.push_back(';');
     const int sgrBase = isFore ? SGR_FORE : SGR_BACK;
     if (color & FLAG_BRIGHT) {
         // Some terminals don't support the 9X/10X "intensive" color parameters
@@ -94,15 +136,14 @@ static void outputSetColorSgrParams(std::string &out, bool isFore, int color)
         // ignore a 3X/4X code if it's followed by a 9X/10X code.  Therefore,
         // output a 3X/4X code as a fallback, then override it.
         const int colorBase = color & ~FLAG_BRIGHT;
-        outUInt(out, sgrBase + colorBase);
-        out.push_back(';');
-        outUInt(out, sgrBase + (SGR_FORE_HI - SGR_FORE) + colorBase);
+        return { sgrBase + colorBase,
+                 sgrBase + (SGR_FORE_HI - SGR_FORE) + colorBase };
     } else {
-        outUInt(out, sgrBase + color);
+        return { sgrBase + color, 0 };
     }
 }
 
-static void outputSetColor(std::string &out, int color)
+static SgrState sgrStateForColor(int color)
 {
     int fore = 0;
     int back = 0;
@@ -158,7 +199,7 @@ static void outputSetColor(std::string &out, int color)
     //  (B) DkGray => DkGray
     //
 
-    out.append(CSI "0");
+    SgrState ret;
     if (back == BLACK) {
         if (fore == LTGRAY) {
             // The "default" foreground color.  Use the terminal's
@@ -168,15 +209,15 @@ static void outputSetColor(std::string &out, int color)
             // the terminal were black-on-white.  Sending Bold is not
             // guaranteed to alter the color, but it will make the text
             // visually distinct, so do that instead.
-            out.append(";1");
+            ret.bold = true;
         } else if (fore == DKGRAY) {
             // Set the foreground color to DkGray(90) with a fallback
             // of LtGray(37) for terminals that don't handle the 9X SGR
             // parameters (e.g. Eclipse's TM Terminal as of this
             // writing).
-            out.append(";37;90");
+            ret.fore = { SGR_FORE + LTGRAY, SGR_FORE_HI + BLACK };
         } else {
-            outputSetColorSgrParams(out, true, fore);
+            ret.fore = sgrColor(true, fore);
         }
     } else if (back == WHITE) {
         // Set the background color using Invert on the default
@@ -184,31 +225,105 @@ static void outputSetColor(std::string &out, int color)
         // background color.
 
         // Use the terminal's inverted colors.
-        out.append(";7");
+        ret.reverse = true;
         if (fore == LTGRAY || fore == BLACK) {
             // We're likely mapping Console White to terminal LtGray or
             // Black.  If they are the Console foreground color, then
             // don't set a terminal foreground color to avoid creating
             // invisible text.
         } else {
-            outputSetColorSgrParams(out, false, fore);
+            ret.back = sgrColor(false, fore);
         }
     } else {
         // Set the foreground and background to match exactly that in
         // the Windows console.
-        outputSetColorSgrParams(out, true, fore);
-        outputSetColorSgrParams(out, false, back);
+        ret.fore = sgrColor(true, fore);
+        ret.back = sgrColor(false, back);
     }
     if (fore == back) {
         // The foreground and background colors are exactly equal, so
         // attempt to hide the text using the Conceal SGR parameter,
         // which some terminals support.
-        out.append(";8");
+        ret.conceal = true;
     }
     if (color & WINPTY_COMMON_LVB_UNDERSCORE) {
-        out.append(";4");
+        ret.underline = true;
     }
+    return ret;
+}
+
+static void outputSgrParam(std::string &out, unsigned int param)
+{
+    out.push_back(';');
+    outUInt(out, param);
+}
+
+static void outputSgrFlag(std::string &out, bool from, bool to,
+                          int onParam, int offParam)
+{
+    if (from != to) {
+        outputSgrParam(out, to ? onParam : offParam);
+    }
+}
+
+static void outputSgrColor(std::string &out, const SgrColor &from,
+                           const SgrColor &to)
+{
+    if (from == to) {
+        return;
+    }
+    // When only the 9X/10X override changes, the terminals that ignore it
+    // already show the 3X/4X fallback.
+    if (to.hi == 0 || to.base != from.base) {
+        outputSgrParam(out, to.base);
+    }
+    if (to.hi != 0) {
+        outputSgrParam(out, to.hi);
+    }
+}
+
+// Append the SGR parameters, each preceded by a ';', that change the
+// terminal from `from` to `to`.
+static void outputSgrDelta(std::string &out, const SgrState &from,
+                           const SgrState &to)
+{
+    outputSgrFlag(out, from.bold, to.bold, 1, 22);
+    outputSgrFlag(out, from.reverse, to.reverse, 7, 27);
+    outputSgrColor(out, from.fore, to.fore);
+    outputSgrColor(out, from.back, to.back);
+    outputSgrFlag(out, from.conceal, to.conceal, 8, 28);
+    outputSgrFlag(out, from.underline, to.underline, 4, 24);
+}
+
+// Change the terminal's color from the console color `prevColor` (or an
+// unknown color, if -1) to `color`.  Output either a reset followed by the
+// whole new state, or only the parameters that differ, whichever is shorter.
+// Two console colors can map to the same terminal state, in which case
+// nothing is output.
+static void outputSetColor(std::string &out, int color, int prevColor)
+{
+    const SgrState target = sgrStateForColor(color);
+    const size_t start = out.size();
+    out.append(CSI "0");
+    outputSgrDelta(out, SgrState(), target);
     out.push_back('m');
+    if (prevColor == -1) {
+        return;
+    }
+
+    // Render the delta just past the reset form, then keep the shorter.
+    const size_t fullLength = out.size() - start;
+    outputSgrDelta(out, sgrStateForColor(prevColor), target);
+    const size_t deltaLength = out.size() - start - fullLength;
+    if (deltaLength == 0) {
+        out.resize(start);
+    } else if (strlen(CSI) + deltaLength < fullLength) {
+        // Replace the reset form and the delta's leading ';' with a CSI.
+        out.replace(start, fullLength + 1, CSI);
+        out.push_back('m');
+    } else {
+        out.resize(start + fullLength);
+    }
 }
 
 static inline unsigned int fixSpecialCharacters(unsigned int ch)
@@ -298,27 +413,157 @@ static inline void scanUnicodeScalarValue(
     }
 }
 
+static inline void appendCellChar(std::string &out, unsigned int ch)
+{
+    ch = fixSpecialCharacters(ch);
+    char enc[4];
+    int enclen = encodeUtf8(enc, ch);
+    if (enclen == 0) {
+        enc[0] = '?';
+        enclen = 1;
+    }
+    out.append(enc, enclen);
+}
+
+// Returns true if the cell continues a character that starts in an earlier
+// cell (the right half of a full-width character or a trailing surrogate), so
+// it can't be output on its own.
+static inline bool isContinuationCell(const CHAR_INFO &cell)
+{
+    return (cell.Attributes & WINPTY_COMMON_LVB_TRAILING_BYTE) ||
+        (cell.Char.UnicodeChar & 0xFC00) == 0xDC00;
+}
+
+// Append the run of printable ASCII cells at the start of `cells` that share
+// the first cell's attributes, and return its length.  These cells need none
+// of appendCellChar's translation, so they're narrowed in bulk.  Returns 0 if
+// the first cell isn't printable ASCII.
+static int appendAsciiRun(std::string &out, const CHAR_INFO *cells, int count)
+{
+    const WORD attributes = cells[0].Attributes;
+    const wchar_t ch = cells[0].Char.UnicodeChar;
+    if (ch < 0x20 || ch > 0x7E ||
+            (attributes & (WINPTY_COMMON_LVB_LEADING_BYTE |
+                           WINPTY_COMMON_LVB_TRAILING_BYTE))) {
+        return 0;
+    }
+    char buffer[256];
+    int ret = 0;
+    while (ret < count) {
+        const int chunk = std::min<int>(count - ret, sizeof(buffer));
+        const int n = cellRangeAsciiPrefix(&cells[ret], chunk, attributes,
+                                           buffer);
+        out.append(buffer, n);
+        ret += n;
+        if (n < chunk) {
+            break;
+        }
+    }
+    return ret;
+}
+
+// Like appendAsciiRun, but for a run of half-width cells that may include
+// non-ASCII characters.  The run ends at a control character, a surrogate,
+// or half of a full-width character, since those need appendCellChar's
+// translation.  The code units are gathered and encoded in bulk.
+static int appendUtf16Run(std::string &out, const CHAR_INFO *cells, int count)
+{
+    const WORD attributes = cells[0].Attributes;
+    if (attributes & (WINPTY_COMMON_LVB_LEADING_BYTE |
+                      WINPTY_COMMON_LVB_TRAILING_BYTE)) {
+        return 0;
+    }
+    wchar_t units[128];
+    char buffer[3 * 128];
+    const int limit = std::min<int>(count, 128);
+    int n = 0;
+    while (n < limit && cells[n].Attributes == attributes) {
+        const wchar_t ch = cells[n].Char.UnicodeChar;
+        if (ch < 0x20 || (ch & 0xF800) == 0xD800) {
+            break;
+        }
+        units[n++] = ch;
+    }
+    out.append(buffer, encodeUtf8Run(units, n, buffer));
+    return n;
+}
+
+// Append the run of cells at the start of `cells` that can be encoded in
+// bulk, and return its length, or 0 if the first cell needs the per-cell
+// path.
+static int appendCellRun(std::string &out, const CHAR_INFO *cells, int count)
+{
+    const int ret = appendAsciiRun(out, cells, count);
+    return ret > 0 ? ret : appendUtf16Run(out, cells, count);
+}
+
+// The number of bytes in a CSI <column+1> G sequence.
+static inline int columnMoveCost(int column)
+{
+    int digits = 1;
+    for (int n = column + 1; n >= 10; n /= 10) {
+        digits++;
+    }
+    return 3 + digits;
+}
+
 } // anonymous namespace
 
 void Terminal::reset(SendClearFlag sendClearFirst, int64_t newLine)
 {
+    if (m_binaryFrames) {
+        // The client starts with a blank screen, so always clear it.
+        beginRecord(WINPTY_FRAME_RESET);
+        outVarint(m_frame, newLine);
+        m_cursorLine = -1;
+        return;
+    }
     if (sendClearFirst == SendClear && !m_plainMode) {
         // 0m   ==> reset SGR parameters
         // 1;1H ==> move cursor to top-left position
         // 2J   ==> clear the entire screen
-        m_output.write(CSI "0m" CSI "1;1H" CSI "2J");
+        m_frame.append(CSI "0m" CSI "1;1H" CSI "2J");
+        m_remoteColor = SGR_RESET_COLOR;
+    } else {
+        m_remoteColor = -1;
     }
     m_remoteLine = newLine;
     m_remoteColumn = 0;
     m_lineData.clear();
     m_cursorHidden = false;
-    m_remoteColor = -1;
+    m_cursorShownAt = std::string::npos;
 }
 
+// Send everything output since the last flush in a single pipe write.  The
+// Scraper flushes once per scrape.
+void Terminal::flush()
+{
+    if (!m_frame.empty()) {
+        if (m_binaryFrames) {
+            const size_t size = m_frame.size() - FRAME_HEADER_SIZE;
+            for (int i = 0; i < 4; ++i) {
+                m_frame[2 + i] = static_cast<char>(size >> (i * 8));
+            }
+        }
+        agentStats().add(WINPTY_STAT_OUTPUT_BYTES, m_frame.size());
+        m_output.write(m_frame.data(), m_frame.size());
+        m_frame.clear();
+    }
+    m_cursorShownAt = std::string::npos;
+}
+
+// `prevLineData`, if non-NULL, is the content the terminal line already shows
+// (i.e. what was last sent for it), and has the same width as `lineData`.
 void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
-                        int cursorColumn)
+                        int cursorColumn, const CHAR_INFO *prevLineData)
 {
     ASSERT(width >= 1);
+    agentStats().add(WINPTY_STAT_LINES_SENT, 1);
+
+    if (m_binaryFrames) {
+        sendBinaryLine(line, lineData, width, prevLineData);
+        return;
+    }
 
     moveTerminalToLine(line);
 
@@ -345,14 +590,22 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
             }
         }
     }
+    // If we'd have to rewrite the line from the start, see if it's cheaper to
+    // patch only the cells that changed.
+    if (prevLineData != nullptr && m_linePatching && !m_plainMode &&
+            (!m_lineDataValid || m_remoteColumn == 0) &&
+            sendLinePatch(lineData, prevLineData, width)) {
+        return;
+    }
+
     if (!m_lineDataValid) {
         // We can't reuse, so we must reset this line.
         hideTerminalCursor();
         if (m_plainMode) {
             // We can't backtrack, so repeat this line.
-            m_output.write("\r\n");
+            m_frame.append("\r\n");
         } else {
-            m_output.write("\r");
+            m_frame.push_back('\r');
         }
         m_lineDataValid = true;
         m_lineData.clear();
@@ -361,23 +614,209 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
 
     std::string &termLine = m_termLineWorkingBuffer;
     termLine.clear();
-    size_t trimmedLineLength = 0;
-    int trimmedCellCount = m_lineData.size();
+    int color = m_remoteColor;
+    const int trimmedCellCount =
+        renderLineTail(termLine, lineData, m_lineData.size(), width, color);
+
+    if (cursorColumn != -1 && trimmedCellCount > cursorColumn) {
+        // The line content would run past the cursor, so hide it before we
+        // output.
+        hideTerminalCursor();
+    }
+
+    m_frame.append(termLine);
+    m_remoteColor = color;
+
+    ASSERT(trimmedCellCount <= width);
+    m_lineData.insert(m_lineData.end(),
+                      &lineData[m_lineData.size()],
+                      &lineData[trimmedCellCount]);
+    m_remoteColumn = trimmedCellCount;
+}
+
+// Update the current terminal line from `prevLineData` to `lineData` by
+// moving the cursor to each run of changed cells and overwriting it.  Runs
+// separated by only a few unchanged cells are merged, since repeating the
+// cells is no more expensive than moving the cursor past them.  The last run
+// is finished with an erase if that is cheaper than writing its trailing
+// blanks.  Returns false, having output nothing, if rewriting the whole line
+// would be at least as cheap.
+bool Terminal::sendLinePatch(const CHAR_INFO *lineData,
+                             const CHAR_INFO *prevLineData, int width)
+{
+    ASSERT(!m_plainMode);
+
+    int pos = cellRangeEqualPrefix(prevLineData, lineData, width);
+    if (pos == width) {
+        // The terminal already shows this line.
+        return true;
+    }
+
+    std::string &rewrite = m_termLineWorkingBuffer;
+    rewrite.clear();
+    if (!m_lineDataValid) {
+        rewrite.push_back('\r');
+    }
+    int rewriteColor = m_remoteColor;
+    renderLineTail(rewrite, lineData, 0, width, rewriteColor);
+
+    std::string &patch = m_patchWorkingBuffer;
+    patch.clear();
+    int color = m_remoteColor;
+    int column = m_remoteColumn;
+    int tailCellCount = -1;
+
+    while (pos < width && patch.size() < rewrite.size()) {
+        int start = pos;
+        while (start > 0 && (isContinuationCell(lineData[start]) ||
+                             isContinuationCell(prevLineData[start]))) {
+            start--;
+        }
+        int end = pos + 1;
+        while (true) {
+            while (end < width && (isContinuationCell(lineData[end]) ||
+                                   isContinuationCell(prevLineData[end]))) {
+                end++;
+            }
+            if (end == width) {
+                break;
+            }
+            const int same = cellRangeEqualPrefix(
+                &prevLineData[end], &lineData[end], width - end);
+            if (end + same == width || same > columnMoveCost(end + same)) {
+                break;
+            }
+            end += same + 1;
+        }
+        pos = end + cellRangeEqualPrefix(
+            &prevLineData[end], &lineData[end], width - end);
+
+        if (column != start) {
+            if (start == 0) {
+                patch.push_back('\r');
+            } else {
+                char buffer[32];
+                winpty_snprintf(buffer, CSI "%dG", start + 1);
+                patch.append(buffer);
+            }
+        }
+
+        if (pos < width) {
+            renderCells(patch, lineData, start, end, color);
+            column = end;
+            continue;
+        }
+
+        // This is the last run.  Either overwrite it exactly, or rewrite
+        // everything from its start and erase the rest of the line.
+        const size_t runStart = patch.size();
+        int tailColor = color;
+        std::string &tail = m_termLineWorkingBuffer2;
+        tail.clear();
+        const int cellCount =
+            renderLineTail(tail, lineData, start, width, tailColor);
+        renderCells(patch, lineData, start, end, color);
+        if (tail.size() <= patch.size() - runStart) {
+            patch.resize(runStart);
+            patch.append(tail);
+            color = tailColor;
+            tailCellCount = cellCount;
+        }
+        column = end;
+    }
+
+    if (patch.size() >= rewrite.size()) {
+        return false;
+    }
+
+    hideTerminalCursor();
+    m_frame.append(patch);
+    m_remoteColor = color;
+    m_lineData.clear();
+    if (tailCellCount != -1) {
+        // The line has been rewritten through its last non-blank cell, so
+        // sendLine can append to it.
+        m_lineDataValid = true;
+        m_lineData.insert(m_lineData.end(),
+                          &lineData[0], &lineData[tailCellCount]);
+        m_remoteColumn = tailCellCount;
+    } else {
+        m_lineDataValid = false;
+        m_remoteColumn = column;
+    }
+    return true;
+}
+
+// Render the cells in [start, end) exactly, including spaces, assuming the
+// terminal cursor is at column `start`.
+void Terminal::renderCells(std::string &out, const CHAR_INFO *lineData,
+                           int start, int end, int &color) const
+{
+    int cellCount = 1;
+    for (int i = start; i < end; i += cellCount) {
+        if (m_outputColor) {
+            int cellColor = lineData[i].Attributes & COLOR_ATTRIBUTE_MASK;
+            if (cellColor != color) {
+                outputSetColor(out, cellColor, color);
+                color = cellColor;
+            }
+        }
+        cellCount = appendCellRun(out, &lineData[i], end - i);
+        if (cellCount > 0) {
+            continue;
+        }
+        unsigned int ch;
+        scanUnicodeScalarValue(&lineData[i], end - i, cellCount, ch);
+        appendCellChar(out, ch);
+    }
+}
+
+// Render the cells from `start` to the end of the line, assuming the terminal
+// cursor is at column `start`, and erase the rest of the terminal line.
+// Trailing spaces are left to the erase.  `color` is the terminal's current
+// color on entry and exit.  Returns the number of cells the terminal cursor
+// has moved past (i.e. the new remote column).
+int Terminal::renderLineTail(std::string &termLine, const CHAR_INFO *lineData,
+                             int start, int width, int &color) const
+{
+    const size_t startLength = termLine.size();
+    size_t trimmedLineLength = startLength;
+    int trimmedCellCount = start;
     bool alreadyErasedLine = false;
 
     int cellCount = 1;
-    for (int i = m_lineData.size(); i < width; i += cellCount) {
+    for (int i = start; i < width; i += cellCount) {
         if (m_outputColor) {
-            int color = lineData[i].Attributes & COLOR_ATTRIBUTE_MASK;
-            if (color != m_remoteColor) {
-                outputSetColor(termLine, color);
+            int cellColor = lineData[i].Attributes & COLOR_ATTRIBUTE_MASK;
+            if (cellColor != color) {
+                outputSetColor(termLine, cellColor, color);
                 trimmedLineLength = termLine.size();
-                m_remoteColor = color;
+                color = cellColor;
 
                 // All the cells just up to this color change will be output.
                 trimmedCellCount = i;
             }
         }
+        // The last cell is left to the scalar path below, which handles the
+        // erase at the end of the line.
+        if (i + 1 < width) {
+            cellCount = appendCellRun(termLine, &lineData[i], width - i - 1);
+            if (cellCount > 0) {
+                // Like the scalar path, output the run's trailing spaces
+                // only if something follows them.
+                int spaces = 0;
+                while (spaces < cellCount &&
+                        lineData[i + cellCount - 1 - spaces].Char.UnicodeChar
+                            == L' ') {
+                    ++spaces;
+                }
+                if (spaces < cellCount) {
+                    trimmedLineLength = termLine.size() - spaces;
+                    trimmedCellCount = i + cellCount - spaces;
+                }
+                continue;
+            }
+        }
         unsigned int ch;
         scanUnicodeScalarValue(&lineData[i], width - i, cellCount, ch);
         if (ch == ' ') {
@@ -398,14 +837,7 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
                 }
                 alreadyErasedLine = true;
             }
-            ch = fixSpecialCharacters(ch);
-            char enc[4];
-            int enclen = encodeUtf8(enc, ch);
-            if (enclen == 0) {
-                enc[0] = '?';
-                enclen = 1;
-            }
-            termLine.append(enc, enclen);
+            appendCellChar(termLine, ch);
             trimmedLineLength = termLine.size();
 
             // All the cells up to and including this cell will be output.
@@ -413,54 +845,128 @@ void Terminal::sendLine(int64_t line, const CHAR_INFO *lineData, int width,
         }
     }
 
-    if (cursorColumn != -1 && trimmedCellCount > cursorColumn) {
-        // The line content would run past the cursor, so hide it before we
-        // output.
-        hideTerminalCursor();
-    }
-
-    m_output.write(termLine.data(), trimmedLineLength);
+    termLine.resize(trimmedLineLength);
     if (!alreadyErasedLine && !m_plainMode) {
-        m_output.write(CSI "0K"); // Erase from cursor to EOL
+        termLine.append(CSI "0K"); // Erase from cursor to EOL
     }
-
-    ASSERT(trimmedCellCount <= width);
-    m_lineData.insert(m_lineData.end(),
-                      &lineData[m_lineData.size()],
-                      &lineData[trimmedCellCount]);
-    m_remoteColumn = trimmedCellCount;
+    return trimmedCellCount;
 }
 
 void Terminal::showTerminalCursor(int column, int64_t line)
 {
+    if (m_binaryFrames) {
+        if (m_cursorHidden || line != m_cursorLine ||
+                column != m_cursorColumn) {
+            beginRecord(WINPTY_FRAME_CURSOR);
+            outVarint(m_frame, line);
+            outVarint(m_frame, column);
+            m_cursorHidden = false;
+            m_cursorLine = line;
+            m_cursorColumn = column;
+        }
+        return;
+    }
     moveTerminalToLine(line);
     if (!m_plainMode) {
         if (m_remoteColumn != column) {
             char buffer[32];
             winpty_snprintf(buffer, CSI "%dG", column + 1);
-            m_output.write(buffer);
+            m_frame.append(buffer);
             m_lineDataValid = (column == 0);
             m_lineData.clear();
             m_remoteColumn = column;
         }
         if (m_cursorHidden) {
-            m_output.write(CSI "?25h");
+            m_frame.append(CSI "?25h");
             m_cursorHidden = false;
+            m_cursorShownAt = m_frame.size();
         }
     }
 }
 
 void Terminal::hideTerminalCursor()
 {
+    if (m_binaryFrames) {
+        // A client applies a whole frame at once, so the cursor only needs
+        // hiding when the scrape leaves it hidden.
+        if (!m_cursorHidden) {
+            beginRecord(WINPTY_FRAME_HIDE_CURSOR);
+            m_cursorHidden = true;
+        }
+        return;
+    }
     if (!m_plainMode) {
         if (m_cursorHidden) {
             return;
         }
-        m_output.write(CSI "?25l");
+        if (m_cursorShownAt == m_frame.size()) {
+            // Nothing was output since the cursor was shown, so take that
+            // back instead.
+            m_frame.resize(m_frame.size() - strlen(CSI "?25h"));
+        } else {
+            m_frame.append(CSI "?25l");
+        }
         m_cursorHidden = true;
+        m_cursorShownAt = std::string::npos;
     }
 }
 
+// Scroll the terminal rows [top, bottom] up by `count` rows, or down if
+// `count` is negative, and fill the exposed rows with blanks in the default
+// color.  Rows are numbered from the top of the screen, which only matches
+// the line numbering in direct mode, where the terminal is reset to line 0.
+// In binary frame mode, the rows are scrolled without changing the line
+// numbering.  Returns false, having output nothing, in plain mode.
+bool Terminal::scrollRows(int top, int bottom, int count)
+{
+    ASSERT(top >= 0 && top <= bottom);
+    ASSERT(count != 0 && abs(count) <= bottom - top);
+
+    if (m_binaryFrames) {
+        beginRecord(count > 0 ? WINPTY_FRAME_SCROLL_UP
+                              : WINPTY_FRAME_SCROLL_DOWN);
+        outVarint(m_frame, top);
+        outVarint(m_frame, bottom);
+        outVarint(m_frame, abs(count));
+        return true;
+    }
+
+    if (m_plainMode) {
+        return false;
+    }
+
+    hideTerminalCursor();
+
+    // 0m   ==> reset SGR parameters, so the exposed rows get the default
+    //          background color (unless they're already reset)
+    // r    ==> set the scrolling region (DECSTBM), which also homes the
+    //          cursor
+    // H    ==> move the cursor to the top of the region
+    // M/L  ==> delete/insert lines (DL/IL), shifting the rest of the region
+    // r    ==> reset the scrolling region, homing the cursor again
+    if (m_remoteColor != SGR_RESET_COLOR) {
+        m_frame.append(CSI "0m");
+        m_remoteColor = SGR_RESET_COLOR;
+    }
+    char buffer[64];
+    if (top == 0) {
+        winpty_snprintf(buffer, CSI "%d;%dr" CSI "%d%c" CSI "r",
+                        top + 1, bottom + 1, abs(count),
+                        count > 0 ? 'M' : 'L');
+    } else {
+        winpty_snprintf(buffer, CSI "%d;%dr" CSI "%dH" CSI "%d%c" CSI "r",
+                        top + 1, bottom + 1, top + 1, abs(count),
+                        count > 0 ? 'M' : 'L');
+    }
+    m_frame.append(buffer);
+
+    m_remoteLine = 0;
+    m_remoteColumn = 0;
+    m_lineDataValid = true;
+    m_lineData.clear();
+    return true;
+}
+
 void Terminal::moveTerminalToLine(int64_t line)
 {
     if (line == m_remoteLine) {
@@ -477,7 +983,7 @@ void Terminal::moveTerminalToLine(int64_t line)
     if (line < m_remoteLine) {
         if (m_plainMode) {
             // We can't backtrack, so instead repeat the lines again.
-            m_output.write("\r\n");
+            m_frame.append("\r\n");
             m_remoteLine = line;
         } else {
             // Backtrack and overwrite previous lines.
@@ -485,13 +991,23 @@ void Terminal::moveTerminalToLine(int64_t line)
             char buffer[32];
             winpty_snprintf(buffer, "\r" CSI "%uA",
                 static_cast<unsigned int>(m_remoteLine - line));
-            m_output.write(buffer);
+            m_frame.append(buffer);
             m_remoteLine = line;
         }
     } else if (line > m_remoteLine) {
-        while (line > m_remoteLine) {
-            m_output.write("\r\n");
-            m_remoteLine++;
+        if (m_plainMode) {
+            while (line > m_remoteLine) {
+                m_frame.append("\r\n");
+                m_remoteLine++;
+            }
+        } else {
+            // One carriage return suffices.  Don't use CUrsor Down (CUD)
+            // instead of the line feeds, because it doesn't scroll the
+            // terminal at the bottom of the screen, and we don't know where
+            // that is.
+            m_frame.push_back('\r');
+            m_frame.append(static_cast<size_t>(line - m_remoteLine), '\n');
+            m_remoteLine = line;
         }
     }
 
@@ -506,6 +1022,10 @@ void Terminal::enableMouseMode(bool enabled)
         return;
     }
     m_mouseModeEnabled = enabled;
+    if (m_binaryFrames) {
+        sendModes();
+        return;
+    }
     if (enabled) {
         // Start by disabling UTF-8 coordinate mode (1005), just in case we
         // have a terminal that does not support 1006/1015 modes, and 1005
@@ -522,14 +1042,150 @@ void Terminal::enableMouseMode(bool enabled)
         // priority.  On other terminals, 1006 wins because it's listed last.
         //
         // See misc/MouseInputNotes.txt for details.
-        m_output.write(
+        m_frame.append(
             CSI "?1005l"
             CSI "?1000h" CSI "?1002h" CSI "?1003h" CSI "?1015h" CSI "?1006h");
     } else {
         // Resetting both encoding modes (1006 and 1015) is necessary, but
         // apparently we only need to use reset on one of the 100[023] modes.
         // Doing both doesn't hurt.
-        m_output.write(
+        m_frame.append(
             CSI "?1006l" CSI "?1015l" CSI "?1003l" CSI "?1002l" CSI "?1000l");
     }
+    // The agent changes the mouse mode between scrapes, so send it now.
+    flush();
+}
+
+// With bracketed paste mode (2004), the terminal wraps pasted text in
+// ESC[200~ and ESC[201~, which lets ConsoleInput write it without looking
+// for escape sequences.  Terminals that lack the mode ignore the request.
+void Terminal::enableBracketedPaste(bool enabled)
+{
+    if (m_bracketedPasteEnabled == enabled || m_plainMode) {
+        return;
+    }
+    m_bracketedPasteEnabled = enabled;
+    if (m_binaryFrames) {
+        sendModes();
+        return;
+    }
+    m_frame.append(enabled ? CSI "?2004h" : CSI "?2004l");
+    flush();
+}
+
+void Terminal::sendModes()
+{
+    beginRecord(WINPTY_FRAME_MODES);
+    outVarint(m_frame,
+        (m_mouseModeEnabled ? WINPTY_FRAME_MODE_MOUSE : 0) |
+        (m_bracketedPasteEnabled ? WINPTY_FRAME_MODE_BRACKETED_PASTE : 0));
+    flush();
+}
+
+// Set the terminal's window title.  The agent calls this between scrapes, so
+// send it now.
+void Terminal::sendTitle(const std::wstring &title)
+{
+    if (m_plainMode) {
+        return;
+    }
+    std::string &utf8 = m_termLineWorkingBuffer;
+    utf8.resize(title.size() * 3);
+    utf8.resize(encodeUtf8Run(title.data(), title.size(), &utf8[0]));
+    if (m_binaryFrames) {
+        beginRecord(WINPTY_FRAME_TITLE);
+        outVarint(m_frame, utf8.size());
+        m_frame.append(utf8);
+    } else {
+        m_frame.append("\x1b]0;");
+        m_frame.append(utf8);
+        m_frame.push_back('\x07');
+    }
+    flush();
+}
+
+// Start a binary frame record, and the frame itself if this is its first
+// record.  flush fills in the payload size.
+void Terminal::beginRecord(int opcode)
+{
+    if (m_frame.empty()) {
+        m_frame.push_back(static_cast<char>(WINPTY_FRAME_MAGIC));
+        m_frame.push_back(static_cast<char>(WINPTY_FRAME_VERSION));
+        m_frame.append(FRAME_HEADER_SIZE - 2, '\0');
+    }
+    m_frame.push_back(static_cast<char>(opcode));
+}
+
+// Send the cells of the line that differ from `prevLineData` (or all of them,
+// if it is NULL or line patching is off) as a WINPTY_FRAME_LINE record.  The
+// blanks at the end of the line, in the last cell's attributes, are sent as an
+// erase.
+void Terminal::sendBinaryLine(int64_t line, const CHAR_INFO *lineData,
+                              int width, const CHAR_INFO *prevLineData)
+{
+    const WORD eraseAttributes = lineData[width - 1].Attributes;
+    const int contentEnd =
+        width - cellRangeBlankSuffix(lineData, width, eraseAttributes);
+    int start = 0;
+    int end = contentEnd;
+    bool erase = contentEnd < width;
+    if (prevLineData != nullptr && m_linePatching) {
+        start = cellRangeEqualPrefix(prevLineData, lineData, width);
+        if (start == width) {
+            return;
+        }
+        int changedEnd = width - cellRangeEqualSuffix(
+            prevLineData + start, lineData + start, width - start);
+        // Don't split a character that spans cells.
+        while (start > 0 && (isContinuationCell(lineData[start]) ||
+                             isContinuationCell(prevLineData[start]))) {
+            start--;
+        }
+        while (changedEnd < width &&
+                (isContinuationCell(lineData[changedEnd]) ||
+                 isContinuationCell(prevLineData[changedEnd]))) {
+            changedEnd++;
+        }
+        if (changedEnd <= contentEnd) {
+            end = changedEnd;
+            erase = false;
+        } else {
+            end = std::max(start, contentEnd);
+        }
+    }
+
+    std::string &text = m_termLineWorkingBuffer;
+    text.clear();
+    auto &runs = m_attributeRuns;
+    runs.clear();
+    int cellCount = 1;
+    for (int i = start; i < end; i += cellCount) {
+        const int attributes = lineData[i].Attributes & COLOR_ATTRIBUTE_MASK;
+        cellCount = appendCellRun(text, &lineData[i], end - i);
+        if (cellCount == 0) {
+            unsigned int ch;
+            scanUnicodeScalarValue(&lineData[i], end - i, cellCount, ch);
+            appendCellChar(text, ch);
+            text.append(cellCount - 1, '\0');
+        }
+        if (!runs.empty() && runs.back().first == attributes) {
+            runs.back().second += cellCount;
+        } else {
+            runs.push_back(std::make_pair(attributes, cellCount));
+        }
+    }
+
+    beginRecord(WINPTY_FRAME_LINE);
+    outVarint(m_frame, line);
+    outVarint(m_frame, start);
+    outVarint(m_frame, end - start);
+    outVarint(m_frame, runs.size());
+    for (const auto &run : runs) {
+        outVarint(m_frame, run.first);
+        outVarint(m_frame, run.second);
+    }
+    outVarint(m_frame, text.size());
+    m_frame.append(text);
+    outVarint(m_frame,
+        erase ? (eraseAttributes & COLOR_ATTRIBUTE_MASK) + 1 : 0);
 }
@@ -21,39 +21,67 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 
-#include <windows.h>
 #include <stdint.h>
 
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "ConsoleTypes.h"
 #include "Coord.h"
 
-class NamedPipe;
+class TerminalOutput;
 
 class Terminal
 {
 public:
-    explicit Terminal(NamedPipe &output, bool plainMode, bool outputColor)
-        : m_output(output), m_plainMode(plainMode), m_outputColor(outputColor)
+    // In binary frame mode (WINPTY_FLAG_BINARY_FRAMES), the Terminal writes
+    // the frames described in winpty_constants.h instead of escape
+    // sequences, and plainMode and outputColor don't apply.
+    explicit Terminal(TerminalOutput &output, bool plainMode,
+                      bool outputColor, bool binaryFrames=false)
+        : m_output(output), m_plainMode(plainMode), m_outputColor(outputColor),
+          m_binaryFrames(binaryFrames)
     {
+        // The client of a binary frame stream starts with the cursor hidden.
+        m_cursorHidden = binaryFrames;
     }
 
     enum SendClearFlag { OmitClear, SendClear };
     void reset(SendClearFlag sendClearFirst, int64_t newLine);
     void sendLine(int64_t line, const CHAR_INFO *lineData, int width,
-                  int cursorColumn);
+                  int cursorColumn, const CHAR_INFO *prevLineData=nullptr);
     void showTerminalCursor(int column, int64_t line);
     void hideTerminalCursor();
+    bool scrollRows(int top, int bottom, int count);
+    void flush();
+    void setLinePatching(bool enabled) { m_linePatching = enabled; }
 
 private:
+    void beginRecord(int opcode);
+    void sendBinaryLine(int64_t line, const CHAR_INFO *lineData, int width,
+                        const CHAR_INFO *prevLineData);
+    void sendModes();
+    bool sendLinePatch(const CHAR_INFO *lineData,
+                       const CHAR_INFO *prevLineData, int width);
+    void renderCells(std::string &out, const CHAR_INFO *lineData,
+                     int start, int end, int &color) const;
+    int renderLineTail(std::string &termLine, const CHAR_INFO *lineData,
+                       int start, int width, int &color) const;
     void moveTerminalToLine(int64_t line);
 
 public:
     void enableMouseMode(bool enabled);
+    void enableBracketedPaste(bool enabled);
+    void sendTitle(const std::wstring &title);
 
 private:
-    NamedPipe &m_output;
+    TerminalOutput &m_output;
+    // Output accumulates here until the next flush.
+    std::string m_frame;
+    // The frame offset just past the last show-cursor command, if nothing
+    // has been output after it.
+    size_t m_cursorShownAt = std::string::npos;
     int64_t m_remoteLine = 0;
     int m_remoteColumn = 0;
     bool m_lineDataValid = true;
@@ -61,9 +89,20 @@ private:
     bool m_cursorHidden = false;
     int m_remoteColor = -1;
     std::string m_termLineWorkingBuffer;
+    std::string m_termLineWorkingBuffer2;
+    std::string m_patchWorkingBuffer;
     bool m_plainMode = false;
     bool m_outputColor = true;
     bool m_mouseModeEnabled = false;
+    bool m_bracketedPasteEnabled = false;
+    bool m_linePatching = true;
+    bool m_binaryFrames = false;
+    // The cursor position last sent in binary frame mode, or -1 if it must
+    // be sent again.
+    int64_t m_cursorLine = -1;
+    int m_cursorColumn = -1;
+    // The (attributes, cell count) runs of the line being encoded.
+    std::vector<std::pair<int, int>> m_attributeRuns;
 };
 
 #endif // TERMINAL_H
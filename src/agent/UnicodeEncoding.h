@@ -23,6 +23,14 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UNICODE_ENCODING_SSE2 1
+#include <emmintrin.h>
+#endif
+
 // Encode the Unicode codepoint with UTF-8.  The buffer must be at least 4
 // bytes in size.
 static inline int encodeUtf8(char *out, uint32_t code) {
@@ -154,4 +162,162 @@ static inline uint32_t decodeSurrogatePair(wchar_t ch1, wchar_t ch2) {
     return ((ch1 - 0xD800) << 10) + (ch2 - 0xDC00) + 0x10000;
 }
 
+#ifdef UNICODE_ENCODING_SSE2
+
+// If the 16 bytes are all ASCII, widen them to `out` and return true.
+static inline bool widenAsciiBlock(const char *in, wchar_t *out) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    if (_mm_movemask_epi8(bytes) != 0) {
+        return false;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    __m128i *const vout = reinterpret_cast<__m128i*>(out);
+    if (sizeof(wchar_t) == 2) {
+        _mm_storeu_si128(vout + 0, lo);
+        _mm_storeu_si128(vout + 1, hi);
+    } else {
+        _mm_storeu_si128(vout + 0, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(vout + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(vout + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(vout + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+    return true;
+}
+
+// If the 8 code units are all ASCII, narrow them to `out` and return true.
+static inline bool narrowAsciiBlock(const wchar_t *in, char *out) {
+    const __m128i *const vin = reinterpret_cast<const __m128i*>(in);
+    __m128i words;
+    if (sizeof(wchar_t) == 2) {
+        words = _mm_loadu_si128(vin);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+                _mm_and_si128(words, _mm_set1_epi16(
+                    static_cast<short>(0xFF80))),
+                _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    } else {
+        const __m128i lo = _mm_loadu_si128(vin + 0);
+        const __m128i hi = _mm_loadu_si128(vin + 1);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                _mm_and_si128(_mm_or_si128(lo, hi),
+                              _mm_set1_epi32(~0x7F)),
+                _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+        words = _mm_packs_epi32(lo, hi);
+    }
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out),
+                     _mm_packus_epi16(words, words));
+    return true;
+}
+
+// After a vector block fails the ASCII test, the run functions convert this
+// many code units one character at a time before testing another block, and
+// double the count (up to kRunMaxScalarSpan) after each further failure.  A
+// block that passes resets it.  Text that isn't mostly ASCII then pays for
+// only an occasional failed test.
+const int kRunMinScalarSpan = 16;
+const int kRunMaxScalarSpan = 1024;
+
+#endif // UNICODE_ENCODING_SSE2
+
+// Decode the longest prefix of `in` made of complete, valid UTF-8 characters
+// to UTF-16.  `out` must have room for `inSize` elements.  Returns the number
+// of bytes decoded and sets `outSize` to the number of elements written.  The
+// result is the same as calling utf8CharLength, decodeUtf8, and encodeUtf16
+// on each character, but blocks of ASCII are widened 16 bytes at a time.
+static inline int decodeUtf8Run(const char *in, int inSize,
+                                wchar_t *out, int &outSize) {
+    int i = 0;
+    int o = 0;
+#ifdef UNICODE_ENCODING_SSE2
+    int scalarSpan = kRunMinScalarSpan;
+#endif
+    while (i < inSize) {
+        int scalarEnd = inSize;
+#ifdef UNICODE_ENCODING_SSE2
+        if (inSize - i >= 16) {
+            if (widenAsciiBlock(in + i, out + o)) {
+                i += 16;
+                o += 16;
+                scalarSpan = kRunMinScalarSpan;
+                continue;
+            }
+            scalarEnd = std::min(inSize, i + scalarSpan);
+            scalarSpan = std::min(scalarSpan * 2, kRunMaxScalarSpan);
+        }
+#endif
+        do {
+            if ((in[i] & 0x80) == 0) {
+                out[o++] = in[i++];
+                continue;
+            }
+            const int len = utf8CharLength(in[i]);
+            if (len == 0 || len > inSize - i) {
+                outSize = o;
+                return i;
+            }
+            const uint32_t code = decodeUtf8(in + i);
+            if (code == static_cast<uint32_t>(-1)) {
+                outSize = o;
+                return i;
+            }
+            o += encodeUtf16(out + o, code);
+            i += len;
+        } while (i < scalarEnd);
+    }
+    outSize = o;
+    return i;
+}
+
+// Encode UTF-16 to UTF-8, replacing each unpaired surrogate with a '?'.
+// `out` must have room for 3 * `inSize` bytes.  Returns the number of bytes
+// written.  The result is the same as encoding each code point (or
+// surrogate pair) with encodeUtf8, but blocks of ASCII are narrowed 8 code
+// units at a time.
+static inline int encodeUtf8Run(const wchar_t *in, int inSize, char *out) {
+    int i = 0;
+    int o = 0;
+#ifdef UNICODE_ENCODING_SSE2
+    int scalarSpan = kRunMinScalarSpan;
+#endif
+    while (i < inSize) {
+        int scalarEnd = inSize;
+#ifdef UNICODE_ENCODING_SSE2
+        if (inSize - i >= 8) {
+            if (narrowAsciiBlock(in + i, out + o)) {
+                i += 8;
+                o += 8;
+                scalarSpan = kRunMinScalarSpan;
+                continue;
+            }
+            scalarEnd = std::min(inSize, i + scalarSpan);
+            scalarSpan = std::min(scalarSpan * 2, kRunMaxScalarSpan);
+        }
+#endif
+        do {
+            uint32_t code = static_cast<uint16_t>(in[i++]);
+            if (code < 0x80) {
+                out[o++] = static_cast<char>(code);
+                continue;
+            }
+            if ((code & 0xFC00) == 0xD800 && i < inSize &&
+                    (in[i] & 0xFC00) == 0xDC00) {
+                code = decodeSurrogatePair(code, in[i++]);
+            }
+            const int len = encodeUtf8(out + o, code);
+            if (len == 0) {
+                out[o++] = '?';
+            } else {
+                o += len;
+            }
+        } while (i < scalarEnd);
+    }
+    return o;
+}
+
 #endif // UNICODE_ENCODING_H
@@ -19,20 +19,34 @@
 // IN THE SOFTWARE.
 
 // Encode every code-point using this module and verify that it matches the
-// encoding generated using Windows WideCharToMultiByte.
+// encoding generated using Windows WideCharToMultiByte.  Then check the bulk
+// decodeUtf8Run and encodeUtf8Run routines against the one-character-at-a-time
+// functions they're built from, exhaustively for every UTF-8 sequence of up
+// to three bytes, every four-byte sequence with a four-byte lead byte, and
+// every UTF-16 code unit and surrogate pair, and report their throughput.
+//
+// Only the comparisons with Windows need Win32.  On Linux, build with, e.g.:
+//   g++ -std=c++11 -O2 UnicodeEncodingTest.cc -o UnicodeEncodingTest
 
 #include "UnicodeEncoding.h"
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <string>
+#include <vector>
+
+static int g_failures = 0;
+
 static void correctnessByCode()
 {
     char mbstr1[4];
-    char mbstr2[4];
     wchar_t wch[2];
     for (unsigned int code = 0; code < 0x110000; ++code) {
 
@@ -42,12 +56,14 @@ static void correctnessByCode()
         int mblen1 = encodeUtf8(mbstr1, code);
         if (isReserved ? mblen1 != 0 : mblen1 <= 0) {
             printf("Error: 0x%04X: mblen1=%d\n", code, mblen1);
+            ++g_failures;
             continue;
         }
 
         int wlen = encodeUtf16(wch, code);
         if (isReserved ? wlen != 0 : wlen <= 0) {
             printf("Error: 0x%04X: wlen=%d\n", code, wlen);
+            ++g_failures;
             continue;
         }
 
@@ -58,28 +74,37 @@ static void correctnessByCode()
         if (mblen1 != utf8CharLength(mbstr1[0])) {
             printf("Error: 0x%04X: mblen1=%d, utf8CharLength(mbstr1[0])=%d\n",
                 code, mblen1, utf8CharLength(mbstr1[0]));
+            ++g_failures;
             continue;
         }
 
         if (code != decodeUtf8(mbstr1)) {
             printf("Error: 0x%04X: decodeUtf8(mbstr1)=%u\n",
                 code, decodeUtf8(mbstr1));
+            ++g_failures;
             continue;
         }
 
+#ifdef _WIN32
+        char mbstr2[4];
         int mblen2 = WideCharToMultiByte(CP_UTF8, 0, wch, wlen, mbstr2, 4, NULL, NULL);
         if (mblen1 != mblen2) {
             printf("Error: 0x%04X: mblen1=%d, mblen2=%d\n", code, mblen1, mblen2);
+            ++g_failures;
             continue;
         }
 
         if (memcmp(mbstr1, mbstr2, mblen1) != 0) {
             printf("Error: 0x%04x: encodings are different\n", code);
+            ++g_failures;
             continue;
         }
+#endif
     }
 }
 
+#ifdef _WIN32
+
 static const char *encodingStr(char (&output)[128], char (&buf)[4])
 {
     sprintf(output, "Encoding %02X %02X %02X %02X",
@@ -127,38 +152,268 @@ static void correctnessByUtf8Encoding()
             printf("%s: code1=0x%04x code2=0x%04x\n",
                 encodingStr(prefix, mb),
                 code1, code2);
+            ++g_failures;
             continue;
         }
         if (wslen1 != wslen2) {
             printf("%s: wslen1=%d wslen2=%d\n",
                 encodingStr(prefix, mb),
                 wslen1, wslen2);
+            ++g_failures;
             continue;
         }
         if (memcmp(ws1, ws2, wslen1 * sizeof(wchar_t)) != 0) {
             printf("%s: ws1 != ws2\n", encodingStr(prefix, mb));
+            ++g_failures;
             continue;
         }
     }
 }
 
+#endif // _WIN32
+
+// The reference versions of the bulk routines, one character at a time.
+static int decodeUtf8RunScalar(const char *in, int inSize,
+                               wchar_t *out, int &outSize)
+{
+    int i = 0;
+    int o = 0;
+    while (i < inSize) {
+        const int len = utf8CharLength(in[i]);
+        if (len == 0 || len > inSize - i) {
+            break;
+        }
+        const uint32_t code = decodeUtf8(in + i);
+        if (code == static_cast<uint32_t>(-1)) {
+            break;
+        }
+        o += encodeUtf16(out + o, code);
+        i += len;
+    }
+    outSize = o;
+    return i;
+}
+
+static int encodeUtf8RunScalar(const wchar_t *in, int inSize, char *out)
+{
+    int o = 0;
+    for (int i = 0; i < inSize; ++i) {
+        uint32_t code = static_cast<uint16_t>(in[i]);
+        if ((code & 0xFC00) == 0xD800 && i + 1 < inSize &&
+                (in[i + 1] & 0xFC00) == 0xDC00) {
+            code = decodeSurrogatePair(in[i], in[i + 1]);
+            ++i;
+        }
+        const int len = encodeUtf8(out + o, code);
+        if (len == 0) {
+            out[o++] = '?';
+        } else {
+            o += len;
+        }
+    }
+    return o;
+}
+
+static void checkDecode(const std::string &in)
+{
+    const int size = static_cast<int>(in.size());
+    std::vector<wchar_t> out1(size + 1), out2(size + 1);
+    int outSize1 = 0;
+    int outSize2 = 0;
+    const int len1 = decodeUtf8RunScalar(in.data(), size, out1.data(), outSize1);
+    const int len2 = decodeUtf8Run(in.data(), size, out2.data(), outSize2);
+    if (len1 != len2 || outSize1 != outSize2 ||
+            memcmp(out1.data(), out2.data(), outSize1 * sizeof(wchar_t))) {
+        if (g_failures++ < 10) {
+            printf("Error: decodeUtf8Run:");
+            for (char ch : in) {
+                printf(" %02X", static_cast<uint8_t>(ch));
+            }
+            printf(": consumed %d/%d, wrote %d/%d\n",
+                   len2, len1, outSize2, outSize1);
+        }
+    }
+}
+
+static void checkEncode(const std::wstring &in)
+{
+    const int size = static_cast<int>(in.size());
+    std::vector<char> out1(3 * size + 1), out2(3 * size + 1);
+    const int len1 = encodeUtf8RunScalar(in.data(), size, out1.data());
+    const int len2 = encodeUtf8Run(in.data(), size, out2.data());
+    if (len1 != len2 || memcmp(out1.data(), out2.data(), len1)) {
+        if (g_failures++ < 10) {
+            printf("Error: encodeUtf8Run:");
+            for (wchar_t ch : in) {
+                printf(" %04X", static_cast<uint16_t>(ch));
+            }
+            printf(": wrote %d/%d\n", len2, len1);
+        }
+    }
+}
+
+// Put the sequence after a varying amount of ASCII, so that it lands at
+// every offset within a vector block, and follow it with a block of ASCII.
+static void checkDecodeInContext(const char *seq, int seqLen, int offset)
+{
+    std::string in(offset % 19, 'a');
+    in.append(seq, seqLen);
+    in.append("0123456789abcdef0");
+    checkDecode(in);
+    checkDecode(std::string(seq, seqLen));
+}
+
+static void differentialDecode()
+{
+    // Every sequence of up to three bytes, including all of the truncated
+    // and invalid ones.  (A trailing zero byte is a one-byte sequence.)
+    for (uint32_t v = 0; v < (1u << 24); ++v) {
+        const char seq[3] = {
+            static_cast<char>(v >> 16),
+            static_cast<char>(v >> 8),
+            static_cast<char>(v),
+        };
+        checkDecodeInContext(seq, 3, v);
+    }
+    // Every four-byte sequence with a lead byte that announces four bytes.
+    for (uint32_t v = 0; v < (1u << 27); ++v) {
+        const char seq[4] = {
+            static_cast<char>(0xF0 | (v >> 24)),
+            static_cast<char>(v >> 16),
+            static_cast<char>(v >> 8),
+            static_cast<char>(v),
+        };
+        checkDecodeInContext(seq, 4, v);
+    }
+    // Random mixtures of text and invalid sequences.
+    static const char *const kTokens[] = {
+        "a", " ", "\r", "\x1B", "0123456789abcdefghijklmnopqrstuvwxyz",
+        "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xE6\xBC\xA2",
+        "\x80", "\xC3", "\xFF", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+        "\xC0\x80", "\xE2\x82", "\xF0\x9F",
+    };
+    srand(1);
+    for (int iter = 0; iter < 200000; ++iter) {
+        std::string in;
+        const int count = rand() % 40;
+        for (int i = 0; i < count; ++i) {
+            in += kTokens[rand() % (sizeof(kTokens) / sizeof(kTokens[0]))];
+        }
+        checkDecode(in);
+    }
+}
+
+static void differentialEncode()
+{
+    // Every code unit, alone and at every offset within a vector block.
+    for (uint32_t v = 0; v < 0x10000; ++v) {
+        for (int offset = 0; offset < 9; ++offset) {
+            std::wstring in(offset, L'a');
+            in.push_back(static_cast<wchar_t>(v));
+            in.append(L"01234567");
+            checkEncode(in);
+        }
+        checkEncode(std::wstring(1, static_cast<wchar_t>(v)));
+    }
+    // Every pair of surrogates, in both orders, whether valid or not.
+    for (uint32_t hi = 0xD800; hi < 0xE000; ++hi) {
+        for (uint32_t lo = 0xD800; lo < 0xE000; ++lo) {
+            const wchar_t in[] = {
+                static_cast<wchar_t>(hi), static_cast<wchar_t>(lo),
+                L'a', L'b', L'c', L'd', L'e', L'f', L'g', L'h',
+            };
+            checkEncode(std::wstring(in, 10));
+        }
+    }
+    // Random mixtures, including a surrogate pair split by a block boundary.
+    srand(1);
+    for (int iter = 0; iter < 200000; ++iter) {
+        std::wstring in;
+        const int count = rand() % 60;
+        for (int i = 0; i < count; ++i) {
+            switch (rand() % 6) {
+                case 0: in.push_back(0xD83D); in.push_back(0xDE00); break;
+                case 1: in.push_back(0xD800 + rand() % 0x800); break;
+                case 2: in.push_back(0x80 + rand() % 0xFF80); break;
+                default: in.push_back(0x20 + rand() % 0x60); break;
+            }
+        }
+        checkEncode(in);
+    }
+}
+
+#ifdef _WIN32
 wchar_t g_wch_TEST[] = { 0xD840, 0xDC00 };
+#endif
 char g_ch_TEST[4];
-wchar_t *volatile g_pwch = g_wch_TEST;
 char *volatile g_pch = g_ch_TEST;
 unsigned int volatile g_code = 0xA2000;
 
+// Repeat `unit` to make about 1MB of text.
+static std::wstring makeText(const wchar_t *unit)
+{
+    std::wstring ret;
+    while (ret.size() < 1000000) {
+        ret += unit;
+    }
+    return ret;
+}
+
+static void bulkPerformance(const char *name, const wchar_t *unit)
+{
+    const std::wstring text = makeText(unit);
+    const int size = static_cast<int>(text.size());
+    std::vector<char> utf8(3 * size);
+    std::vector<wchar_t> utf16(3 * size);
+    const int utf8Size = encodeUtf8Run(text.data(), size, utf8.data());
+    const int iterations = 200;
+    long long sum = 0;
+    double secs[4];
+    for (int kind = 0; kind < 4; ++kind) {
+        const clock_t start = clock();
+        for (int i = 0; i < iterations; ++i) {
+            int outSize = 0;
+            switch (kind) {
+                case 0:
+                    sum += encodeUtf8RunScalar(text.data(), size, utf8.data());
+                    break;
+                case 1:
+                    sum += encodeUtf8Run(text.data(), size, utf8.data());
+                    break;
+                case 2:
+                    sum += decodeUtf8RunScalar(utf8.data(), utf8Size,
+                                               utf16.data(), outSize);
+                    break;
+                case 3:
+                    sum += decodeUtf8Run(utf8.data(), utf8Size,
+                                         utf16.data(), outSize);
+                    break;
+            }
+        }
+        secs[kind] = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+    }
+    // Throughput is in MB of UTF-8 per second.
+    const double mb = static_cast<double>(utf8Size) * iterations / 1e6;
+    printf("%-8s encode: %7.0f MB/s (scalar %7.0f)  "
+           "decode: %7.0f MB/s (scalar %7.0f)  (%lld)\n",
+           name, mb / secs[1], mb / secs[0], mb / secs[3], mb / secs[2],
+           sum);
+}
+
 static void performance()
 {
+#ifdef _WIN32
     {
+        wchar_t *volatile pwch = g_wch_TEST;
         clock_t start = clock();
         for (long long i = 0; i < 250000000LL; ++i) {
-            int mblen = WideCharToMultiByte(CP_UTF8, 0, g_pwch, 2, g_pch, 4, NULL, NULL);
+            int mblen = WideCharToMultiByte(CP_UTF8, 0, pwch, 2, g_pch, 4, NULL, NULL);
             assert(mblen == 4);
         }
         clock_t stop = clock();
         printf("%.3fns per char\n", (double)(stop - start) / CLOCKS_PER_SEC * 4.0);
     }
+#endif
 
     {
         clock_t start = clock();
@@ -169,6 +424,14 @@ static void performance()
         clock_t stop = clock();
         printf("%.3fns per char\n", (double)(stop - start) / CLOCKS_PER_SEC / 3.0);
     }
+
+    bulkPerformance("ascii",
+        L"The quick brown fox jumps over the lazy dog. 0123456789\n");
+    bulkPerformance("latin",
+        L"Na\u00EFve caf\u00E9 \u00FCber cr\u00E8me br\u00FBl\u00E9e. ");
+    bulkPerformance("cjk",
+        L"\u6F22\u5B57\u304B\u306A\u4EA4\u3058\u308A\u6587\u306E"
+        L"\u30C6\u30B9\u30C8\u3067\u3059\u3002");
 }
 
 int main()
@@ -177,13 +440,25 @@ int main()
     fflush(stdout);
     correctnessByCode();
 
+#ifdef _WIN32
     printf("Testing correctnessByUtf8Encoding... (may take a couple minutes)\n");
     fflush(stdout);
     correctnessByUtf8Encoding();
+#endif
+
+    printf("Testing decodeUtf8Run and encodeUtf8Run... "
+           "(may take a couple minutes)\n");
+    fflush(stdout);
+    differentialDecode();
+    differentialEncode();
 
     printf("Testing performance...\n");
     fflush(stdout);
     performance();
 
+    if (g_failures != 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
     return 0;
 }
@@ -28,6 +28,8 @@
 #include "../shared/DebugClient.h"
 #include "../shared/WinptyAssert.h"
 
+#include "AgentStats.h"
+
 Win32Console::Win32Console() : m_titleWorkBuf(16)
 {
     // The console window must be non-NULL.  It is used for two purposes:
@@ -97,11 +99,14 @@ void Win32Console::setFrozen(bool frozen) {
         // Enter selection mode by activating either Mark or SelectAll.
         const int command = m_freezeUsesMark ? SC_CONSOLE_MARK
                                              : SC_CONSOLE_SELECT_ALL;
+        m_freezeTime = TimeMeasurement();
         SendMessage(m_hwnd, WM_SYSCOMMAND, command, 0);
         m_frozen = true;
     } else {
         // Send Escape to cancel the selection.
         SendMessage(m_hwnd, WM_CHAR, 27, 0x00010001);
         m_frozen = false;
+        agentStats().addFreeze(
+            static_cast<uint64_t>(m_freezeTime.elapsed() * 1000000.0));
     }
 }
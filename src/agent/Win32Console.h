@@ -26,25 +26,12 @@
 #include <string>
 #include <vector>
 
-class Win32Console
+#include "../shared/TimeMeasurement.h"
+#include "ConsoleControl.h"
+
+class Win32Console : public ConsoleControl
 {
 public:
-    class FreezeGuard {
-    public:
-        FreezeGuard(Win32Console &console, bool frozen) :
-                m_console(console), m_previous(console.frozen()) {
-            m_console.setFrozen(frozen);
-        }
-        ~FreezeGuard() {
-            m_console.setFrozen(m_previous);
-        }
-        FreezeGuard(const FreezeGuard &other) = delete;
-        FreezeGuard &operator=(const FreezeGuard &other) = delete;
-    private:
-        Win32Console &m_console;
-        bool m_previous;
-    };
-
     Win32Console();
 
     HWND hwnd() { return m_hwnd; }
@@ -52,13 +39,14 @@ public:
     void setTitle(const std::wstring &title);
     void setFreezeUsesMark(bool useMark) { m_freezeUsesMark = useMark; }
     void setNewW10(bool isNewW10) { m_isNewW10 = isNewW10; }
-    bool isNewW10() { return m_isNewW10; }
-    void setFrozen(bool frozen=true);
-    bool frozen() { return m_frozen; }
+    virtual bool isNewW10() override { return m_isNewW10; }
+    virtual void setFrozen(bool frozen=true) override;
+    virtual bool frozen() override { return m_frozen; }
 
 private:
     HWND m_hwnd = nullptr;
     bool m_frozen = false;
+    TimeMeasurement m_freezeTime;
     bool m_freezeUsesMark = false;
     bool m_isNewW10 = false;
     std::vector<wchar_t> m_titleWorkBuf;
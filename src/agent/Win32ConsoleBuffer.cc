@@ -24,8 +24,12 @@
 
 #include "../shared/DebugClient.h"
 #include "../shared/StringBuilder.h"
+#include "../shared/WindowsVersion.h"
 #include "../shared/WinptyAssert.h"
 
+#include "AgentStats.h"
+#include "ConsoleFont.h"
+
 std::unique_ptr<Win32ConsoleBuffer> Win32ConsoleBuffer::openStdout() {
     return std::unique_ptr<Win32ConsoleBuffer>(
         new Win32ConsoleBuffer(GetStdHandle(STD_OUTPUT_HANDLE), false));
@@ -79,10 +83,6 @@ void Win32ConsoleBuffer::clearLines(
     }
 }
 
-void Win32ConsoleBuffer::clearAllLines(const ConsoleScreenBufferInfo &info) {
-    clearLines(0, info.bufferSize().Y, info);
-}
-
 ConsoleScreenBufferInfo Win32ConsoleBuffer::bufferInfo() {
     // TODO: error handling
     ConsoleScreenBufferInfo info;
@@ -92,14 +92,6 @@ ConsoleScreenBufferInfo Win32ConsoleBuffer::bufferInfo() {
     return info;
 }
 
-Coord Win32ConsoleBuffer::bufferSize() {
-    return bufferInfo().bufferSize();
-}
-
-SmallRect Win32ConsoleBuffer::windowRect() {
-    return bufferInfo().windowRect();
-}
-
 bool Win32ConsoleBuffer::resizeBufferRange(const Coord &initialSize,
                                            Coord &finalSize) {
     if (SetConsoleScreenBufferSize(m_conout, initialSize)) {
@@ -143,8 +135,12 @@ void Win32ConsoleBuffer::moveWindow(const SmallRect &rect) {
     }
 }
 
-Coord Win32ConsoleBuffer::cursorPosition() {
-    return bufferInfo().dwCursorPosition;
+Coord Win32ConsoleBuffer::largestWindowSize() {
+    return GetLargestConsoleWindowSize(m_conout);
+}
+
+void Win32ConsoleBuffer::setSmallFont(int columns, bool isNewW10) {
+    ::setSmallFont(m_conout, columns, isNewW10);
 }
 
 void Win32ConsoleBuffer::setCursorPosition(const Coord &coord) {
@@ -154,8 +150,20 @@ void Win32ConsoleBuffer::setCursorPosition(const Coord &coord) {
     }
 }
 
+bool Win32ConsoleBuffer::cursorVisible() {
+    // The cursor visibility has always been read from the agent's
+    // STD_OUTPUT_HANDLE rather than from this buffer.
+    CONSOLE_CURSOR_INFO cursorInfo = {};
+    if (!GetConsoleCursorInfo(GetStdHandle(STD_OUTPUT_HANDLE), &cursorInfo)) {
+        trace("GetConsoleCursorInfo failed");
+        return true;
+    }
+    return cursorInfo.bVisible != 0;
+}
+
 void Win32ConsoleBuffer::read(const SmallRect &rect, CHAR_INFO *data) {
     // TODO: error handling
+    agentStats().add(WINPTY_STAT_CELLS_READ, rect.width() * rect.height());
     SmallRect tmp(rect);
     if (!ReadConsoleOutputW(m_conout, data, rect.size(), Coord(), &tmp) &&
             isTracingEnabled()) {
@@ -186,8 +194,25 @@ void Win32ConsoleBuffer::write(const SmallRect &rect, const CHAR_INFO *data) {
     }
 }
 
+bool Win32ConsoleBuffer::largeReadsAllowed() {
+    static const bool allowed = isAtLeastWindows8();
+    return allowed;
+}
+
 void Win32ConsoleBuffer::setTextAttribute(WORD attributes) {
     if (!SetConsoleTextAttribute(m_conout, attributes)) {
         trace("SetConsoleTextAttribute failed");
     }
 }
+
+DWORD Win32ConsoleBuffer::outputMode() {
+    DWORD mode = 0;
+    if (!GetConsoleMode(m_conout, &mode)) {
+        mode = 0;
+    }
+    return mode;
+}
+
+UINT Win32ConsoleBuffer::outputCodePage() {
+    return GetConsoleOutputCP();
+}
@@ -23,26 +23,13 @@
 
 #include <windows.h>
 
-#include <string.h>
-
 #include <memory>
 
+#include "ConsoleBuffer.h"
 #include "Coord.h"
 #include "SmallRect.h"
 
-class ConsoleScreenBufferInfo : public CONSOLE_SCREEN_BUFFER_INFO {
-public:
-    ConsoleScreenBufferInfo()
-    {
-        memset(this, 0, sizeof(*this));
-    }
-
-    Coord bufferSize() const        { return dwSize;    }
-    SmallRect windowRect() const    { return srWindow;  }
-    Coord cursorPosition() const    { return dwCursorPosition; }
-};
-
-class Win32ConsoleBuffer {
+class Win32ConsoleBuffer : public ConsoleBuffer {
 private:
     Win32ConsoleBuffer(HANDLE conout, bool owned) :
         m_conout(conout), m_owned(owned)
@@ -50,8 +37,6 @@ private:
     }
 
 public:
-    static const int kDefaultAttributes = 7;
-
     ~Win32ConsoleBuffer() {
         if (m_owned) {
             CloseHandle(m_conout);
@@ -62,34 +47,33 @@ public:
     static std::unique_ptr<Win32ConsoleBuffer> openConout();
     static std::unique_ptr<Win32ConsoleBuffer> createErrorBuffer();
 
-    Win32ConsoleBuffer(const Win32ConsoleBuffer &other) = delete;
-    Win32ConsoleBuffer &operator=(const Win32ConsoleBuffer &other) = delete;
-
     HANDLE conout();
-    void clearLines(int row, int count, const ConsoleScreenBufferInfo &info);
-    void clearAllLines(const ConsoleScreenBufferInfo &info);
+    virtual void clearLines(int row, int count,
+                            const ConsoleScreenBufferInfo &info) override;
 
     // Buffer and window sizes.
-    ConsoleScreenBufferInfo bufferInfo();
-    Coord bufferSize();
-    SmallRect windowRect();
-    void resizeBuffer(const Coord &size);
-    bool resizeBufferRange(const Coord &initialSize, Coord &finalSize);
-    bool resizeBufferRange(const Coord &initialSize) {
-        Coord dummy;
-        return resizeBufferRange(initialSize, dummy);
-    }
-    void moveWindow(const SmallRect &rect);
+    virtual ConsoleScreenBufferInfo bufferInfo() override;
+    virtual void resizeBuffer(const Coord &size) override;
+    using ConsoleBuffer::resizeBufferRange;
+    virtual bool resizeBufferRange(const Coord &initialSize,
+                                   Coord &finalSize) override;
+    virtual void moveWindow(const SmallRect &rect) override;
+    virtual Coord largestWindowSize() override;
+    virtual void setSmallFont(int columns, bool isNewW10) override;
 
     // Cursor.
-    Coord cursorPosition();
-    void setCursorPosition(const Coord &point);
+    virtual void setCursorPosition(const Coord &point) override;
+    virtual bool cursorVisible() override;
 
     // Screen content.
-    void read(const SmallRect &rect, CHAR_INFO *data);
-    void write(const SmallRect &rect, const CHAR_INFO *data);
+    virtual void read(const SmallRect &rect, CHAR_INFO *data) override;
+    virtual void write(const SmallRect &rect, const CHAR_INFO *data) override;
+    virtual bool largeReadsAllowed() override;
+
+    virtual void setTextAttribute(WORD attributes) override;
 
-    void setTextAttribute(WORD attributes);
+    virtual DWORD outputMode() override;
+    virtual UINT outputCodePage() override;
 
 private:
     HANDLE m_conout = nullptr;
@@ -33,7 +33,8 @@
 #include "DebugShowInput.h"
 
 const char USAGE[] =
-"Usage: %ls controlPipeName flags mouseMode cols rows\n"
+"Usage: %ls controlPipeName flags mouseMode cols rows minPollMs maxPollMs\n"
+"           backlogHighBytes backlogLowBytes maxCols maxRows bufferRows\n"
 "Usage: %ls controlPipeName --create-desktop\n"
 "\n"
 "Ordinarily, this program is launched by winpty.dll and is not directly\n"
@@ -96,16 +97,26 @@ int main() {
         return 0;
     }
 
-    if (argc != 6) {
+    if (argc != 13) {
         fprintf(stderr, USAGE, argv[0], argv[0], argv[0]);
         return 1;
     }
 
+    ConsoleLimits limits;
+    limits.maxWidth = atoi(utf8FromWide(argv[10]).c_str());
+    limits.maxHeight = atoi(utf8FromWide(argv[11]).c_str());
+    limits.bufferLineCount = atoi(utf8FromWide(argv[12]).c_str());
+
     Agent agent(argv[1],
                 winpty_atoi64(utf8FromWide(argv[2]).c_str()),
                 atoi(utf8FromWide(argv[3]).c_str()),
                 atoi(utf8FromWide(argv[4]).c_str()),
-                atoi(utf8FromWide(argv[5]).c_str()));
+                atoi(utf8FromWide(argv[5]).c_str()),
+                atoi(utf8FromWide(argv[6]).c_str()),
+                atoi(utf8FromWide(argv[7]).c_str()),
+                strtoul(utf8FromWide(argv[8]).c_str(), NULL, 10),
+                strtoul(utf8FromWide(argv[9]).c_str(), NULL, 10),
+                limits);
     agent.run();
 
     // The Agent destructor shouldn't return, but if it does, exit
@@ -25,6 +25,7 @@ $(eval $(call def_mingw_target,agent,-DWINPTY_AGENT_ASSERT))
 AGENT_OBJECTS = \
 	build/agent/agent/Agent.o \
 	build/agent/agent/AgentCreateDesktop.o \
+	build/agent/agent/CellScan.o \
 	build/agent/agent/ConsoleFont.o \
 	build/agent/agent/ConsoleInput.o \
 	build/agent/agent/ConsoleInputReencoding.o \
@@ -33,8 +34,10 @@ AGENT_OBJECTS = \
 	build/agent/agent/DefaultInputMap.o \
 	build/agent/agent/EventLoop.o \
 	build/agent/agent/InputMap.o \
+	build/agent/agent/KeyboardLayoutCache.o \
 	build/agent/agent/LargeConsoleRead.o \
 	build/agent/agent/NamedPipe.o \
+	build/agent/agent/OutputQueue.o \
 	build/agent/agent/Scraper.o \
 	build/agent/agent/Terminal.o \
 	build/agent/agent/Win32Console.o \
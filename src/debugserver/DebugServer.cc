@@ -40,7 +40,9 @@ static void usage(const char *program, int code) {
            "\n"
            "Use the WINPTY_DEBUG environment variable to enable winpty trace output.\n"
            "(e.g. WINPTY_DEBUG=trace for the default trace output.)  Set WINPTYDBG=1\n"
-           "to enable trace with older winpty versions.\n",
+           "to enable trace with older winpty versions.  Set WINPTY_TRACE_FILE to\n"
+           "write trace output to per-process binary files instead, and decode\n"
+           "them with misc/DecodeTrace.py.\n",
            program, kPipeName);
     exit(code);
 }
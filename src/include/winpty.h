@@ -106,6 +106,39 @@ winpty_config_set_mouse_mode(winpty_config_t *cfg, int mouseMode);
 WINPTY_API void
 winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs);
 
+/* Bounds on how often the agent polls the console for changes, in
+ * milliseconds.  The agent polls every minMs while the console is active and
+ * backs off exponentially toward maxMs while it is idle.  Input from the
+ * terminal resets the interval to minMs.  The defaults are 25 and 200.  Pass
+ * the same value twice for a fixed interval.  minMs must be greater than 0
+ * and no greater than maxMs. */
+WINPTY_API void
+winpty_config_set_poll_interval(winpty_config_t *cfg,
+                                DWORD minMs, DWORD maxMs);
+
+/* Limits on the terminal output the agent queues when the client reads
+ * CONOUT or CONERR more slowly than the console produces output.  Once more
+ * than highBytes are waiting to be read, the agent stops scraping the console
+ * until no more than lowBytes are waiting, then sends the console's current
+ * state, skipping the intermediate screen states.  The defaults are 262144
+ * and 16384.  A highBytes of 0 removes the limit.  lowBytes must be no
+ * greater than highBytes. */
+WINPTY_API void
+winpty_config_set_output_backlog(winpty_config_t *cfg,
+                                 DWORD highBytes, DWORD lowBytes);
+
+/* Limits on the console size.  Larger terminal sizes are clipped to maxCols
+ * and maxRows.  bufferRows is the height of the console screen buffer, which
+ * holds the console's scrollback.  The agent's memory use grows with the
+ * window size rather than with bufferRows, but the console itself allocates
+ * the whole buffer.  The defaults are 2500, 2000, and 3000.  All three must
+ * be greater than 0 and no greater than 32766, and bufferRows must be at
+ * least maxRows + 1000.  Prior to Windows 8, the agent never exceeds the
+ * defaults. */
+WINPTY_API void
+winpty_config_set_console_limits(winpty_config_t *cfg,
+                                 int maxCols, int maxRows, int bufferRows);
+
 
 
 /*****************************************************************************
@@ -218,11 +251,31 @@ WINPTY_API BOOL
 winpty_set_size(winpty_t *wp, int cols, int rows,
                 winpty_error_ptr_t *err /*OPTIONAL*/);
 
+/* Like winpty_set_size, but returns without waiting for the agent to resize
+ * the console.  The agent keeps only the latest size it has received and
+ * applies it in place of its next scrape of the console (which is delayed
+ * while the terminal is behind on output), so a client can call this for
+ * every step of a window drag.  A later winpty_set_size call takes precedence over an
+ * earlier winpty_set_size_async call that hasn't been applied yet. */
+WINPTY_API BOOL
+winpty_set_size_async(winpty_t *wp, int cols, int rows,
+                      winpty_error_ptr_t *err /*OPTIONAL*/);
+
 /* Gets a list of processes attached to the console. */
 WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
                                 winpty_error_ptr_t *err /*OPTIONAL*/);
 
+/* Gets the agent's statistics.  values[i] receives the statistic with index
+ * i (see WINPTY_STAT_* in winpty_constants.h), for each i less than both
+ * valueCount and the number of statistics the agent keeps.  Returns the
+ * number the agent keeps, which is WINPTY_STAT_COUNT for this version of
+ * winpty, or 0 on failure.  Collecting the statistics is cheap, and they are
+ * always kept. */
+WINPTY_API int
+winpty_get_stats(winpty_t *wp, UINT64 *values, int valueCount,
+                 winpty_error_ptr_t *err /*OPTIONAL*/);
+
 /* Frees the winpty_t object and the OS resources contained in it.  This
  * call breaks the connection with the agent, which should then close its
  * console, terminating the processes attached to it.
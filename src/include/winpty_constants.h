@@ -76,11 +76,32 @@
  * See https://github.com/rprichard/winpty/issues/58. */
 #define WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION 0x8ull
 
+/* Track scraped console lines by hashing them rather than keeping a copy of
+ * each line.  This reduces the agent's memory use for wide consoles.  The
+ * output is the same, except that a line whose text was truncated by
+ * narrowing the terminal may be resent when the terminal is widened again. */
+#define WINPTY_FLAG_LINE_HASHING        0x10ull
+
+/* Output binary frames describing the console's cells instead of VT escape
+ * sequences.  See "Binary frame output" below.  WINPTY_FLAG_PLAIN_OUTPUT
+ * and WINPTY_FLAG_COLOR_ESCAPES are ignored.  Terminal input is unchanged. */
+#define WINPTY_FLAG_BINARY_FRAMES       0x20ull
+
+/* Enable the terminal's bracketed paste mode (ESC[?2004h).  The agent then
+ * types the text between the ESC[200~ and ESC[201~ markers literally, without
+ * decoding escape sequences, and holds back a large paste while the console's
+ * input buffer is full.  Without this flag, the markers are not recognized.
+ * A paste that has no end marker ends after a second without input. */
+#define WINPTY_FLAG_BRACKETED_PASTE     0x40ull
+
 #define WINPTY_FLAG_MASK (0ull \
     | WINPTY_FLAG_CONERR \
     | WINPTY_FLAG_PLAIN_OUTPUT \
     | WINPTY_FLAG_COLOR_ESCAPES \
     | WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION \
+    | WINPTY_FLAG_LINE_HASHING \
+    | WINPTY_FLAG_BINARY_FRAMES \
+    | WINPTY_FLAG_BRACKETED_PASTE \
 )
 
 /* QuickEdit mode is initially disabled, and the agent does not send mouse
@@ -128,4 +149,144 @@
 
 
 
+/*****************************************************************************
+ * Binary frame output.
+ *
+ * With WINPTY_FLAG_BINARY_FRAMES, each output pipe carries a sequence of
+ * frames, one for each time the agent updates the terminal.  A frame is:
+ *
+ *   - WINPTY_FRAME_MAGIC (one byte)
+ *   - WINPTY_FRAME_VERSION (one byte)
+ *   - the payload size, as a 32-bit little-endian integer
+ *   - the payload: a sequence of records, each an opcode byte followed by
+ *     its fields
+ *
+ * A client should reject a frame with a different magic byte or version.
+ * Numeric fields are unsigned LEB128 varints (seven bits per byte, least
+ * significant first, with the high bit set on all but the last byte).
+ * Strings are a byte count followed by that many bytes of UTF-8.
+ *
+ * The records describe a screen the size of the console window.  Lines are
+ * numbered from the RESET record's line, which is shown on the top row.  A
+ * line below the bottom row scrolls the screen up until that line is on the
+ * bottom row, like line feeds on a terminal.  Lines above the top row are not
+ * shown.  A client applies a whole frame before redrawing, so that it never
+ * shows a partial update.
+ *
+ * Cell attributes are the console's CHAR_INFO attributes: the foreground
+ * and background color bits, COMMON_LVB_REVERSE_VIDEO, and
+ * COMMON_LVB_UNDERSCORE.  The other bits are always zero. */
+
+#define WINPTY_FRAME_MAGIC                  0xF7
+#define WINPTY_FRAME_VERSION                1
+
+/* Fields: line.  Clear the screen to blanks in the default attributes
+ * (0x07) and show `line` on the top row. */
+#define WINPTY_FRAME_RESET                  1
+
+/* Fields: line, column, cell count, run count, runs, text, erase.  Replace
+ * `cell count` cells of the line starting at `column`.  Each run is an
+ * attribute value and a cell count, and the runs' cell counts add up to
+ * `cell count`.  The text has one Unicode character for each cell, except
+ * that a character covering more than one cell (e.g. a full-width CJK
+ * character) is followed by a NUL (U+0000) for each extra cell.  If `erase`
+ * is non-zero, the rest of the line is then cleared to blanks with
+ * attributes `erase - 1`. */
+#define WINPTY_FRAME_LINE                   2
+
+/* Fields: line, column.  Show the cursor at the given position. */
+#define WINPTY_FRAME_CURSOR                 3
+
+/* No fields.  Hide the cursor. */
+#define WINPTY_FRAME_HIDE_CURSOR            4
+
+/* Fields: top, bottom, count.  Scroll the screen rows from `top` to `bottom`
+ * (inclusive, counting from 0 at the top of the screen) up or down by
+ * `count` rows, and clear the exposed rows to blanks in the default
+ * attributes.  Line numbering is unchanged. */
+#define WINPTY_FRAME_SCROLL_UP              5
+#define WINPTY_FRAME_SCROLL_DOWN            6
+
+/* Fields: mode bits.  The terminal modes the agent would otherwise enable
+ * with escape sequences.  With WINPTY_FRAME_MODE_MOUSE, the client should
+ * send mouse input as SGR (1006) mouse escape sequences.  With
+ * WINPTY_FRAME_MODE_BRACKETED_PASTE, it should wrap pasted text in
+ * ESC[200~ and ESC[201~. */
+#define WINPTY_FRAME_MODES                  7
+#define WINPTY_FRAME_MODE_MOUSE             1
+#define WINPTY_FRAME_MODE_BRACKETED_PASTE   2
+
+/* Fields: string.  The console title changed. */
+#define WINPTY_FRAME_TITLE                  8
+
+
+
+/*****************************************************************************
+ * winpty agent RPC call: statistics.
+ *
+ * winpty_get_stats fills an array of 64-bit values, indexed by these
+ * constants.  Counters start at zero when the agent starts and only grow. */
+
+/* The number of times the agent scraped the console. */
+#define WINPTY_STAT_SCRAPE_COUNT            0
+
+/* The total time spent scraping, in microseconds. */
+#define WINPTY_STAT_SCRAPE_MICROSECONDS     1
+
+/* The number of CHAR_INFO cells read with ReadConsoleOutputW. */
+#define WINPTY_STAT_CELLS_READ              2
+
+/* The number of scraped lines the agent found to differ from the last
+ * scrape, including new lines. */
+#define WINPTY_STAT_LINES_CHANGED           3
+
+/* The number of lines sent to the terminal.  Once the agent finds a changed
+ * line in the scrollback, it resends the lines below it without comparing
+ * them, so this can exceed WINPTY_STAT_LINES_CHANGED. */
+#define WINPTY_STAT_LINES_SENT              4
+
+/* The number of bytes of terminal output (text and escape sequences) the
+ * agent generated. */
+#define WINPTY_STAT_OUTPUT_BYTES            5
+
+/* The number of output bytes queued for the terminal pipes as of the last
+ * poll, and the largest such number seen. */
+#define WINPTY_STAT_OUTPUT_QUEUE_BYTES      6
+#define WINPTY_STAT_OUTPUT_QUEUE_MAX_BYTES  7
+
+/* The number of bytes of terminal input the agent decoded. */
+#define WINPTY_STAT_INPUT_BYTES             8
+
+/* The number of INPUT_RECORD values written to the console. */
+#define WINPTY_STAT_INPUT_RECORDS           9
+
+/* A histogram of scrape durations.  The value at
+ * WINPTY_STAT_SCRAPE_HISTOGRAM + i counts the scrapes that took less than
+ * 2^(i+6) microseconds but at least 2^(i+5).  The first bucket also counts
+ * scrapes shorter than 32us, and the last counts everything longer. */
+#define WINPTY_STAT_SCRAPE_HISTOGRAM        10
+#define WINPTY_STAT_HISTOGRAM_BUCKETS       16
+
+/* The number of times the agent froze the console (by putting it into
+ * selection mode), and the total time it stayed frozen, in microseconds.
+ * Console programs that write output block while the console is frozen. */
+#define WINPTY_STAT_FREEZE_COUNT            26
+#define WINPTY_STAT_FREEZE_MICROSECONDS     27
+
+/* A histogram of freeze durations, bucketed like
+ * WINPTY_STAT_SCRAPE_HISTOGRAM. */
+#define WINPTY_STAT_FREEZE_HISTOGRAM        28
+
+/* In scrolling mode, the agent finds out how far the console buffer has
+ * scrolled by looking for a marker it wrote into the buffer.  These count
+ * the searches that found the marker where the agent predicted, and the ones
+ * that had to read further up the buffer (or didn't find it). */
+#define WINPTY_STAT_SYNC_MARKER_HITS        44
+#define WINPTY_STAT_SYNC_MARKER_MISSES      45
+
+/* The number of statistics. */
+#define WINPTY_STAT_COUNT                   46
+
+
+
 #endif /* WINPTY_CONSTANTS_H */
@@ -47,6 +47,13 @@ struct winpty_config_s {
     int rows = 25;
     int mouseMode = WINPTY_MOUSE_MODE_AUTO;
     DWORD timeoutMs = 30000;
+    DWORD minPollMs = 25;
+    DWORD maxPollMs = 200;
+    DWORD outputBacklogHigh = 256 * 1024;
+    DWORD outputBacklogLow = 16 * 1024;
+    int maxCols = 2500;
+    int maxRows = 2000;
+    int bufferRows = 3000;
 };
 
 struct winpty_s {
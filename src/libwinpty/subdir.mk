@@ -44,3 +44,17 @@ build/winpty.dll : $(LIBWINPTY_OBJECTS)
 	@$(MINGW_CXX) $(MINGW_LDFLAGS) -shared -o $@ $^ -Wl,--out-implib,build/winpty.lib
 
 -include $(LIBWINPTY_OBJECTS:.o=.d)
+
+# The reference decoder for WINPTY_FLAG_BINARY_FRAMES output, which clients
+# link statically.
+ALL_TARGETS += build/libwinpty-frame-decoder.a
+
+FRAME_DECODER_OBJECTS = \
+	build/libwinpty/shared/FrameDecoder.o
+
+build/libwinpty-frame-decoder.a : $(FRAME_DECODER_OBJECTS)
+	$(info Archiving $@)
+	@rm -f $@
+	@$(MINGW_AR) rcs $@ $^
+
+-include $(FRAME_DECODER_OBJECTS:.o=.d)
@@ -187,6 +187,35 @@ winpty_config_set_agent_timeout(winpty_config_t *cfg, DWORD timeoutMs) {
     cfg->timeoutMs = timeoutMs;
 }
 
+WINPTY_API void
+winpty_config_set_poll_interval(winpty_config_t *cfg,
+                                DWORD minMs, DWORD maxMs) {
+    ASSERT(cfg != nullptr && minMs > 0 && minMs <= maxMs &&
+        maxMs <= static_cast<DWORD>(std::numeric_limits<int>::max()));
+    cfg->minPollMs = minMs;
+    cfg->maxPollMs = maxMs;
+}
+
+WINPTY_API void
+winpty_config_set_output_backlog(winpty_config_t *cfg,
+                                 DWORD highBytes, DWORD lowBytes) {
+    ASSERT(cfg != nullptr && lowBytes <= highBytes);
+    cfg->outputBacklogHigh = highBytes;
+    cfg->outputBacklogLow = lowBytes;
+}
+
+WINPTY_API void
+winpty_config_set_console_limits(winpty_config_t *cfg,
+                                 int maxCols, int maxRows, int bufferRows) {
+    ASSERT(cfg != nullptr &&
+        maxCols > 0 && maxCols <= 32766 &&
+        maxRows > 0 &&
+        bufferRows >= maxRows + 1000 && bufferRows <= 32766);
+    cfg->maxCols = maxCols;
+    cfg->maxRows = maxRows;
+    cfg->bufferRows = bufferRows;
+}
+
 
 
 /*****************************************************************************
@@ -656,7 +685,14 @@ winpty_open(const winpty_config_t *cfg,
                 << cfg->flags << L' '
                 << cfg->mouseMode << L' '
                 << cfg->cols << L' '
-                << cfg->rows).str_moved();
+                << cfg->rows << L' '
+                << cfg->minPollMs << L' '
+                << cfg->maxPollMs << L' '
+                << cfg->outputBacklogHigh << L' '
+                << cfg->outputBacklogLow << L' '
+                << cfg->maxCols << L' '
+                << cfg->maxRows << L' '
+                << cfg->bufferRows).str_moved();
         auto wp = createAgentSession(cfg, desktopName, params,
                                      CREATE_NEW_CONSOLE);
 
@@ -935,6 +971,23 @@ winpty_set_size(winpty_t *wp, int cols, int rows,
     } API_CATCH(FALSE)
 }
 
+WINPTY_API BOOL
+winpty_set_size_async(winpty_t *wp, int cols, int rows,
+                      winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr && cols > 0 && rows > 0);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::SetSizeAsync);
+        packet.putInt32(cols);
+        packet.putInt32(rows);
+        writePacket(*wp, packet);
+        rpc.success();
+        return TRUE;
+    } API_CATCH(FALSE)
+}
+
 WINPTY_API int
 winpty_get_console_process_list(winpty_t *wp, int *processList, const int processCount,
                                 winpty_error_ptr_t *err /*OPTIONAL*/) {
@@ -962,6 +1015,33 @@ winpty_get_console_process_list(winpty_t *wp, int *processList, const int proces
     } API_CATCH(0)
 }
 
+WINPTY_API int
+winpty_get_stats(winpty_t *wp, UINT64 *values, int valueCount,
+                 winpty_error_ptr_t *err /*OPTIONAL*/) {
+    API_TRY {
+        ASSERT(wp != nullptr);
+        ASSERT(values != nullptr || valueCount == 0);
+        LockGuard<Mutex> lock(wp->mutex);
+        RpcOperation rpc(*wp);
+        auto packet = newPacket();
+        packet.putInt32(AgentMsg::GetStats);
+        writePacket(*wp, packet);
+        auto reply = readPacket(*wp);
+
+        const auto statCount = reply.getInt32();
+        for (auto i = 0; i < statCount; i++) {
+            const auto value = reply.getInt64();
+            if (i < valueCount) {
+                values[i] = value;
+            }
+        }
+
+        reply.assertEof();
+        rpc.success();
+        return statCount;
+    } API_CATCH(0)
+}
+
 WINPTY_API void winpty_free(winpty_t *wp) {
     // At least in principle, CloseHandle can fail, so this deletion can
     // fail.  It won't throw an exception, but maybe there's an error that
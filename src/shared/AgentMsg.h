@@ -27,6 +27,8 @@ struct AgentMsg
         StartProcess,
         SetSize,
         GetConsoleProcessList,
+        GetStats,
+        SetSizeAsync,
     };
 };
 
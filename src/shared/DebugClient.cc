@@ -28,10 +28,20 @@
 #include <algorithm>
 #include <string>
 
+#include "Mutex.h"
+#include "TraceRing.h"
 #include "winpty_snprintf.h"
 
 const wchar_t *const kPipeName = L"\\\\.\\pipe\\DebugServer";
 
+// DebugServer reads messages of up to this size.  A batch of trace lines is
+// sent as one message, with the lines separated by newlines.
+const size_t kDebugServerMessageSize = 4096;
+
+// The flusher thread wakes up this often, or sooner if the trace ring is
+// half full.
+const DWORD kTraceFlushIntervalMs = 50;
+
 void *volatile g_debugConfig;
 
 namespace {
@@ -50,7 +60,7 @@ private:
 
 } // anonymous namespace
 
-static void sendToDebugServer(const char *message)
+static void sendToDebugServer(const char *message, size_t size)
 {
     HANDLE tracePipe = INVALID_HANDLE_VALUE;
 
@@ -76,7 +86,7 @@ static void sendToDebugServer(const char *message)
         char response[16];
         DWORD actual = 0;
         TransactNamedPipe(tracePipe,
-            const_cast<char*>(message), strlen(message),
+            const_cast<char*>(message), size,
             response, sizeof(response), &actual, NULL);
         CloseHandle(tracePipe);
     }
@@ -95,6 +105,266 @@ static long long unixTimeMillis()
     return msTime - 134774LL * 24 * 3600 * 1000;
 }
 
+namespace {
+
+// The state behind trace().  trace() formats its message and pushes it onto a
+// TraceRing, and a background thread drains the ring and sends the records to
+// DebugServer, a batch of lines per pipe message.  If WINPTY_TRACE_FILE is
+// set, the records are instead appended to the file "<value>.<pid>" in the
+// binary format below, which misc/DecodeTrace.py converts to text:
+//
+//     header:  "winptytr"  uint32 version (1)  uint32 pid
+//              uint64 QPC frequency  uint64 QPC at start
+//              int64 Unix time at start in ms
+//              uint16 module name length  module name
+//     record:  uint64 QPC  uint32 thread ID  uint16 length  text
+//
+// All integers are little-endian.
+class TraceLog {
+public:
+    TraceLog();
+    void start();
+    void append(const char *text, size_t length);
+    void flush(bool wait);
+
+private:
+    static DWORD WINAPI flusherThread(void *param);
+    void drain();
+    void appendLine(const TraceRecord &record);
+    void appendBinary(const TraceRecord &record);
+    void sendBatch();
+
+    TraceRing m_ring;
+    Mutex m_drainLock;
+    HANDLE m_wakeEvent = nullptr;
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    long long m_qpcFrequency = 1;
+    long long m_qpcStart = 0;
+    long long m_unixMillisStart = 0;
+    DWORD m_pid = 0;
+    char m_moduleName[MAX_PATH] = {};
+    volatile LONG m_dropped = 0;
+    std::string m_batch;
+};
+
+template <typename T>
+void appendBytes(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+TraceLog::TraceLog()
+{
+    LARGE_INTEGER value;
+    QueryPerformanceFrequency(&value);
+    m_qpcFrequency = value.QuadPart;
+    QueryPerformanceCounter(&value);
+    m_qpcStart = value.QuadPart;
+    m_unixMillisStart = unixTimeMillis();
+    m_pid = GetCurrentProcessId();
+
+    char path[MAX_PATH];
+    path[0] = '\0';
+    GetModuleFileNameA(NULL, path, sizeof(path));
+    path[sizeof(path) - 1] = '\0';
+    const char *baseName = strrchr(path, '\\');
+    baseName = (baseName != NULL) ? baseName + 1 : path;
+    winpty_snprintf(m_moduleName, "%s", baseName);
+}
+
+void TraceLog::start()
+{
+    LockGuard<Mutex> guard(m_drainLock);
+
+    char path[MAX_PATH];
+    const DWORD pathSize =
+        GetEnvironmentVariableA("WINPTY_TRACE_FILE", path, sizeof(path));
+    if (pathSize > 0 && pathSize < sizeof(path)) {
+        char fileName[MAX_PATH + 16];
+        winpty_snprintf(fileName, "%s.%u", path,
+                        static_cast<unsigned>(m_pid));
+        m_file = CreateFileA(fileName, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        const uint16_t nameLength = strlen(m_moduleName);
+        m_batch.append("winptytr");
+        appendBytes(m_batch, static_cast<uint32_t>(1));
+        appendBytes(m_batch, static_cast<uint32_t>(m_pid));
+        appendBytes(m_batch, static_cast<uint64_t>(m_qpcFrequency));
+        appendBytes(m_batch, static_cast<uint64_t>(m_qpcStart));
+        appendBytes(m_batch, static_cast<int64_t>(m_unixMillisStart));
+        appendBytes(m_batch, nameLength);
+        m_batch.append(m_moduleName, nameLength);
+        sendBatch();
+    }
+
+    // The flusher thread runs until the process exits, so keep the module
+    // (possibly winpty.dll) loaded.
+    HMODULE module = NULL;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                           GET_MODULE_HANDLE_EX_FLAG_PIN,
+                       reinterpret_cast<LPCWSTR>(&flusherThread), &module);
+    m_wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    HANDLE thread = CreateThread(NULL, 0, flusherThread, this, 0, NULL);
+    if (thread != NULL) {
+        CloseHandle(thread);
+    }
+}
+
+void TraceLog::append(const char *text, size_t length)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    const DWORD threadId = GetCurrentThreadId();
+    int attempts = 0;
+    while (!m_ring.push(now.QuadPart, threadId, text, length)) {
+        // The ring is full.  Drain it on this thread unless another thread is
+        // already draining it.  If the other thread never finishes (e.g. it
+        // was killed at process exit), give up on this record eventually.
+        if (m_drainLock.tryLock()) {
+            drain();
+            m_drainLock.unlock();
+        } else if (++attempts >= 100) {
+            InterlockedIncrement(&m_dropped);
+            return;
+        } else {
+            Sleep(1);
+        }
+    }
+    if (m_ring.approxSize() >= TraceRing::kSlotCount / 2 &&
+            m_wakeEvent != nullptr) {
+        SetEvent(m_wakeEvent);
+    }
+}
+
+void TraceLog::flush(bool wait)
+{
+    if (wait) {
+        m_drainLock.lock();
+    } else if (!m_drainLock.tryLock()) {
+        return;
+    }
+    drain();
+    m_drainLock.unlock();
+}
+
+DWORD WINAPI TraceLog::flusherThread(void *param)
+{
+    TraceLog &log = *static_cast<TraceLog*>(param);
+    while (true) {
+        WaitForSingleObject(log.m_wakeEvent, kTraceFlushIntervalMs);
+        log.flush(true);
+    }
+    return 0;
+}
+
+// Must be called with m_drainLock held.
+void TraceLog::drain()
+{
+    while (const TraceRecord *record = m_ring.front()) {
+        if (m_file != INVALID_HANDLE_VALUE) {
+            appendBinary(*record);
+        } else {
+            appendLine(*record);
+        }
+        m_ring.pop();
+    }
+    m_ring.publishTail();
+    const LONG dropped = InterlockedExchange(&m_dropped, 0);
+    if (dropped > 0) {
+        TraceRecord note;
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        note.time = now.QuadPart;
+        note.threadId = GetCurrentThreadId();
+        winpty_snprintf(note.text, "%d trace messages were dropped",
+                        static_cast<int>(dropped));
+        note.length = strlen(note.text);
+        if (m_file != INVALID_HANDLE_VALUE) {
+            appendBinary(note);
+        } else {
+            appendLine(note);
+        }
+    }
+    sendBatch();
+}
+
+void TraceLog::appendLine(const TraceRecord &record)
+{
+    const long long unixMillis = m_unixMillisStart +
+        (static_cast<long long>(record.time) - m_qpcStart) * 1000 /
+            m_qpcFrequency;
+    const int currentTime = (int)(unixMillis % (100000 * 1000));
+    char line[1200];
+    winpty_snprintf(line,
+             "[%05d.%03d %s,p%04d,t%04d]: %.*s",
+             currentTime / 1000, currentTime % 1000,
+             m_moduleName, (int)m_pid, (int)record.threadId,
+             (int)record.length, record.text);
+    const size_t size = strlen(line);
+    if (!m_batch.empty() &&
+            m_batch.size() + 1 + size > kDebugServerMessageSize) {
+        sendBatch();
+    }
+    if (!m_batch.empty()) {
+        m_batch.push_back('\n');
+    }
+    m_batch.append(line, size);
+}
+
+void TraceLog::appendBinary(const TraceRecord &record)
+{
+    appendBytes(m_batch, static_cast<uint64_t>(record.time));
+    appendBytes(m_batch, static_cast<uint32_t>(record.threadId));
+    appendBytes(m_batch, static_cast<uint16_t>(record.length));
+    m_batch.append(record.text, record.length);
+    if (m_batch.size() >= 64 * 1024) {
+        sendBatch();
+    }
+}
+
+void TraceLog::sendBatch()
+{
+    if (m_batch.empty()) {
+        return;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        DWORD actual = 0;
+        WriteFile(m_file, m_batch.data(), m_batch.size(), &actual, NULL);
+    } else {
+        sendToDebugServer(m_batch.data(), m_batch.size());
+    }
+    m_batch.clear();
+}
+
+void *volatile g_traceLog;
+
+void flushTraceAtExit()
+{
+    // Other threads are gone by now, perhaps killed while holding the drain
+    // lock, so don't wait for it.
+    static_cast<TraceLog*>(g_traceLog)->flush(false);
+}
+
+TraceLog &traceLog()
+{
+    if (g_traceLog == NULL) {
+        TraceLog *newLog = new TraceLog;
+        void *oldValue = InterlockedCompareExchangePointer(
+            &g_traceLog, newLog, NULL);
+        if (oldValue != NULL) {
+            delete newLog;
+        } else {
+            newLog->start();
+            atexit(flushTraceAtExit);
+        }
+    }
+    return *static_cast<TraceLog*>(g_traceLog);
+}
+
+} // anonymous namespace
+
 static const char *getDebugConfig()
 {
     if (g_debugConfig == NULL) {
@@ -167,21 +437,15 @@ void trace(const char *format, ...)
     message[sizeof(message) - 1] = '\0';
     va_end(ap);
 
-    const int currentTime = (int)(unixTimeMillis() % (100000 * 1000));
-
-    char moduleName[1024];
-    moduleName[0] = '\0';
-    GetModuleFileNameA(NULL, moduleName, sizeof(moduleName));
-    const char *baseName = strrchr(moduleName, '\\');
-    baseName = (baseName != NULL) ? baseName + 1 : moduleName;
-
-    char fullMessage[1024];
-    winpty_snprintf(fullMessage,
-             "[%05d.%03d %s,p%04d,t%04d]: %s",
-             currentTime / 1000, currentTime % 1000,
-             baseName, (int)GetCurrentProcessId(), (int)GetCurrentThreadId(),
-             message);
-    fullMessage[sizeof(fullMessage) - 1] = '\0';
+    traceLog().append(message, strlen(message));
+}
 
-    sendToDebugServer(fullMessage);
+// Write out the buffered trace messages now, rather than waiting for the
+// background thread, e.g. because the process is about to exit.
+void flushTrace()
+{
+    if (isTracingEnabled() && g_traceLog != NULL) {
+        PreserveLastError preserve;
+        traceLog().flush(true);
+    }
 }
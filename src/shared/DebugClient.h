@@ -26,6 +26,7 @@
 bool isTracingEnabled();
 bool hasDebugFlag(const char *flag);
 void trace(const char *format, ...) WINPTY_SNPRINTF_FORMAT(1, 2);
+void flushTrace();
 
 // This macro calls trace without evaluating the arguments.
 #define TRACE(format, ...)                          \
@@ -0,0 +1,314 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "FrameDecoder.h"
+
+#include <algorithm>
+
+#include "../include/winpty_constants.h"
+
+namespace {
+
+const size_t kHeaderSize = 6;
+const uint16_t kDefaultAttributes = 0x07;
+
+const FrameDecoder::Cell kBlankCell = { ' ', kDefaultAttributes };
+
+bool readVarint(const uint8_t *&p, const uint8_t *end, uint64_t &out) {
+    out = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        const uint8_t byte = *p++;
+        out |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads a varint that must fit in an int.
+bool readInt(const uint8_t *&p, const uint8_t *end, int &out) {
+    uint64_t value;
+    if (!readVarint(p, end, value) || value > 0x7FFFFFFF) {
+        return false;
+    }
+    out = static_cast<int>(value);
+    return true;
+}
+
+// Decodes one character of the UTF-8 text in [p, end), which is not empty.
+// Invalid bytes decode to U+FFFD, one at a time.
+uint32_t readUtf8(const uint8_t *&p, const uint8_t *end) {
+    const uint8_t lead = *p++;
+    if (lead < 0x80) {
+        return lead;
+    }
+    int extra = 0;
+    uint32_t ch = 0;
+    if ((lead & 0xE0) == 0xC0) {
+        extra = 1;
+        ch = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        extra = 2;
+        ch = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        extra = 3;
+        ch = lead & 0x07;
+    } else {
+        return 0xFFFD;
+    }
+    if (end - p < extra) {
+        return 0xFFFD;
+    }
+    for (int i = 0; i < extra; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        ch = (ch << 6) | (p[i] & 0x3F);
+    }
+    p += extra;
+    return ch;
+}
+
+} // anonymous namespace
+
+FrameDecoder::FrameDecoder(int cols, int rows) :
+    m_cols(std::max(cols, 1)),
+    m_rows(std::max(rows, 1)),
+    m_cells(m_cols * m_rows, kBlankCell)
+{
+}
+
+bool FrameDecoder::feed(const void *data, size_t size) {
+    if (m_failed) {
+        return false;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    m_pending.insert(m_pending.end(), bytes, bytes + size);
+    size_t pos = 0;
+    while (m_pending.size() - pos >= kHeaderSize) {
+        const uint8_t *header = &m_pending[pos];
+        if (header[0] != WINPTY_FRAME_MAGIC ||
+                header[1] != WINPTY_FRAME_VERSION) {
+            m_failed = true;
+            return false;
+        }
+        const size_t payloadSize =
+            header[2] | (header[3] << 8) | (header[4] << 16) |
+            (static_cast<size_t>(header[5]) << 24);
+        if (m_pending.size() - pos - kHeaderSize < payloadSize) {
+            break;
+        }
+        const uint8_t *payload = header + kHeaderSize;
+        if (!decodeFrame(payload, payload + payloadSize)) {
+            m_failed = true;
+            return false;
+        }
+        m_frameCount++;
+        pos += kHeaderSize + payloadSize;
+    }
+    m_pending.erase(m_pending.begin(), m_pending.begin() + pos);
+    return true;
+}
+
+bool FrameDecoder::decodeFrame(const uint8_t *p, const uint8_t *end) {
+    while (p < end) {
+        const int opcode = *p++;
+        uint64_t line;
+        int column, top, bottom, count, length;
+        switch (opcode) {
+            case WINPTY_FRAME_RESET:
+                if (!readVarint(p, end, line)) {
+                    return false;
+                }
+                clearRows(0, m_rows - 1);
+                m_topLine = static_cast<int64_t>(line);
+                break;
+            case WINPTY_FRAME_LINE:
+                if (!decodeLine(p, end)) {
+                    return false;
+                }
+                break;
+            case WINPTY_FRAME_CURSOR:
+                if (!readVarint(p, end, line) || !readInt(p, end, column)) {
+                    return false;
+                }
+                m_cursorVisible = true;
+                m_cursorLine = static_cast<int64_t>(line);
+                m_cursorColumn = column;
+                break;
+            case WINPTY_FRAME_HIDE_CURSOR:
+                m_cursorVisible = false;
+                break;
+            case WINPTY_FRAME_SCROLL_UP:
+            case WINPTY_FRAME_SCROLL_DOWN:
+                if (!readInt(p, end, top) || !readInt(p, end, bottom) ||
+                        !readInt(p, end, count) || top > bottom) {
+                    return false;
+                }
+                if (top < m_rows) {
+                    bottom = std::min(bottom, m_rows - 1);
+                    count = std::min(count, bottom - top + 1);
+                    if (opcode == WINPTY_FRAME_SCROLL_UP) {
+                        scrollUp(top, bottom, count);
+                    } else {
+                        scrollDown(top, bottom, count);
+                    }
+                }
+                break;
+            case WINPTY_FRAME_MODES:
+                if (!readInt(p, end, m_modes)) {
+                    return false;
+                }
+                break;
+            case WINPTY_FRAME_TITLE:
+                if (!readInt(p, end, length) || end - p < length) {
+                    return false;
+                }
+                m_title.assign(reinterpret_cast<const char*>(p), length);
+                p += length;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool FrameDecoder::decodeLine(const uint8_t *&p, const uint8_t *end) {
+    uint64_t line;
+    int column, cellCount, runCount;
+    if (!readVarint(p, end, line) || !readInt(p, end, column) ||
+            !readInt(p, end, cellCount) || !readInt(p, end, runCount)) {
+        return false;
+    }
+    // Runs are at least two bytes each.
+    if (end - p < static_cast<ptrdiff_t>(runCount) * 2) {
+        return false;
+    }
+    const uint8_t *const runs = p;
+    int runCells = 0;
+    for (int i = 0; i < runCount; ++i) {
+        int attributes, cells;
+        if (!readInt(p, end, attributes) || !readInt(p, end, cells) ||
+                cells > cellCount - runCells) {
+            return false;
+        }
+        runCells += cells;
+    }
+    int textLength;
+    if (runCells != cellCount || !readInt(p, end, textLength) ||
+            end - p < textLength) {
+        return false;
+    }
+    const uint8_t *text = p;
+    const uint8_t *const textEnd = p + textLength;
+    p = textEnd;
+    uint64_t erase;
+    if (!readVarint(p, end, erase)) {
+        return false;
+    }
+
+    // Scroll the line onto the screen, or ignore it if it's above the top.
+    const int64_t lineNumber = static_cast<int64_t>(line);
+    if (lineNumber < m_topLine) {
+        return true;
+    }
+    if (lineNumber - m_topLine >= m_rows) {
+        const int64_t shift = lineNumber - m_topLine - m_rows + 1;
+        scrollUp(0, m_rows - 1, static_cast<int>(
+            std::min<int64_t>(shift, m_rows)));
+        m_topLine += shift;
+    }
+    Cell *const row = &m_cells[(lineNumber - m_topLine) * m_cols];
+
+    const uint8_t *runPos = runs;
+    int x = column;
+    for (int i = 0; i < runCount; ++i) {
+        int attributes, cells;
+        readInt(runPos, end, attributes);
+        readInt(runPos, end, cells);
+        for (int j = 0; j < cells; ++j, ++x) {
+            if (text == textEnd) {
+                return false;
+            }
+            const uint32_t ch = readUtf8(text, textEnd);
+            if (x < m_cols) {
+                row[x].ch = ch;
+                row[x].attributes = static_cast<uint16_t>(attributes);
+            }
+        }
+    }
+    if (text != textEnd) {
+        return false;
+    }
+    if (erase != 0) {
+        const Cell blank = { ' ', static_cast<uint16_t>(erase - 1) };
+        for (; x < m_cols; ++x) {
+            row[x] = blank;
+        }
+    }
+    return true;
+}
+
+void FrameDecoder::resize(int cols, int rows) {
+    cols = std::max(cols, 1);
+    rows = std::max(rows, 1);
+    int shift = 0;
+    const int64_t cursorRow = m_cursorLine - m_topLine;
+    if (cursorRow >= rows && cursorRow < m_rows) {
+        shift = static_cast<int>(cursorRow) - rows + 1;
+    }
+    std::vector<Cell> cells(cols * rows, kBlankCell);
+    const int copyCols = std::min(cols, m_cols);
+    for (int y = 0; y < rows && y + shift < m_rows; ++y) {
+        const Cell *const src = m_cells.data() + (y + shift) * m_cols;
+        std::copy(src, src + copyCols, cells.data() + y * cols);
+    }
+    m_cells.swap(cells);
+    m_cols = cols;
+    m_rows = rows;
+    m_topLine += shift;
+}
+
+void FrameDecoder::scrollUp(int top, int bottom, int count) {
+    Cell *const cells = m_cells.data();
+    std::copy(cells + (top + count) * m_cols,
+              cells + (bottom + 1) * m_cols,
+              cells + top * m_cols);
+    clearRows(bottom + 1 - count, bottom);
+}
+
+void FrameDecoder::scrollDown(int top, int bottom, int count) {
+    Cell *const cells = m_cells.data();
+    std::copy_backward(cells + top * m_cols,
+                       cells + (bottom + 1 - count) * m_cols,
+                       cells + (bottom + 1) * m_cols);
+    clearRows(top, top + count - 1);
+}
+
+void FrameDecoder::clearRows(int top, int bottom) {
+    Cell *const cells = m_cells.data();
+    std::fill(cells + top * m_cols, cells + (bottom + 1) * m_cols,
+              kBlankCell);
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// A reference decoder for the binary frames the agent writes with
+// WINPTY_FLAG_BINARY_FRAMES (see winpty_constants.h).  It maintains a screen
+// of cells the size of the console window, which the client resizes along
+// with the console.  It has no Win32 dependencies, so a client can build it
+// on its own.
+
+#ifndef WINPTY_SHARED_FRAME_DECODER_H
+#define WINPTY_SHARED_FRAME_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+class FrameDecoder {
+public:
+    struct Cell {
+        // A Unicode character, or 0 for each cell after the first of a
+        // character that spans several cells.
+        uint32_t ch;
+        uint16_t attributes;
+    };
+
+    FrameDecoder(int cols, int rows);
+
+    // Decodes the complete frames in `data`, keeping an incomplete frame at
+    // the end for the next call.  Returns false if the stream is invalid
+    // (e.g. it is from another version of the agent), after which the
+    // decoder ignores its input.
+    bool feed(const void *data, size_t size);
+
+    // Resizes the screen, keeping the cells at its top-left.  If the cursor
+    // would be below the bottom row, the screen scrolls up instead.
+    void resize(int cols, int rows);
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+    const Cell *row(int row) const { return &m_cells[row * m_cols]; }
+
+    // The line number shown on the top row.
+    int64_t topLine() const { return m_topLine; }
+
+    bool cursorVisible() const { return m_cursorVisible; }
+    int64_t cursorLine() const { return m_cursorLine; }
+    int cursorColumn() const { return m_cursorColumn; }
+
+    // The WINPTY_FRAME_MODE_* bits.
+    int modes() const { return m_modes; }
+    const std::string &title() const { return m_title; }
+    uint64_t frameCount() const { return m_frameCount; }
+
+private:
+    bool decodeFrame(const uint8_t *p, const uint8_t *end);
+    bool decodeLine(const uint8_t *&p, const uint8_t *end);
+    void scrollUp(int top, int bottom, int count);
+    void scrollDown(int top, int bottom, int count);
+    void clearRows(int top, int bottom);
+
+private:
+    int m_cols;
+    int m_rows;
+    std::vector<Cell> m_cells;
+    int64_t m_topLine = 0;
+    bool m_cursorVisible = false;
+    int64_t m_cursorLine = 0;
+    int m_cursorColumn = 0;
+    int m_modes = 0;
+    std::string m_title;
+    uint64_t m_frameCount = 0;
+    bool m_failed = false;
+    // The start of a frame that hasn't completely arrived.
+    std::vector<uint8_t> m_pending;
+};
+
+#endif // WINPTY_SHARED_FRAME_DECODER_H
@@ -0,0 +1,245 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Feed hand-built frames to FrameDecoder and check the screen it keeps.
+
+#include "FrameDecoder.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "../include/winpty_constants.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("Error: %s:%d: check failed: %s\n",                  \
+                   __FILE__, __LINE__, #cond);                          \
+            ++g_failures;                                               \
+        }                                                               \
+    } while (0)
+
+// Builds one frame, record by record.
+class FrameBuilder {
+public:
+    FrameBuilder &op(int opcode) { m_payload.push_back(opcode); return *this; }
+    FrameBuilder &num(uint64_t n) {
+        while (n >= 0x80) {
+            m_payload.push_back(static_cast<char>((n & 0x7F) | 0x80));
+            n >>= 7;
+        }
+        m_payload.push_back(static_cast<char>(n));
+        return *this;
+    }
+    FrameBuilder &str(const std::string &s) {
+        num(s.size());
+        m_payload += s;
+        return *this;
+    }
+    // A line record whose cells are all in one run.
+    FrameBuilder &line(uint64_t line, int column, const std::string &text,
+                       int cells, int attributes, int erase) {
+        op(WINPTY_FRAME_LINE).num(line).num(column).num(cells);
+        if (cells > 0) {
+            num(1).num(attributes).num(cells);
+        } else {
+            num(0);
+        }
+        return str(text).num(erase);
+    }
+    std::string frame(int version = WINPTY_FRAME_VERSION) const {
+        std::string ret;
+        ret.push_back(static_cast<char>(WINPTY_FRAME_MAGIC));
+        ret.push_back(static_cast<char>(version));
+        const size_t size = m_payload.size();
+        for (int i = 0; i < 4; ++i) {
+            ret.push_back(static_cast<char>(size >> (i * 8)));
+        }
+        return ret + m_payload;
+    }
+private:
+    std::string m_payload;
+};
+
+// The characters of a row, with '~' for the continuation of a wide
+// character and '#' for anything else outside ASCII.
+std::string rowText(const FrameDecoder &dec, int row) {
+    std::string ret;
+    for (int x = 0; x < dec.cols(); ++x) {
+        const uint32_t ch = dec.row(row)[x].ch;
+        ret.push_back(ch == 0 ? '~' : ch < 0x80 ? static_cast<char>(ch) : '#');
+    }
+    return ret;
+}
+
+bool feed(FrameDecoder &dec, const std::string &bytes) {
+    return dec.feed(bytes.data(), bytes.size());
+}
+
+void testLines() {
+    FrameDecoder dec(8, 3);
+    FrameBuilder fb;
+    fb.op(WINPTY_FRAME_RESET).num(100);
+    // "ab" in 0x07, then "cd" in 0x1F, then erase in 0x70.
+    fb.op(WINPTY_FRAME_LINE).num(100).num(0).num(4).num(2)
+      .num(0x07).num(2).num(0x1F).num(2).str("abcd").num(0x70 + 1);
+    // A full-width character followed by an ASCII one.
+    fb.line(101, 1, std::string("\xE6\xBC\xA2") + '\0' + "x", 3, 0x07, 0);
+    CHECK(feed(dec, fb.frame()));
+    CHECK(dec.frameCount() == 1);
+    CHECK(dec.topLine() == 100);
+    CHECK(rowText(dec, 0) == "abcd    ");
+    CHECK(dec.row(0)[1].attributes == 0x07);
+    CHECK(dec.row(0)[2].attributes == 0x1F);
+    CHECK(dec.row(0)[7].attributes == 0x70);
+    CHECK(rowText(dec, 1) == " #~x    ");
+    CHECK(dec.row(1)[1].ch == 0x6F22);
+
+    // Patch the middle of the first line without erasing.
+    FrameBuilder patch;
+    patch.line(100, 1, "ZZ", 2, 0x0C, 0);
+    CHECK(feed(dec, patch.frame()));
+    CHECK(rowText(dec, 0) == "aZZd    ");
+    CHECK(dec.row(0)[3].attributes == 0x1F);
+
+    // A line below the bottom row scrolls the screen up.
+    FrameBuilder below;
+    below.line(104, 0, "end", 3, 0x07, 1);
+    CHECK(feed(dec, below.frame()));
+    CHECK(dec.topLine() == 102);
+    CHECK(rowText(dec, 0) == "        ");
+    CHECK(rowText(dec, 2) == "end     ");
+
+    // Lines above the top row are ignored, and so are cells past the end.
+    FrameBuilder outside;
+    outside.line(101, 0, "gone", 4, 0x07, 1);
+    outside.line(103, 6, "wxyz", 4, 0x07, 1);
+    CHECK(feed(dec, outside.frame()));
+    CHECK(rowText(dec, 1) == "      wx");
+    CHECK(rowText(dec, 2) == "end     ");
+}
+
+void testScrollRegions() {
+    FrameDecoder dec(4, 5);
+    FrameBuilder fb;
+    fb.op(WINPTY_FRAME_RESET).num(0);
+    for (int i = 0; i < 5; ++i) {
+        fb.line(i, 0, std::string(4, static_cast<char>('0' + i)), 4, 0x07, 0);
+    }
+    fb.op(WINPTY_FRAME_SCROLL_UP).num(1).num(3).num(1);
+    CHECK(feed(dec, fb.frame()));
+    CHECK(rowText(dec, 0) == "0000");
+    CHECK(rowText(dec, 1) == "2222");
+    CHECK(rowText(dec, 2) == "3333");
+    CHECK(rowText(dec, 3) == "    ");
+    CHECK(rowText(dec, 4) == "4444");
+
+    FrameBuilder down;
+    down.op(WINPTY_FRAME_SCROLL_DOWN).num(0).num(4).num(2);
+    CHECK(feed(dec, down.frame()));
+    CHECK(rowText(dec, 0) == "    ");
+    CHECK(rowText(dec, 1) == "    ");
+    CHECK(rowText(dec, 2) == "0000");
+    CHECK(rowText(dec, 4) == "3333");
+    CHECK(dec.topLine() == 0);
+}
+
+void testState() {
+    FrameDecoder dec(10, 4);
+    CHECK(!dec.cursorVisible());
+    FrameBuilder fb;
+    fb.op(WINPTY_FRAME_CURSOR).num(2).num(5);
+    fb.op(WINPTY_FRAME_MODES).num(WINPTY_FRAME_MODE_BRACKETED_PASTE);
+    fb.op(WINPTY_FRAME_TITLE).str("cmd.exe");
+    CHECK(feed(dec, fb.frame()));
+    CHECK(dec.cursorVisible());
+    CHECK(dec.cursorLine() == 2 && dec.cursorColumn() == 5);
+    CHECK(dec.modes() == WINPTY_FRAME_MODE_BRACKETED_PASTE);
+    CHECK(dec.title() == "cmd.exe");
+
+    // Shrinking the screen below the cursor scrolls it up.
+    dec.resize(6, 2);
+    CHECK(dec.topLine() == 1);
+    FrameBuilder hide;
+    hide.op(WINPTY_FRAME_HIDE_CURSOR);
+    CHECK(feed(dec, hide.frame()));
+    CHECK(!dec.cursorVisible());
+}
+
+void testSplitFeeds() {
+    FrameBuilder a;
+    a.op(WINPTY_FRAME_RESET).num(0);
+    a.line(0, 0, "hello", 5, 0x07, 1);
+    FrameBuilder b;
+    b.line(1, 0, "world", 5, 0x0A, 1);
+    b.op(WINPTY_FRAME_CURSOR).num(1).num(5);
+    const std::string stream = a.frame() + b.frame();
+
+    FrameDecoder whole(8, 2);
+    CHECK(feed(whole, stream));
+    FrameDecoder bytewise(8, 2);
+    for (char ch : stream) {
+        CHECK(bytewise.feed(&ch, 1));
+    }
+    CHECK(bytewise.frameCount() == 2);
+    for (int row = 0; row < 2; ++row) {
+        CHECK(rowText(whole, row) == rowText(bytewise, row));
+    }
+    CHECK(rowText(bytewise, 1) == "world   ");
+    CHECK(bytewise.cursorLine() == 1 && bytewise.cursorColumn() == 5);
+}
+
+void testInvalid() {
+    FrameDecoder dec(4, 2);
+    FrameBuilder fb;
+    fb.line(0, 0, "ab", 2, 0x07, 1);
+    CHECK(!feed(dec, fb.frame(WINPTY_FRAME_VERSION + 1)));
+    CHECK(!feed(dec, fb.frame()));
+    CHECK(dec.frameCount() == 0);
+
+    // The text must have one character per cell.
+    FrameDecoder dec2(4, 2);
+    FrameBuilder shortText;
+    shortText.line(0, 0, "a", 2, 0x07, 1);
+    CHECK(!feed(dec2, shortText.frame()));
+}
+
+} // anonymous namespace
+
+int main() {
+    testLines();
+    testScrollRegions();
+    testState();
+    testSplitFeeds();
+    testInvalid();
+    if (g_failures > 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
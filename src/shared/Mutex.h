@@ -34,6 +34,7 @@ public:
     Mutex()         { InitializeCriticalSection(&m_mutex);  }
     ~Mutex()        { DeleteCriticalSection(&m_mutex);      }
     void lock()     { EnterCriticalSection(&m_mutex);       }
+    bool tryLock()  { return TryEnterCriticalSection(&m_mutex) != 0; }
     void unlock()   { LeaveCriticalSection(&m_mutex);       }
 
     Mutex(const Mutex &other) = delete;
@@ -0,0 +1,133 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// A bounded queue of trace records, filled by any number of threads and
+// drained by one at a time.  Each slot carries a sequence number that says
+// whether it's free for the producer claiming a position or holds a record
+// for the consumer, so a push is a compare-and-swap and a copy, with no lock.
+// The consumer must be serialized by the caller.
+
+#ifndef WINPTY_SHARED_TRACE_RING_H
+#define WINPTY_SHARED_TRACE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+
+struct TraceRecord {
+    // Enough for the 1KB messages trace() formats, with the header.
+    static const size_t kMaxText = 1024 - 16;
+
+    uint64_t time;
+    uint32_t threadId;
+    uint16_t length;
+    char text[kMaxText];
+};
+
+class TraceRing {
+public:
+    static const size_t kSlotCount = 256;
+
+    TraceRing() : m_slots(new Slot[kSlotCount]) {
+        for (size_t i = 0; i < kSlotCount; ++i) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Copies a record into the ring.  Returns false, leaving the ring
+    // unchanged, if it's full.
+    bool push(uint64_t time, uint32_t threadId,
+              const char *text, size_t length) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &m_slots[pos % kSlotCount];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const ptrdiff_t diff =
+                static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The slot still holds the record from one lap ago.
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        if (length > TraceRecord::kMaxText) {
+            length = TraceRecord::kMaxText;
+        }
+        slot->record.time = time;
+        slot->record.threadId = threadId;
+        slot->record.length = static_cast<uint16_t>(length);
+        memcpy(slot->record.text, text, length);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // The oldest record, or NULL if the ring is empty or the oldest claimed
+    // slot is still being filled.  It stays valid until pop.
+    const TraceRecord *front() const {
+        const Slot &slot = m_slots[m_tail % kSlotCount];
+        if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) {
+            return nullptr;
+        }
+        return &slot.record;
+    }
+
+    void pop() {
+        m_slots[m_tail % kSlotCount].seq.store(
+            m_tail + kSlotCount, std::memory_order_release);
+        ++m_tail;
+    }
+
+    // The number of claimed slots.  Producers may see a stale count.
+    size_t approxSize() const {
+        return m_head.load(std::memory_order_relaxed) -
+            m_tailPublished.load(std::memory_order_relaxed);
+    }
+
+    // Lets approxSize see the consumer's progress.  Call it after draining.
+    void publishTail() {
+        m_tailPublished.store(m_tail, std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        TraceRecord record;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_head { 0 };
+    size_t m_tail = 0;
+    std::atomic<size_t> m_tailPublished { 0 };
+
+    TraceRing(const TraceRing &other) = delete;
+    TraceRing &operator=(const TraceRing &other) = delete;
+};
+
+#endif // WINPTY_SHARED_TRACE_RING_H
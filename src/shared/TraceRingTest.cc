@@ -0,0 +1,133 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Check that each thread's records drain from the ring intact and in order.
+
+#include "TraceRing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kProducers = 4;
+const int kRecordsPerProducer = 200000;
+
+int g_failures = 0;
+
+void correctness() {
+    TraceRing ring;
+    std::atomic<int> finished(0);
+    std::vector<std::thread> producers;
+    for (int id = 0; id < kProducers; ++id) {
+        producers.emplace_back([&ring, &finished, id]() {
+            char text[64];
+            for (int i = 0; i < kRecordsPerProducer; ++i) {
+                // Vary the length so a torn copy would show up.
+                const int length = snprintf(text, sizeof(text),
+                                            "%d:%d:%.*s", id, i, i % 32,
+                                            "abcdefghijklmnopqrstuvwxyz012345");
+                while (!ring.push(i, id, text, length)) {
+                    std::this_thread::yield();
+                }
+            }
+            ++finished;
+        });
+    }
+    std::vector<int> next(kProducers);
+    int received = 0;
+    while (received < kProducers * kRecordsPerProducer) {
+        const TraceRecord *record = ring.front();
+        if (record == nullptr) {
+            ring.publishTail();
+            if (finished == kProducers && ring.front() == nullptr) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        const int id = record->threadId;
+        const int i = static_cast<int>(record->time);
+        char expected[64];
+        const int length = snprintf(expected, sizeof(expected),
+                                    "%d:%d:%.*s", id, i, i % 32,
+                                    "abcdefghijklmnopqrstuvwxyz012345");
+        if (id < 0 || id >= kProducers || i != next[id] ||
+                record->length != length ||
+                memcmp(record->text, expected, length) != 0) {
+            if (g_failures++ < 10) {
+                printf("Error: bad record from producer %d: %d, expected %d\n",
+                       id, i, id >= 0 && id < kProducers ? next[id] : -1);
+            }
+        } else {
+            ++next[id];
+        }
+        ring.pop();
+        ++received;
+    }
+    for (auto &thread : producers) {
+        thread.join();
+    }
+    if (received != kProducers * kRecordsPerProducer) {
+        printf("Error: received %d records, expected %d\n",
+               received, kProducers * kRecordsPerProducer);
+        ++g_failures;
+    }
+}
+
+void benchmark() {
+    TraceRing ring;
+    static const char kText[] =
+        "Scraper: console window rect (0,0)-(79,24), cursor (12,3)";
+    const int kIterations = 10000000;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+        if (!ring.push(i, 1, kText, sizeof(kText) - 1)) {
+            while (ring.front() != nullptr) {
+                ring.pop();
+            }
+            ring.publishTail();
+            ring.push(i, 1, kText, sizeof(kText) - 1);
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    printf("push+pop: %.1f ns per record\n",
+           std::chrono::duration<double, std::nano>(t1 - t0).count() /
+               kIterations);
+}
+
+} // anonymous namespace
+
+int main() {
+    correctness();
+    if (g_failures > 0) {
+        printf("%d failures\n", g_failures);
+        return 1;
+    }
+    printf("correctness: OK\n");
+    benchmark();
+    return 0;
+}
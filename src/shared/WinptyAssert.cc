@@ -28,11 +28,15 @@
 void assertTrace(const char *file, int line, const char *cond) {
     trace("Assertion failed: %s, file %s, line %d",
           cond, file, line);
+    flushTrace();
 }
 
 #ifdef WINPTY_AGENT_ASSERT
 
 void agentShutdown() {
+    // Closing the console window ends the process without running exit
+    // handlers, so write out the buffered trace messages first.
+    flushTrace();
     HWND hwnd = GetConsoleWindow();
     if (hwnd != NULL) {
         PostMessage(hwnd, WM_CLOSE, 0, 0);
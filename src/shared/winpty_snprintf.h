@@ -27,7 +27,8 @@
 
 #include "WinptyAssert.h"
 
-#if defined(__CYGWIN__) || defined(__MSYS__)
+#if defined(__CYGWIN__) || defined(__MSYS__) || \
+        (defined(__GNUC__) && !defined(_WIN32))
 #define WINPTY_SNPRINTF_FORMAT(fmtarg, vararg) \
     __attribute__((format(printf, (fmtarg), ((vararg)))))
 #elif defined(__GNUC__)
@@ -0,0 +1,73 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// The agent's EventLoop on a virtual millisecond clock, for the tests that
+// simulate its polling policies (AdaptivePollIntervalTest and
+// OutputBacklogLimitTest).  Like the real loop, it wakes up for each poll,
+// some interval after the previous poll, and for each pipe input that arrives
+// before then.
+
+#ifndef TESTS_VIRTUAL_EVENT_LOOP_H
+#define TESTS_VIRTUAL_EVENT_LOOP_H
+
+#include <stddef.h>
+
+#include <utility>
+#include <vector>
+
+class VirtualEventLoop {
+public:
+    // `inputTimes` must be in increasing order.
+    explicit VirtualEventLoop(std::vector<int> inputTimes = {}) :
+        m_inputTimes(std::move(inputTimes))
+    {
+    }
+
+    // Advance the clock to the next wakeup: the next input, if it arrives
+    // before the poll `intervalMs` after the previous poll, or else that
+    // poll.  Returns true for a poll.
+    bool wait(int intervalMs) {
+        const int pollTime = m_lastPoll + intervalMs;
+        m_prevWake = m_now;
+        ++m_wakes;
+        if (m_nextInput < m_inputTimes.size() &&
+                m_inputTimes[m_nextInput] < pollTime) {
+            m_now = m_inputTimes[m_nextInput++];
+            return false;
+        }
+        m_now = m_lastPoll = pollTime;
+        return true;
+    }
+
+    int now() const { return m_now; }
+    // Milliseconds since the previous wakeup.
+    int elapsed() const { return m_now - m_prevWake; }
+    int wakes() const { return m_wakes; }
+
+private:
+    std::vector<int> m_inputTimes;
+    size_t m_nextInput = 0;
+    int m_now = 0;
+    int m_prevWake = 0;
+    int m_lastPoll = 0;
+    int m_wakes = 0;
+};
+
+#endif // TESTS_VIRTUAL_EVENT_LOOP_H
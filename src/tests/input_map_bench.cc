@@ -0,0 +1,175 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Measure InputMap::lookupKey, which sees every byte of terminal input before
+// ConsoleInput decides how to translate it.  The benchmark builds the default
+// input map and replays synthetic input streams through a loop shaped like
+// ConsoleInput::scanInput, once with the map's trie and once with its
+// compiled state-transition table.
+//
+// Streams:
+//  - typing: interactive editing, mixing text, Enter, and cursor keys, Home
+//    and End, and function keys with and without modifiers, as sent by
+//    xterm-style terminals.
+//  - paste: a large paste of source-code text, one lookup per byte.
+//  - bracketed: the same paste, wrapped in bracketed-paste markers.
+//
+// Usage: input_map_bench [stream...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../agent/DefaultInputMap.h"
+#include "../agent/InputMap.h"
+
+namespace {
+
+const int kStreamBytes = 4 * 1024 * 1024;
+
+struct Stream {
+    const char *name;
+    std::string data;
+};
+
+std::string typingStream() {
+    static const char *const keys[] = {
+        "\x1b[A", "\x1b[B", "\x1b[C", "\x1b[D",
+        "\x1b[1;5C", "\x1b[1;5D", "\x1b[1;2A", "\x1b[H", "\x1b[F",
+        "\x1bOP", "\x1b[15~", "\x1b[3~", "\x1b[5;5~", "\x7f", "\r", "\t",
+    };
+    std::string ret;
+    srand(1);
+    while (ret.size() < kStreamBytes) {
+        const int words = 1 + rand() % 6;
+        for (int i = 0; i < words; ++i) {
+            const int len = 1 + rand() % 8;
+            for (int j = 0; j < len; ++j) {
+                ret.push_back('a' + rand() % 26);
+            }
+            ret.push_back(' ');
+        }
+        const int keyCount = rand() % 4;
+        for (int i = 0; i < keyCount; ++i) {
+            ret += keys[rand() % (sizeof(keys) / sizeof(keys[0]))];
+        }
+    }
+    return ret;
+}
+
+std::string pasteStream() {
+    static const char *const lines[] = {
+        "int InputMap::lookupKey(const char *input, int inputSize,\r",
+        "                        Key &keyOut, bool &incompleteOut) const {\r",
+        "    for (int i = 0; i < inputSize; ++i) {\r",
+        "        unsigned char ch = input[i];\r",
+        "        // Comments, \"strings\", and [brackets] {braces} ~tildes~.\r",
+        "    }\r",
+        "\r",
+    };
+    std::string ret;
+    srand(2);
+    while (ret.size() < kStreamBytes) {
+        ret += lines[rand() % (sizeof(lines) / sizeof(lines[0]))];
+    }
+    return ret;
+}
+
+std::string bracketedStream() {
+    std::string ret = "\x1b[200~";
+    ret += pasteStream();
+    ret += "\x1b[201~";
+    return ret;
+}
+
+// Consume the stream the way ConsoleInput::scanInput does: a map match
+// consumes its length, and anything else is taken one byte at a time.
+size_t replay(const InputMap &map, const std::string &data) {
+    size_t matches = 0;
+    const char *p = data.data();
+    const char *const end = p + data.size();
+    while (p < end) {
+        InputMap::Key key;
+        bool incomplete;
+        const int len = map.lookupKey(p, end - p, key, incomplete);
+        if (len > 0) {
+            ++matches;
+            p += len;
+        } else {
+            ++p;
+        }
+    }
+    return matches;
+}
+
+void report(const InputMap &map, const Stream &s, const char *mode) {
+    replay(map, s.data);
+    double best = 1e9;
+    size_t matches = 0;
+    for (int trial = 0; trial < 5; ++trial) {
+        const auto start = std::chrono::steady_clock::now();
+        matches = replay(map, s.data);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    printf("  %-10s %-8s %8.1f MB/s  %8zu keys\n",
+           s.name, mode, s.data.size() / best / 1e6, matches);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    InputMap trie;
+    addDefaultEntriesToInputMap(trie);
+    InputMap compiled;
+    addDefaultEntriesToInputMap(compiled);
+    const auto start = std::chrono::steady_clock::now();
+    if (!compiled.compile()) {
+        fprintf(stderr, "error: the input map could not be compiled\n");
+        return 1;
+    }
+    const std::chrono::duration<double> compileTime =
+        std::chrono::steady_clock::now() - start;
+    printf("compile: %.2f ms\n", compileTime.count() * 1000.0);
+
+    const Stream streams[] = {
+        { "typing", typingStream() },
+        { "paste", pasteStream() },
+        { "bracketed", bracketedStream() },
+    };
+    for (const Stream &s : streams) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || strcmp(argv[i], s.name) == 0;
+        }
+        if (selected) {
+            printf("%s:\n", s.name);
+            report(trie, s, "trie");
+            report(compiled, s, "compiled");
+        }
+    }
+    return 0;
+}
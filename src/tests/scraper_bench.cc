@@ -0,0 +1,484 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+// Measure how efficiently the scraper turns console changes into terminal
+// output.  Most workloads run in scrolling mode; "pager" resizes the buffer to
+// the window, like a full-screen program, to run in direct mode.  Scripted
+// workloads write into a SimConsoleBuffer, and after each frame the Scraper
+// scrapes it into a Terminal whose output is only counted.  Nothing touches a
+// real console, so the benchmark also runs natively outside Windows (build it
+// with src/tests/sim.mk) under perf or valgrind.
+//
+// For each workload, the benchmark reports:
+//  - console lines written per second of scraping time,
+//  - VT bytes emitted per frame and per console cell the workload changed,
+//    and
+//  - heap allocations made while scraping.
+//
+// Usage: scraper_bench [options] [workload...]
+//
+// Options:
+//   --line-hashing     Track lines with hashes (WINPTY_FLAG_LINE_HASHING).
+//   --no-line-patching Always rewrite changed lines in full, rather than
+//                      patching only their changed cells.
+//   --no-scroll-detection
+//                      In direct mode, resend scrolled lines rather than
+//                      scrolling them in the terminal.
+//   --binary-frames    Send binary frames (WINPTY_FLAG_BINARY_FRAMES) rather
+//                      than escape sequences.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../agent/ConsoleControl.h"
+#include "../agent/Scraper.h"
+#include "../agent/SimConsoleBuffer.h"
+#include "../agent/Terminal.h"
+#include "../agent/TerminalOutput.h"
+#include "../shared/winpty_snprintf.h"
+
+namespace {
+
+bool g_countAllocs = false;
+size_t g_allocCount = 0;
+
+struct Options {
+    bool lineHashing = false;
+    bool linePatching = true;
+    bool scrollDetection = true;
+    bool binaryFrames = false;
+} g_options;
+
+} // anonymous namespace
+
+void *operator new(size_t size) {
+    if (g_countAllocs) {
+        ++g_allocCount;
+    }
+    void *ret = malloc(size == 0 ? 1 : size);
+    if (ret == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ret;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+const int kCols = 80;
+const int kRows = 25;
+
+struct FrameResult {
+    int lines;
+    int cells;
+};
+
+// The workloads format ASCII text with winpty_snprintf and widen it.
+std::wstring widen(const char *text) {
+    return std::wstring(text, text + strlen(text));
+}
+
+typedef FrameResult (*FrameFunc)(SimConsoleBuffer &buffer, int frame);
+
+struct Workload {
+    const char *name;
+    int frames;
+    FrameFunc func;
+};
+
+// Counts the bytes the Terminal writes and discards them.
+class OutputSink : public TerminalOutput {
+public:
+    virtual void write(const void *data, size_t size) override {
+        m_bytes += size;
+    }
+    size_t bytes() const { return m_bytes; }
+
+private:
+    size_t m_bytes = 0;
+};
+
+// A full-screen program (e.g. top) repainting every row of the window each
+// frame, although only a few cells actually change.
+FrameResult redrawFrame(SimConsoleBuffer &buffer, int frame) {
+    static std::vector<std::wstring> prev(kRows);
+    FrameResult ret = { kRows, 0 };
+    const SmallRect window = buffer.windowRect();
+    for (int row = 0; row < kRows; ++row) {
+        char line[kCols + 1];
+        if (row == 0) {
+            winpty_snprintf(line,
+                            "top - frame %-8d  load average: %d.%02d", frame,
+                            frame % 7, (frame * 13) % 100);
+        } else {
+            winpty_snprintf(line,
+                            "%5d user      20   0 %8d %6d S %4.1f %4.1f  "
+                            "proc%d",
+                            1000 + row, 100000 + row * 37,
+                            (frame * row) % 50000,
+                            ((frame + row) % 97) / 10.0, (row % 13) / 10.0,
+                            row);
+        }
+        std::wstring text = widen(line);
+        text.resize(kCols, L' ');
+        const std::wstring &old = prev[row];
+        for (int i = 0; i < kCols; ++i) {
+            if (old.size() != text.size() || old[i] != text[i]) {
+                ++ret.cells;
+            }
+        }
+        buffer.writeCells(Coord(window.Left, window.Top + row), text,
+                          row == 0 ? 0x70 : 0x07);
+        prev[row] = text;
+    }
+    return ret;
+}
+
+// A build dashboard: a table of jobs whose progress counters tick, and a
+// status bar with a clock.  Each frame changes a handful of cells in a few
+// colored rows.
+FrameResult dashboardFrame(SimConsoleBuffer &buffer, int frame) {
+    static std::vector<std::wstring> prev(kRows);
+    FrameResult ret = { 0, 0 };
+    const SmallRect window = buffer.windowRect();
+    for (int row = 0; row < kRows; ++row) {
+        char line[kCols + 1];
+        WORD attr = 0x07;
+        if (row == kRows - 1) {
+            const int secs = frame / 4;
+            winpty_snprintf(line,
+                            " build #%d  %02d:%02d:%02d  %d/%d jobs  "
+                            "F1 Help  F10 Quit",
+                            1234, secs / 3600, secs / 60 % 60, secs % 60,
+                            frame / 40 % (kRows - 1), kRows - 1);
+            attr = 0x1F;
+        } else {
+            const int progress = (frame * (row + 1) / 8) % 101;
+            winpty_snprintf(line, " job %-2d  %-24s [%-20.*s] %3d%%",
+                            row, "compile src/agent/...", progress / 5,
+                            "####################", progress);
+            attr = progress == 100 ? 0x0A : 0x07;
+        }
+        std::wstring text = widen(line);
+        text.resize(kCols, L' ');
+        const std::wstring &old = prev[row];
+        int cells = 0;
+        for (int i = 0; i < kCols; ++i) {
+            if (old.size() != text.size() || old[i] != text[i]) {
+                ++cells;
+            }
+        }
+        if (cells > 0) {
+            buffer.writeCells(Coord(window.Left, window.Top + row), text,
+                              attr);
+            ret.lines++;
+            ret.cells += cells;
+        }
+        prev[row] = text;
+    }
+    return ret;
+}
+
+// A pager (e.g. less) in a window-sized buffer, scrolling through a file a
+// line or a page at a time, with a status line at the bottom.
+FrameResult pagerFrame(SimConsoleBuffer &buffer, int frame) {
+    static std::vector<std::wstring> prev(kRows);
+    static int top = 0;
+    if (frame == 0) {
+        buffer.resizeBuffer(Coord(kCols, kRows));
+        top = 0;
+    } else if (frame % 50 == 0) {
+        top += kRows - 1;
+    } else if (frame % 50 < 10) {
+        top -= 1;
+    } else {
+        top += 1;
+    }
+    FrameResult ret = { 0, 0 };
+    for (int row = 0; row < kRows; ++row) {
+        char line[kCols + 1];
+        WORD attr = 0x07;
+        if (row == kRows - 1) {
+            winpty_snprintf(line, "file.txt lines %d-%d", top + 1,
+                            top + kRows - 1);
+            attr = 0x70;
+        } else {
+            const int n = top + row;
+            winpty_snprintf(line, "%6d  %s", n + 1,
+                            n % 9 == 0 ? "" :
+                            "Lorem ipsum dolor sit amet, consectetur "
+                            "adipiscing elit, sed do eiusmod");
+            attr = n % 9 == 1 ? 0x0E : 0x07;
+        }
+        std::wstring text = widen(line);
+        text.resize(kCols, L' ');
+        const std::wstring &old = prev[row];
+        int cells = 0;
+        for (int i = 0; i < kCols; ++i) {
+            if (old.size() != text.size() || old[i] != text[i]) {
+                ++cells;
+            }
+        }
+        buffer.writeCells(Coord(0, row), text, attr);
+        if (cells > 0) {
+            ret.lines++;
+            ret.cells += cells;
+        }
+        prev[row] = text;
+    }
+    return ret;
+}
+
+// Misc/Spew.py: an endless stream of short lines.
+FrameResult spewFrame(SimConsoleBuffer &buffer, int frame) {
+    static int counter = 0;
+    FrameResult ret = { 0, 0 };
+    std::wstring text;
+    for (int i = 0; i < 500; ++i) {
+        char line[32];
+        const int len = winpty_snprintf(line, "%d\n", ++counter);
+        text += widen(line);
+        ret.lines++;
+        ret.cells += len - 1;
+    }
+    buffer.writeText(text);
+    return ret;
+}
+
+// Compiler diagnostics: a colored location and severity followed by a
+// message in the default color.
+FrameResult colorLogFrame(SimConsoleBuffer &buffer, int frame) {
+    static const wchar_t *const kMessages[] = {
+        L"unused variable 'ret' [-Wunused-variable]",
+        L"comparison of integers of different signs: 'int' and 'size_t'",
+        L"no matching function for call to 'foo(std::string&)'",
+        L"expected ';' after expression",
+    };
+    FrameResult ret = { 0, 0 };
+    for (int i = 0; i < 50; ++i) {
+        const int n = frame * 50 + i;
+        const bool isError = n % 5 == 0;
+        char loc[64];
+        winpty_snprintf(loc, "src/agent/File%d.cc:%d:%d: ",
+                        n % 17, 10 + n % 900, 1 + n % 60);
+        const std::wstring location = widen(loc);
+        const std::wstring severity = isError ? L"error: " : L"warning: ";
+        const std::wstring message = kMessages[n % 4];
+        buffer.setTextAttribute(0x0F);
+        buffer.writeText(location);
+        buffer.setTextAttribute(isError ? 0x0C : 0x0D);
+        buffer.writeText(severity);
+        buffer.setTextAttribute(0x07);
+        buffer.writeText(message + L"\n");
+        ret.lines++;
+        ret.cells += location.size() + severity.size() + message.size();
+    }
+    return ret;
+}
+
+// Syntax-highlighted source code (e.g. a colorized diff or cat), where the
+// color changes every few cells: a dim line-number gutter, keywords, types,
+// strings, numbers, and comments, with an occasional highlighted search hit.
+FrameResult highlightFrame(SimConsoleBuffer &buffer, int frame) {
+    struct Token {
+        const wchar_t *text;
+        WORD attr;
+    };
+    static const Token kLine1[] = {
+        { L"static ", 0x09 }, { L"int ", 0x0B }, { L"count", 0x07 },
+        { L" = ", 0x07 }, { L"0", 0x0D }, { L"; ", 0x07 },
+        { L"// number of cells", 0x02 },
+    };
+    static const Token kLine2[] = {
+        { L"if ", 0x09 }, { L"(", 0x07 }, { L"name", 0x07 }, { L" == ", 0x07 },
+        { L"\"pager\"", 0x0E }, { L") { ", 0x07 }, { L"return ", 0x09 },
+        { L"true", 0x0D }, { L"; }", 0x07 },
+    };
+    static const Token kLine3[] = {
+        { L"-", 0x0C }, { L"    ", 0x07 }, { L"out", 0x07 }, { L".", 0x07 },
+        { L"append", 0x0F }, { L"(", 0x07 }, { L"CSI ", 0x07 },
+        { L"\"0m\"", 0x4F }, { L");", 0x07 },
+    };
+    static const Token kLine4[] = {
+        { L"+", 0x0A }, { L"    ", 0x07 }, { L"outputSetColor", 0x0F },
+        { L"(", 0x07 }, { L"out", 0x07 }, { L", ", 0x07 }, { L"color", 0x70 },
+        { L", ", 0x07 }, { L"prev", 0x07 }, { L");", 0x07 },
+    };
+    struct Line {
+        const Token *tokens;
+        int count;
+    };
+    static const Line kLines[] = {
+        { kLine1, sizeof(kLine1) / sizeof(kLine1[0]) },
+        { kLine2, sizeof(kLine2) / sizeof(kLine2[0]) },
+        { kLine3, sizeof(kLine3) / sizeof(kLine3[0]) },
+        { kLine4, sizeof(kLine4) / sizeof(kLine4[0]) },
+    };
+    FrameResult ret = { 0, 0 };
+    for (int i = 0; i < 50; ++i) {
+        const int n = frame * 50 + i;
+        char gutter[16];
+        const int len = winpty_snprintf(gutter, "%5d ", n + 1);
+        buffer.setTextAttribute(0x08);
+        buffer.writeText(widen(gutter));
+        ret.cells += len;
+        const Line &line = kLines[n % 4];
+        for (int j = 0; j < line.count; ++j) {
+            const std::wstring text = line.tokens[j].text;
+            buffer.setTextAttribute(line.tokens[j].attr);
+            buffer.writeText(text);
+            ret.cells += text.size();
+        }
+        buffer.setTextAttribute(0x07);
+        buffer.writeText(L"\n");
+        ret.lines++;
+    }
+    return ret;
+}
+
+// Full-width CJK text, long enough to wrap.
+FrameResult cjkFrame(SimConsoleBuffer &buffer, int frame) {
+    // Japanese, Korean, and Chinese text.
+    static const wchar_t kText[] =
+        L"\u6F22\u5B57\u304B\u306A\u4EA4\u3058\u308A\u6587\u306E"
+        L"\u30C6\u30B9\u30C8\u3067\u3059\u3002\uD55C\uAD6D\uC5B4 "
+        L"\u4E2D\u6587\u6587\u672C\u3002";
+    FrameResult ret = { 0, 0 };
+    std::wstring text;
+    for (int i = 0; i < 50; ++i) {
+        char prefix[16];
+        const int len = winpty_snprintf(prefix, "%5d ", frame * 50 + i);
+        text += widen(prefix);
+        ret.cells += len;
+        for (int j = 0; j <= i % 4; ++j) {
+            text += kText;
+            for (const wchar_t *p = kText; *p != L'\0'; ++p) {
+                ret.cells += *p < 0x1100 ? 1 : 2;
+            }
+        }
+        text += L'\n';
+        ret.lines++;
+    }
+    buffer.writeText(text);
+    return ret;
+}
+
+const Workload kWorkloads[] = {
+    { "redraw",     2000,   redrawFrame     },
+    { "dashboard",  2000,   dashboardFrame  },
+    { "pager",      2000,   pagerFrame      },
+    { "spew",       200,    spewFrame       },
+    { "colorlog",   1000,   colorLogFrame   },
+    { "highlight",  1000,   highlightFrame  },
+    { "cjk",        1000,   cjkFrame        },
+};
+
+void runWorkload(ConsoleControl &console, const Workload &workload) {
+    OutputSink sink;
+    SimConsoleBuffer buffer(Coord(kCols, kRows), Coord(kCols, kRows));
+    buffer.setOutputCodePage(932);
+    std::unique_ptr<Terminal> terminal(
+        new Terminal(sink, false, true, g_options.binaryFrames));
+    terminal->setLinePatching(g_options.linePatching);
+    Scraper scraper(console, buffer, std::move(terminal),
+                    Coord(kCols, kRows));
+    scraper.setLineHashing(g_options.lineHashing);
+    scraper.setScrollDetection(g_options.scrollDetection);
+
+    long long lines = 0;
+    long long cells = 0;
+    double seconds = 0.0;
+    const size_t startBytes = sink.bytes();
+    g_allocCount = 0;
+    for (int frame = 0; frame < workload.frames; ++frame) {
+        const FrameResult result = workload.func(buffer, frame);
+        lines += result.lines;
+        cells += result.cells;
+        ConsoleScreenBufferInfo info;
+        const auto t0 = std::chrono::steady_clock::now();
+        g_countAllocs = true;
+        {
+            ConsoleControl::FreezeGuard guard(console, console.frozen());
+            scraper.scrapeBuffer(buffer, info);
+        }
+        g_countAllocs = false;
+        const auto t1 = std::chrono::steady_clock::now();
+        seconds += std::chrono::duration<double>(t1 - t0).count();
+    }
+    const size_t bytes = sink.bytes() - startBytes;
+
+    printf("%-10s frames=%-5d lines=%-7.0f %10.0f lines/s  "
+           "%10.0f bytes  %8.1f bytes/frame  %6.2f bytes/cell  "
+           "%8.0f allocs (%.1f/frame)\n",
+           workload.name, workload.frames, static_cast<double>(lines),
+           seconds > 0.0 ? lines / seconds : 0.0,
+           static_cast<double>(bytes),
+           static_cast<double>(bytes) / workload.frames,
+           cells > 0 ? static_cast<double>(bytes) / cells : 0.0,
+           static_cast<double>(g_allocCount),
+           static_cast<double>(g_allocCount) / workload.frames);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    SimConsoleControl console;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--line-hashing")) {
+            g_options.lineHashing = true;
+        } else if (!strcmp(argv[i], "--no-line-patching")) {
+            g_options.linePatching = false;
+        } else if (!strcmp(argv[i], "--no-scroll-detection")) {
+            g_options.scrollDetection = false;
+        } else if (!strcmp(argv[i], "--binary-frames")) {
+            g_options.binaryFrames = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "error: unrecognized option: %s\n", argv[i]);
+            return 1;
+        } else {
+            names.push_back(argv[i]);
+        }
+    }
+    for (const auto &workload : kWorkloads) {
+        bool selected = names.empty();
+        for (const auto &name : names) {
+            if (name == workload.name) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            runWorkload(console, workload);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+# Copyright (c) 2016 Ryan Prichard
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# Builds the scraping code (Scraper, Terminal, and SimConsoleBuffer) with the
+# host's C++ compiler, so that it can be run and profiled outside of Windows,
+# e.g. with perf or valgrind on Linux.  It also builds the binary frame
+# decoder library, which has no Win32 dependencies.  Run it from the top of
+# the tree:
+#
+#     make -f src/tests/sim.mk
+#
+# The unit tests for code without Win32 dependencies build into the same
+# tree.  To build and run them:
+#
+#     make -f src/tests/sim.mk check
+#
+# The output goes to build/sim.  CXX and CXXFLAGS can be overridden on the
+# command line, e.g. CXXFLAGS="-O2 -g -fno-omit-frame-pointer".
+
+.SECONDEXPANSION :
+
+.PHONY : default
+default : all
+
+CXXFLAGS := -O2 -g
+
+SIM_CXXFLAGS := -std=c++11 -MMD -Wall $(CXXFLAGS)
+
+SIM_OBJECTS = \
+	build/sim/agent/CellScan.o \
+	build/sim/agent/ConsoleLine.o \
+	build/sim/agent/LargeConsoleRead.o \
+	build/sim/agent/Scraper.o \
+	build/sim/agent/SimConsoleBuffer.o \
+	build/sim/agent/Terminal.o \
+	build/sim/tests/sim_trace.o
+
+build/sim/%.o : src/%.cc | $$(@D)/.mkdir
+	$(info Compiling $<)
+	@$(CXX) $(SIM_CXXFLAGS) -c -o $@ $<
+
+build/sim/libwinpty-sim.a : $(SIM_OBJECTS)
+	$(info Archiving $@)
+	@rm -f $@
+	@$(AR) rcs $@ $^
+
+build/sim/libwinpty-frame-decoder.a : build/sim/shared/FrameDecoder.o
+	$(info Archiving $@)
+	@rm -f $@
+	@$(AR) rcs $@ $^
+
+build/sim/scraper_bench : \
+		build/sim/tests/scraper_bench.o \
+		build/sim/libwinpty-sim.a
+	$(info Linking $@)
+	@$(CXX) $(CXXFLAGS) -o $@ $^
+
+SIM_TESTS = \
+	build/sim/agent/CellScanTest \
+	build/sim/agent/ConsoleLineTest \
+	build/sim/agent/OutputQueueTest \
+	build/sim/agent/KeyboardLayoutCacheTest \
+	build/sim/shared/TraceRingTest \
+	build/sim/shared/FrameDecoderTest \
+	build/sim/agent/AdaptivePollIntervalTest \
+	build/sim/agent/OutputBacklogLimitTest
+
+build/sim/agent/CellScanTest : \
+		build/sim/agent/CellScanTest.o \
+		build/sim/agent/CellScan.o
+
+build/sim/agent/ConsoleLineTest : \
+		build/sim/agent/ConsoleLineTest.o \
+		build/sim/agent/ConsoleLine.o \
+		build/sim/agent/CellScan.o \
+		build/sim/tests/sim_trace.o
+
+# OutputQueueTest defines its own assertTrace, so it doesn't link sim_trace.
+build/sim/agent/OutputQueueTest : \
+		build/sim/agent/OutputQueueTest.o \
+		build/sim/agent/OutputQueue.o
+
+build/sim/agent/KeyboardLayoutCacheTest : \
+		build/sim/agent/KeyboardLayoutCacheTest.o \
+		build/sim/agent/KeyboardLayoutCache.o
+
+build/sim/shared/TraceRingTest : build/sim/shared/TraceRingTest.o
+build/sim/shared/TraceRingTest : SIM_CXXFLAGS += -pthread
+build/sim/shared/TraceRingTest : CXXFLAGS += -pthread
+
+build/sim/shared/FrameDecoderTest : \
+		build/sim/shared/FrameDecoderTest.o \
+		build/sim/libwinpty-frame-decoder.a
+
+build/sim/agent/AdaptivePollIntervalTest : \
+		build/sim/agent/AdaptivePollIntervalTest.o
+
+build/sim/agent/OutputBacklogLimitTest : \
+		build/sim/agent/OutputBacklogLimitTest.o
+
+$(SIM_TESTS) :
+	$(info Linking $@)
+	@$(CXX) $(CXXFLAGS) -o $@ $^
+
+.PHONY : all
+all : \
+	build/sim/libwinpty-sim.a \
+	build/sim/libwinpty-frame-decoder.a \
+	build/sim/scraper_bench \
+	$(SIM_TESTS)
+
+.PHONY : check
+check : $(SIM_TESTS)
+	@set -e; for test in $^; do echo "Running $$test"; $$test; done
+
+.PHONY : clean
+clean :
+	rm -fr build/sim
+
+.PRECIOUS : %.mkdir
+%.mkdir :
+	$(info Creating directory $(dir $@))
+	@mkdir -p $(dir $@)
+	@touch $@
+
+-include $(SIM_OBJECTS:.o=.d)
+-include build/sim/tests/scraper_bench.d
+-include build/sim/shared/FrameDecoder.d
+-include $(SIM_TESTS:=.d)
@@ -0,0 +1,74 @@
+// Copyright (c) 2016 Ryan Prichard
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+// Trace and assert support for the simulated console build (sim.mk), which
+// runs outside Windows and has no debugserver.  As in the agent, tracing is
+// enabled with WINPTY_DEBUG=trace, and the messages go to stderr.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "../shared/DebugClient.h"
+#include "../shared/WinptyAssert.h"
+
+bool isTracingEnabled()
+{
+    static const bool enabled = hasDebugFlag("trace") || hasDebugFlag("1");
+    return enabled;
+}
+
+bool hasDebugFlag(const char *flag)
+{
+    const char *const config = getenv("WINPTY_DEBUG");
+    if (config == NULL || config[0] == '\0') {
+        return false;
+    }
+    return ("," + std::string(config) + ",").find(
+        "," + std::string(flag) + ",") != std::string::npos;
+}
+
+void trace(const char *format, ...)
+{
+    if (!isTracingEnabled())
+        return;
+
+    char message[1024];
+
+    va_list ap;
+    va_start(ap, format);
+    winpty_vsnprintf(message, format, ap);
+    message[sizeof(message) - 1] = '\0';
+    va_end(ap);
+
+    fprintf(stderr, "%s\n", message);
+}
+
+void flushTrace()
+{
+}
+
+void assertTrace(const char *file, int line, const char *cond) {
+    fprintf(stderr, "Assertion failed: %s, file %s, line %d\n",
+            cond, file, line);
+}
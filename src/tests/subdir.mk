@@ -22,7 +22,28 @@ build/%.exe : src/tests/%.cc build/winpty.dll
 	$(info Building $@)
 	@$(MINGW_CXX) $(MINGW_CXXFLAGS) $(MINGW_LDFLAGS) -o $@ $^
 
+# The scraper and input map benchmarks link the agent's code directly rather
+# than using winpty.dll.  The simulated console is only linked into the
+# scraper benchmark.
+build/scraper_bench.exe : \
+		build/agent/tests/scraper_bench.o \
+		build/agent/agent/SimConsoleBuffer.o \
+		$(filter-out build/agent/agent/main.o,$(AGENT_OBJECTS))
+	$(info Linking $@)
+	@$(MINGW_CXX) $(MINGW_LDFLAGS) -o $@ $^
+
+build/input_map_bench.exe : \
+		build/agent/tests/input_map_bench.o \
+		$(filter-out build/agent/agent/main.o,$(AGENT_OBJECTS))
+	$(info Linking $@)
+	@$(MINGW_CXX) $(MINGW_LDFLAGS) -o $@ $^
+
 TEST_PROGRAMS = \
-        build/trivial_test.exe
+        build/trivial_test.exe \
+        build/scraper_bench.exe \
+        build/input_map_bench.exe
 
 -include $(TEST_PROGRAMS:.exe=.d)
+-include build/agent/tests/scraper_bench.d
+-include build/agent/agent/SimConsoleBuffer.d
+-include build/agent/tests/input_map_bench.d
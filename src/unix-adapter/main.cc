@@ -594,7 +594,8 @@ int main(int argc, char *argv[])
     sz.ws_row = 25;
     ioctl(STDIN_FILENO, TIOCGWINSZ, &sz);
 
-    DWORD agentFlags = WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION;
+    DWORD agentFlags = WINPTY_FLAG_ALLOW_CURPROC_DESKTOP_CREATION |
+                       WINPTY_FLAG_BRACKETED_PASTE;
     if (args.testConerr)        { agentFlags |= WINPTY_FLAG_CONERR; }
     if (args.testPlainOutput)   { agentFlags |= WINPTY_FLAG_PLAIN_OUTPUT; }
     if (args.testColorEscapes)  { agentFlags |= WINPTY_FLAG_COLOR_ESCAPES; }
@@ -690,7 +691,7 @@ int main(int argc, char *argv[])
             ioctl(STDIN_FILENO, TIOCGWINSZ, &sz2);
             if (memcmp(&sz, &sz2, sizeof(sz)) != 0) {
                 sz = sz2;
-                winpty_set_size(wp, sz.ws_col, sz.ws_row, NULL);
+                winpty_set_size_async(wp, sz.ws_col, sz.ws_row, NULL);
             }
         }
 
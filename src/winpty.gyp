@@ -48,18 +48,26 @@
                 },
             },
             'sources' : [
+                'agent/AdaptivePollInterval.h',
                 'agent/Agent.h',
                 'agent/Agent.cc',
                 'agent/AgentCreateDesktop.h',
                 'agent/AgentCreateDesktop.cc',
+                'agent/AgentStats.h',
+                'agent/CellScan.h',
+                'agent/CellScan.cc',
+                'agent/ConsoleBuffer.h',
+                'agent/ConsoleControl.h',
                 'agent/ConsoleFont.cc',
                 'agent/ConsoleFont.h',
                 'agent/ConsoleInput.cc',
                 'agent/ConsoleInput.h',
                 'agent/ConsoleInputReencoding.cc',
                 'agent/ConsoleInputReencoding.h',
+                'agent/ConsoleLimits.h',
                 'agent/ConsoleLine.cc',
                 'agent/ConsoleLine.h',
+                'agent/ConsoleTypes.h',
                 'agent/Coord.h',
                 'agent/DebugShowInput.h',
                 'agent/DebugShowInput.cc',
@@ -70,16 +78,22 @@
                 'agent/EventLoop.cc',
                 'agent/InputMap.h',
                 'agent/InputMap.cc',
+                'agent/KeyboardLayoutCache.h',
+                'agent/KeyboardLayoutCache.cc',
                 'agent/LargeConsoleRead.h',
                 'agent/LargeConsoleRead.cc',
                 'agent/NamedPipe.h',
                 'agent/NamedPipe.cc',
+                'agent/OutputBacklogLimit.h',
+                'agent/OutputQueue.h',
+                'agent/OutputQueue.cc',
                 'agent/Scraper.h',
                 'agent/Scraper.cc',
                 'agent/SimplePool.h',
                 'agent/SmallRect.h',
                 'agent/Terminal.h',
                 'agent/Terminal.cc',
+                'agent/TerminalOutput.h',
                 'agent/UnicodeEncoding.h',
                 'agent/Win32Console.cc',
                 'agent/Win32Console.h',
@@ -101,6 +115,7 @@
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
+                'shared/TraceRing.h',
                 'shared/UnixCtrlChars.h',
                 'shared/WindowsSecurity.cc',
                 'shared/WindowsSecurity.h',
@@ -155,6 +170,7 @@
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
+                'shared/TraceRing.h',
                 'shared/WindowsSecurity.cc',
                 'shared/WindowsSecurity.h',
                 'shared/WindowsVersion.h',
@@ -168,6 +184,17 @@
                 'shared/winpty_snprintf.h',
             ],
         },
+        {
+            # The reference decoder for WINPTY_FLAG_BINARY_FRAMES output,
+            # which clients link statically.
+            'target_name' : 'winpty-frame-decoder',
+            'type' : 'static_library',
+            'sources' : [
+                'include/winpty_constants.h',
+                'shared/FrameDecoder.h',
+                'shared/FrameDecoder.cc',
+            ],
+        },
         {
             'target_name' : 'winpty-debugserver',
             'type' : 'executable',
@@ -188,6 +215,7 @@
                 'shared/StringBuilder.h',
                 'shared/StringUtil.cc',
                 'shared/StringUtil.h',
+                'shared/TraceRing.h',
                 'shared/WindowsSecurity.h',
                 'shared/WindowsSecurity.cc',
                 'shared/WindowsVersion.h',